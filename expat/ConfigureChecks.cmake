@@ -128,3 +128,19 @@ else()
 endif()
 
 check_library_exists(m cos "" _EXPAT_LIBM_FOUND)
+
+# Batching hash salts per thread on Linux needs pthread_atfork, which has
+# to come without a threads library so that linking stays as it is
+if(NOT WIN32)
+    check_symbol_exists("pthread_atfork" "pthread.h" HAVE_PTHREAD_ATFORK)
+endif()
+
+# Parser pools lock their list of idle parsers with a pthread mutex (or a
+# critical section on Windows) if asked to
+if(EXPAT_POOL_LOCKING AND NOT WIN32)
+    set(THREADS_PREFER_PTHREAD_FLAG ON)
+    find_package(Threads REQUIRED)
+    if(NOT CMAKE_USE_PTHREADS_INIT)
+        message(SEND_ERROR "EXPAT_POOL_LOCKING needs pthreads")
+    endif()
+endif()
@@ -8,6 +8,6 @@ Version: $<TARGET_PROPERTY:expat,pkgconfig_version>
 Description: expat XML parser
 URL: https://libexpat.github.io/
 Libs: -L${libdir} -l$<TARGET_PROPERTY:expat,pkgconfig_$<LOWER_CASE:$<CONFIG>>_output_name>
-Libs.private: $<TARGET_PROPERTY:expat,pkgconfig_libm>
+Libs.private: $<TARGET_PROPERTY:expat,pkgconfig_libm> $<TARGET_PROPERTY:expat,pkgconfig_threads>
 Cflags: -I${includedir}
 Cflags.private: -DXML_STATIC
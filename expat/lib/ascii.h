@@ -123,3 +123,5 @@
 #define ASCII_HASH 0x23
 #define ASCII_PIPE 0x7C
 #define ASCII_COMMA 0x2C
+#define ASCII_QUEST 0x3F
+#define ASCII_CR 0x0D
@@ -290,6 +290,49 @@ XML_ParserCreate_MM(const XML_Char *encoding,
 XMLPARSEAPI(XML_Bool)
 XML_ParserReset(XML_Parser parser, const XML_Char *encoding);
 
+/* A pool of parsers for applications that parse many documents with the
+   same kind of parser.  Released parsers are reset and kept, together
+   with the memory they allocated, up to maxIdle of them.  The other
+   arguments are those of XML_ParserCreate_MM; they apply to every parser
+   the pool creates.
+
+   XML_ParserPoolAcquire returns a parser that behaves like a new one, or
+   NULL if we are out of memory.  XML_ParserPoolRelease takes a parser back
+   from the application, which must not use it afterwards; it returns
+   XML_FALSE, leaving the parser with the application, if called from
+   inside a handler or with a parser for an external entity.  A parser
+   created with other arguments than those of the pool is freed rather
+   than kept, and parsers from a pool may be freed with XML_ParserFree
+   instead of being released.  XML_ParserPoolFree frees the pool and the
+   idle parsers in it.
+
+   Pools do no locking by default: the application has to make sure that
+   only one thread at a time calls a function on a pool, for example with
+   a lock of its own.  If Expat was built with pool locking (the CMake
+   option EXPAT_POOL_LOCKING or configure --enable-pool-locking, which
+   make it depend on pthreads outside of Windows), several threads may
+   acquire and release parsers of the same pool at the same time.  A
+   parser itself is always used by one thread at a time, and
+   XML_ParserPoolFree must not race with any other call.
+
+   Added in Expat 2.8.4.
+*/
+typedef struct XML_ParserPoolStruct *XML_ParserPool;
+
+XMLPARSEAPI(XML_ParserPool)
+XML_ParserPoolCreate(const XML_Char *encoding,
+                     const XML_Memory_Handling_Suite *memsuite,
+                     const XML_Char *namespaceSeparator, unsigned int maxIdle);
+
+XMLPARSEAPI(XML_Parser)
+XML_ParserPoolAcquire(XML_ParserPool pool);
+
+XMLPARSEAPI(XML_Bool)
+XML_ParserPoolRelease(XML_ParserPool pool, XML_Parser parser);
+
+XMLPARSEAPI(void)
+XML_ParserPoolFree(XML_ParserPool pool);
+
 /* atts is array of name/value pairs, terminated by 0;
    names and values are 0 terminated.
 */
@@ -300,6 +343,22 @@ typedef void(XMLCALL *XML_StartElementHandler)(void *userData,
 typedef void(XMLCALL *XML_EndElementHandler)(void *userData,
                                              const XML_Char *name);
 
+/* Like XML_StartElementHandler and XML_EndElementHandler, but every name
+   comes with its symbol ID, see XML_GetSymbolId; attIds[i] is the ID of
+   the attribute name in atts[2 * i].
+
+   Added in Expat 2.8.4.
+*/
+typedef void(XMLCALL *XML_StartElementIdHandler)(void *userData,
+                                                 const XML_Char *name,
+                                                 int nameId,
+                                                 const XML_Char **atts,
+                                                 const int *attIds);
+
+typedef void(XMLCALL *XML_EndElementIdHandler)(void *userData,
+                                               const XML_Char *name,
+                                               int nameId);
+
 /* s is not 0 terminated. */
 typedef void(XMLCALL *XML_CharacterDataHandler)(void *userData,
                                                 const XML_Char *s, int len);
@@ -563,6 +622,141 @@ XML_SetStartElementHandler(XML_Parser parser, XML_StartElementHandler handler);
 XMLPARSEAPI(void)
 XML_SetEndElementHandler(XML_Parser parser, XML_EndElementHandler handler);
 
+/* Sets handlers that are called instead of the ones set with
+   XML_SetElementHandler, XML_SetStartElementHandler and
+   XML_SetEndElementHandler.  Where start or end is NULL, the other
+   handler is called as before.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(void)
+XML_SetElementIdHandler(XML_Parser parser, XML_StartElementIdHandler start,
+                        XML_EndElementIdHandler end);
+
+/* Returns the symbol ID of name, the positive number that stands for name
+   in the handlers set with XML_SetElementIdHandler, or 0 if parser or
+   name is NULL or we are out of memory.  A name that has not been seen
+   yet gets the next free ID, so applications can look up the IDs of the
+   names they dispatch on before parsing.  Element and attribute names
+   share IDs, and are taken as they are written in the document: with
+   namespace processing, an ID stands for the prefixed name rather than
+   the expanded name passed to the handlers.  IDs are shared with
+   external entity parsers, and are given out anew after XML_ParserReset.
+   A parser from XML_FragmentParserCreate starts with the IDs of its
+   parser, but the IDs that it gives out later are its own.
+   XML_SetHashSalt and XML_SetHashSalt16Bytes fail once IDs have been
+   given out, so a salt has to be set before.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(int)
+XML_GetSymbolId(XML_Parser parser, const XML_Char *name);
+
+/* A vocabulary is a frozen set of element and attribute names, as written
+   in documents, that many parsers can share.  XML_VocabularyCreate builds
+   a perfect hash table of names, a NULL terminated array; it copies the
+   names and returns NULL if a name is given twice or we are out of memory.
+   memsuite may be NULL to use the standard library memory functions.
+   A vocabulary is never changed after creation, so parsers in different
+   threads may use it at the same time; it must outlive them.
+
+   XML_SetVocabulary attaches a vocabulary to a parser and the external
+   entity parsers it creates, or detaches it if vocabulary is NULL.  The
+   parser then finds these names by that table instead of hashing them
+   into its own tables, and the i-th name always has the symbol ID i + 1,
+   see XML_GetSymbolId; names outside the vocabulary get IDs after those.
+   It returns XML_FALSE for external entity parsers, once parsing has
+   started, once IDs have been given out to names outside the vocabulary,
+   and if we are out of memory.  XML_ParserReset keeps the vocabulary, while
+   XML_ParserPoolRelease drops it.
+
+   Added in Expat 2.8.4.
+*/
+typedef struct XML_VocabularyStruct *XML_Vocabulary;
+
+XMLPARSEAPI(XML_Vocabulary)
+XML_VocabularyCreate(const XML_Char *const *names,
+                     const XML_Memory_Handling_Suite *memsuite);
+
+XMLPARSEAPI(void)
+XML_VocabularyFree(XML_Vocabulary vocabulary);
+
+XMLPARSEAPI(XML_Bool)
+XML_SetVocabulary(XML_Parser parser, XML_Vocabulary vocabulary);
+
+/* A DTD snapshot is a frozen copy of what a parser has learned from
+   document type declarations: entities, attribute defaults and the like.
+   XML_DTDSnapshotCreate takes one from a parser that is not in the middle
+   of parsing; it returns NULL for external entity parsers, for parsers
+   that use a snapshot themselves, and if we are out of memory.  The
+   snapshot uses the memory handling functions and the hash salt of the
+   parser, which may be freed afterwards.
+
+   XML_SetDTDSnapshot attaches a snapshot to a parser, or detaches it if
+   snapshot is NULL.  The parser then starts out with all declarations
+   of the snapshot, as if they came before its own DTD, and shares them
+   with the external entity parsers it creates.  Parsing keeps state of
+   its own in entities, element types and attributes, so each parser
+   copies those of the snapshot that a document uses into its own tables
+   when it first meets them, but not the strings they point to.
+   Declarations of the document that the snapshot already has are
+   ignored, as the first declaration is binding.  Since a snapshot is
+   never changed, parsers in different threads may use it at the same
+   time; it must outlive them.  It returns XML_FALSE for external entity
+   parsers, once parsing has started, if exactly one of the snapshot and
+   the parser does namespace processing, and if parser is NULL.
+   XML_ParserReset keeps the snapshot, while XML_ParserPoolRelease
+   drops it.
+
+   Added in Expat 2.8.4.
+*/
+typedef struct XML_DTDSnapshotStruct *XML_DTDSnapshot;
+
+XMLPARSEAPI(XML_DTDSnapshot)
+XML_DTDSnapshotCreate(XML_Parser parser);
+
+XMLPARSEAPI(void)
+XML_DTDSnapshotFree(XML_DTDSnapshot snapshot);
+
+XMLPARSEAPI(XML_Bool)
+XML_SetDTDSnapshot(XML_Parser parser, XML_DTDSnapshot snapshot);
+
+/* A DTD cache keeps the external subsets that parsers read through the
+   external entity reference handler, in the form of DTD snapshots, so
+   that later documents with the same external subset are spared the
+   handler call and the parsing.  Entries are keyed by the base, system
+   ID and public ID passed to the handler, and by whether the parser does
+   namespace processing.  The cache cannot tell whether a subset has
+   changed since it was read; free it when that may be the case.
+
+   XML_SetDTDCache makes a parser use the cache, or stop using any if
+   cache is NULL; the cache must outlive the parser.  A parser only uses
+   it where the outcome is the same: with no snapshot, when the internal
+   subset, if any, declares nothing, and when no handler that could be
+   told about anything in the external subset is set.  These are the
+   declaration handlers, the comment, processing instruction, XML
+   declaration, skipped entity, doctype declaration, not standalone and
+   default handlers, and event batches, event arrays and pull parsing.
+   When a subset is taken from the cache, the external entity reference
+   handler is not called for it.  Subsets that end up not being read
+   completely are not kept.  Parsers using the same cache must
+   run in the same thread.  It returns XML_FALSE for external entity
+   parsers, once parsing has started, and if parser is NULL.
+   XML_ParserReset keeps the cache, while XML_ParserPoolRelease drops it.
+
+   Added in Expat 2.8.4.
+*/
+typedef struct XML_DTDCacheStruct *XML_DTDCache;
+
+XMLPARSEAPI(XML_DTDCache)
+XML_DTDCacheCreate(const XML_Memory_Handling_Suite *memsuite);
+
+XMLPARSEAPI(void)
+XML_DTDCacheFree(XML_DTDCache cache);
+
+XMLPARSEAPI(XML_Bool)
+XML_SetDTDCache(XML_Parser parser, XML_DTDCache cache);
+
 XMLPARSEAPI(void)
 XML_SetCharacterDataHandler(XML_Parser parser,
                             XML_CharacterDataHandler handler);
@@ -797,6 +991,19 @@ XML_GetBuffer(XML_Parser parser, int len);
 XMLPARSEAPI(enum XML_Status)
 XML_ParseBuffer(XML_Parser parser, int len, int isFinal);
 
+/* Like XML_Parse, but parses the input where it is rather than copying it
+   to the internal buffer first.  Only a token that is cut off at the end
+   of s (or, after suspension, the input not parsed yet) is copied, so that
+   s does not have to stay valid once the call returns.  While handlers run,
+   XML_GetInputContext reports context from s; after an error, the context
+   around it is copied to the internal buffer.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(enum XML_Status)
+XML_ParseExternalBuffer(XML_Parser parser, const char *s, int len,
+                        int isFinal);
+
 /* Stops parsing, causing XML_Parse() or XML_ParseBuffer() to return.
    Must be called from within a call-back handler, except when aborting
    (resumable = 0) an already suspended parser. Some call-backs may
@@ -881,6 +1088,76 @@ XMLPARSEAPI(XML_Parser)
 XML_ExternalEntityParserCreate(XML_Parser parser, const XML_Char *context,
                                const XML_Char *encoding);
 
+/* Creates a parser for a fragment of the document that parser is
+   parsing: a run of element content, parsed as if it were the
+   replacement text of an external parsed entity referenced at the
+   current position of parser.  The in-scope namespace declarations,
+   the DTD, the handlers, userData and the settings are taken from
+   parser, which has to be a parser for a document or an external
+   parsed entity.  Unlike with XML_ExternalEntityParserCreate, the new
+   parser is a root parser of its own: it is not accounted to parser
+   and may be parsed and freed in any order relative to it.  The DTD
+   tables are copied, but a shared DTD base of parser (see
+   XML_SetDTDSnapshot) is shared, and has to outlive the new parser.
+   Names keep the symbol IDs that parser has given out so far (see
+   XML_GetSymbolId); IDs that the new parser gives out to new names are
+   local to it, and parser or other fragment parsers may give the same
+   IDs to other names.  An event array of parser (see
+   XML_SetEventArrayHandler) is not shared either.
+
+   This allows a caller to parse one large document on several threads:
+   after the prolog and the start tag of the document element have been
+   parsed by parser, split the content of the document element at '<'
+   characters that look like start tags.  Parse the first piece with
+   parser, every other piece with a parser from this function and
+   isFinal set to XML_TRUE, and then the end tag of the document element
+   with parser again.  The split is speculative; it was correct if every
+   fragment parser succeeds.  If any of them fails (for example, because
+   the split fell into a comment or a CDATA section, or between a start
+   tag and its end tag), discard the speculative results and parse the
+   input sequentially instead.
+   Returns NULL if parser is NULL, a parameter entity parser, or if out
+   of memory.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Parser)
+XML_FragmentParserCreate(XML_Parser parser, const XML_Char *encoding);
+
+/* Called by XML_ScanRecords for every record that it finds; s and len
+   delimit the record, from the '<' of its start tag to the '>' of its
+   end tag, in the input passed to XML_ScanRecords.
+*/
+typedef void(XMLCALL *XML_RecordHandler)(void *userData, const char *s,
+                                         int len);
+
+/* Scans input that continues the content of the element that parser is
+   in, and reports every child element of that element as a record to
+   handler, without parsing it.  This is for documents such as feeds,
+   where an element holds a long run of independent records: each record
+   (or each run of consecutive records) can then be parsed with a parser
+   from XML_FragmentParserCreate, on any thread.  The scan only splits
+   tokens, so it is much faster than parsing, but it does not check
+   whether the records are well-formed; that is left to the parsers of
+   the records.  Character data, comments and processing instructions
+   between the records are skipped.
+
+   parser has to have parsed all the input passed to it so far and be in
+   content, for example right after the start tag of the document
+   element.  Returns the number of bytes that were scanned: up to the
+   end tag of the element that parser is in, or, if the input ends
+   before it, up to the start of the first incomplete record.  In the
+   former case, parsing continues by passing the rest of the input to
+   parser; in the latter, by passing the unscanned bytes, followed by
+   more input, to XML_ScanRecords again.  Returns -1 if the input
+   contains an invalid token or if parser is not in content.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(int)
+XML_ScanRecords(XML_Parser parser, const char *s, int len,
+                XML_RecordHandler handler, void *userData);
+
 enum XML_ParamEntityParsing {
   XML_PARAM_ENTITY_PARSING_NEVER,
   XML_PARAM_ENTITY_PARSING_UNLESS_STANDALONE,
@@ -1051,6 +1328,8 @@ enum XML_FeatureEnum {
   /* Added in Expat 2.7.2. */
   XML_FEATURE_ALLOC_TRACKER_MAXIMUM_AMPLIFICATION_DEFAULT,
   XML_FEATURE_ALLOC_TRACKER_ACTIVATION_THRESHOLD_DEFAULT,
+  /* Added in Expat 2.8.4. */
+  XML_FEATURE_ADAPTIVE_HASH,
   /* Additional features must be added to the end of this enum. */
 };
 
@@ -1091,6 +1370,214 @@ XML_SetAllocTrackerActivationThreshold(
 XMLPARSEAPI(XML_Bool)
 XML_SetReparseDeferralEnabled(XML_Parser parser, XML_Bool enabled);
 
+/* Has the character data handler called once per run of text between
+   two pieces of markup, rather than once per line, reference or input
+   chunk.  The text is collected until the next start tag, end tag,
+   comment or processing instruction, or the next CDATA section or
+   entity reference that is reported to another handler; it is held
+   across parse calls.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetCharacterDataCoalescing(XML_Parser parser, XML_Bool enabled);
+
+/* XML_ParserReset keeps the string pools of the parser sized for the
+   most demanding of the last few documents, so that the next document
+   need not grow them step by step again, and releases the rest.
+   XML_SetMemoryRetention sets how many documents that is: at most 16,
+   and 4 by default; with 0, XML_ParserReset releases all memory it can.
+   It returns XML_FALSE for external entity parsers, if documents is out
+   of range and if parser is NULL.  XML_ParserReset keeps the setting.
+
+   XML_TrimMemory releases all memory that the parser only keeps for
+   later documents, say after an unusually large one: unused string pool
+   and DTD memory, tags and namespace bindings kept for reuse, and the
+   input buffer.  The input buffer is kept if XML_GetBuffer has returned
+   it since the parser was created or reset, as the application may be
+   filling it for XML_ParseBuffer; otherwise buffers that XML_GetBuffer
+   returned before are no longer valid.  It returns XML_FALSE once
+   parsing has started (until XML_ParserReset), for external entity
+   parsers and if parser is NULL.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetMemoryRetention(XML_Parser parser, unsigned int documents);
+
+XMLPARSEAPI(XML_Bool)
+XML_TrimMemory(XML_Parser parser);
+
+/* In document arena mode, the parser takes the memory for open tags,
+   namespace bindings and open entities from a few large blocks instead
+   of allocating each of them on its own.  XML_ParserReset then takes it
+   all back at once, keeping the blocks for the next document, and
+   XML_ParserFree only has to free the blocks.  Buffers for long tag
+   names and namespace URIs that have to grow leave their old memory
+   unused until then.  The blocks count against the limits set with
+   XML_SetAllocTrackerMaximumAmplification like all other memory.  The
+   mode is off by default and XML_ParserReset keeps it.
+
+   Returns XML_FALSE once parsing has started (until XML_ParserReset), for
+   external entity parsers, which inherit the mode of their parent, and if
+   parser is NULL.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetDocumentArena(XML_Parser parser, XML_Bool enabled);
+
+/* The kinds of events in an event batch, see XML_SetEventBatchHandler.
+
+   Added in Expat 2.8.4.
+*/
+enum XML_EventType {
+  XML_EVENT_START_ELEMENT = 1,
+  XML_EVENT_END_ELEMENT,
+  XML_EVENT_CHARACTER_DATA,
+  XML_EVENT_PROCESSING_INSTRUCTION,
+  XML_EVENT_COMMENT,
+  XML_EVENT_START_CDATA_SECTION,
+  XML_EVENT_END_CDATA_SECTION
+};
+
+/* An event in an event batch.  name is the element name, or the target of
+   a processing instruction, and atts are the attributes of a start
+   element, as they would be passed to the handlers.  nameId and attIds
+   are the symbol IDs of the element name and of the attribute names, as
+   the handlers set with XML_SetElementIdHandler get them.  data and
+   dataLen are the character data, the data of a processing instruction,
+   or the text of a comment; only the latter two are '\0'-terminated.
+   Adjacent character data is recorded as a single event.  byteIndex is
+   what XML_GetCurrentByteIndex returns for the event.  Members that do
+   not apply to an event are NULL or 0.
+
+   Added in Expat 2.8.4.
+*/
+typedef struct {
+  enum XML_EventType type;
+  const XML_Char *name;
+  int nameId;
+  const XML_Char **atts;
+  const int *attIds;
+  const XML_Char *data;
+  int dataLen;
+  XML_Index byteIndex;
+} XML_Event;
+
+struct XML_EventBatchStruct;
+typedef struct XML_EventBatchStruct *XML_EventBatch;
+
+typedef void(XMLCALL *XML_EventBatchHandler)(void *userData,
+                                             XML_EventBatch batch);
+
+/* With an event batch handler set, the parser records start and end tags,
+   character data, processing instructions, comments and CDATA section
+   boundaries as events in batches of up to maxEvents events, instead of
+   reporting them to their handlers.  A batch is passed to handler once it
+   is full, and at the latest when the call to XML_Parse or
+   XML_ParseBuffer that recorded its first event returns.  Other events,
+   such as namespace declarations or DTD declarations, go to their
+   handlers right away.
+
+   A batch is owned by the application from then on.  It holds copies of
+   everything its events point to, so it can be read on any thread while
+   the parser goes on with the next batch: one thread can parse while
+   another one runs the application code for the events.  When done with
+   a batch, pass it back with XML_ReleaseEventBatch on the thread that
+   parses, for example from handler, so that the parser can reuse it.
+   XML_ParserFree frees all batches, released or not.  External entity
+   parsers inherit the handler and record into the batches of their
+   parent parser, so that all events stay in document order.
+
+   handler NULL turns event batches off, and maxEvents is ignored then.
+   Returns XML_FALSE once parsing has started (until XML_ParserReset,
+   which also turns event batches off), for external entity parsers, if
+   maxEvents is less than 1, and if parser is NULL.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetEventBatchHandler(XML_Parser parser, XML_EventBatchHandler handler,
+                         int maxEvents);
+
+/* Returns the events of batch and stores their number in *count.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(const XML_Event *)
+XML_GetEventBatchEvents(XML_EventBatch batch, int *count);
+
+/* Gives batch back to parser, which passed it to the event batch
+   handler, for reuse.  The events of batch must not be used any more.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(void)
+XML_ReleaseEventBatch(XML_Parser parser, XML_EventBatch batch);
+
+typedef void(XMLCALL *XML_EventArrayHandler)(void *userData,
+                                             const XML_Event *events,
+                                             int count);
+
+/* Like XML_SetEventBatchHandler, but the parser records the events into
+   events, an array of maxEvents events that the application provides,
+   and passes them to handler whenever the array is full, and at the
+   latest when the call to XML_Parse or XML_ParseBuffer that recorded the
+   first of them returns.  This way the application pays for one call
+   per array of events rather than for one call per event.  The events
+   and everything they point to are only valid until handler returns,
+   after which the parser reuses the array.
+
+   handler NULL turns the event array off, and events and maxEvents are
+   ignored then.  Returns XML_FALSE once parsing has started (until
+   XML_ParserReset, which also turns the event array off), for external
+   entity parsers, if events is NULL or maxEvents is less than 1, and if
+   parser is NULL.  The event array, event batches and pull parsing
+   replace each other.  A parser from XML_FragmentParserCreate does not
+   take over the event array, which belongs to parser; it calls the
+   handlers of the events instead, unless it is given an array of its own.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetEventArrayHandler(XML_Parser parser, XML_EventArrayHandler handler,
+                         XML_Event *events, int maxEvents);
+
+/* Turns parser into a pull parser: instead of calling handlers, it records
+   the events that event batches would hold (see XML_SetEventBatchHandler)
+   for XML_NextEvent to return one at a time.  Input is passed with
+   XML_Parse or XML_ParseBuffer as usual, but these suspend parsing once
+   at least maxEvents events are waiting and then return
+   XML_STATUS_SUSPENDED.  XML_NextEvent resumes parsing when it has
+   returned all of them, so parsing is suspended once every maxEvents
+   events rather than once per event.  Pull events until XML_NextEvent
+   returns NULL before passing more input.  maxEvents 0 turns pull
+   parsing off, and event batches and the event array are off while it
+   is on.
+
+   Returns XML_FALSE once parsing has started (until XML_ParserReset,
+   which also turns pull parsing off), for external entity parsers, if
+   maxEvents is negative, and if parser is NULL.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(XML_Bool)
+XML_SetPullParsing(XML_Parser parser, int maxEvents);
+
+/* Stores the next event of a pull parser in *event, resuming parsing if
+   needed.  *event is NULL once all input passed to the parser so far has
+   been parsed; then XML_GetParsingStatus tells if the parser needs more
+   input or has finished.  The event stays valid until the next call to
+   XML_NextEvent, XML_Parse or XML_ParseBuffer.  Returns XML_STATUS_ERROR
+   if parsing fails, after which the events recorded up to the error can
+   still be pulled, and if the parser does not do pull parsing.
+
+   Added in Expat 2.8.4.
+*/
+XMLPARSEAPI(enum XML_Status)
+XML_NextEvent(XML_Parser parser, const XML_Event **event);
+
 /* Expat follows the semantic versioning convention.
    See https://semver.org
 */
@@ -182,6 +182,8 @@ void *expat_malloc(XML_Parser parser, size_t size, int sourceLine);
 void expat_free(XML_Parser parser, void *ptr, int sourceLine);
 void *expat_realloc(XML_Parser parser, void *ptr, size_t size, int sourceLine);
 extern unsigned int g_bytesScanned; // used for testing only
+extern XML_Bool g_fastHashCollides; // used for testing only
+void testingGetHashSalt(XML_Parser parser, unsigned char salt[16]);
 #endif
 
 #ifdef __cplusplus
@@ -85,3 +85,32 @@ EXPORTS
 @_EXPAT_COMMENT_DTD_OR_GE@ XML_SetAllocTrackerActivationThreshold @73
 ; added with version 2.8.0
   XML_SetHashSalt16Bytes @74
+; added with version 2.8.4
+  XML_ParseExternalBuffer @75
+  XML_SetCharacterDataCoalescing @76
+  XML_ParserPoolCreate @77
+  XML_ParserPoolAcquire @78
+  XML_ParserPoolRelease @79
+  XML_ParserPoolFree @80
+  XML_SetElementIdHandler @81
+  XML_GetSymbolId @82
+  XML_VocabularyCreate @83
+  XML_VocabularyFree @84
+  XML_SetVocabulary @85
+  XML_DTDSnapshotCreate @86
+  XML_DTDSnapshotFree @87
+  XML_SetDTDSnapshot @88
+  XML_DTDCacheCreate @89
+  XML_DTDCacheFree @90
+  XML_SetDTDCache @91
+  XML_SetMemoryRetention @92
+  XML_TrimMemory @93
+  XML_SetDocumentArena @94
+  XML_FragmentParserCreate @95
+  XML_ScanRecords @96
+  XML_SetEventBatchHandler @97
+  XML_GetEventBatchEvents @98
+  XML_ReleaseEventBatch @99
+  XML_SetPullParsing @100
+  XML_NextEvent @101
+  XML_SetEventArrayHandler @102
@@ -147,6 +147,20 @@
 #  include "random_rand_s.h"
 #endif /* defined(_WIN32) */
 
+/* Hash salts are taken from a batch of entropy per thread on Linux, see
+   takeBatchedEntropy; this needs thread-local storage and pthread_atfork. */
+#if defined(__linux__) && defined(HAVE_PTHREAD_ATFORK)                         \
+    && (defined(__GNUC__) || defined(__clang__))
+#  define XML_ENTROPY_BATCH 1
+#  include <pthread.h> /* pthread_atfork */
+#endif
+
+/* Parser pools lock their list of idle parsers if built with
+   XML_POOL_LOCKING, see poolLock */
+#if defined(XML_POOL_LOCKING) && ! defined(_WIN32)
+#  include <pthread.h> /* pthread_mutex_t */
+#endif
+
 #if ! defined(HAVE_GETRANDOM) && ! defined(HAVE_SYSCALL_GETRANDOM)             \
     && ! defined(HAVE_ARC4RANDOM_BUF) && ! defined(HAVE_ARC4RANDOM)            \
     && ! defined(HAVE_GETENTROPY) && ! defined(XML_DEV_URANDOM)                \
@@ -233,20 +247,76 @@ typedef struct {
   KEY name;
 } NAMED;
 
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size; // bytes available after the header
+  size_t used;
+} ARENA_BLOCK;
+
+/* Memory for objects that live exactly as long as the DTD they belong to:
+   it is handed out from a list of blocks, and only given back all at once
+   by arenaClear or arenaDestroy */
+typedef struct {
+  ARENA_BLOCK *blocks; // oldest first
+  ARENA_BLOCK *block;  // block that memory is taken from currently
+  XML_Parser parser;
+} ARENA;
+
+/* Hash tables take both their slots and their entries from an arena, so
+   slots left behind by growing a table are only reclaimed together with
+   the entries */
 typedef struct {
-  NAMED **v;
+  NAMED **v;           // followed by one tag byte per slot, see HASH_TAG
   unsigned char power;
   size_t size;
   size_t used;
-  XML_Parser parser;
+  ARENA *arena;
+  XML_Bool sipHash; // see lookupWithLength
 } HASH_TABLE;
 
 static size_t keylen(KEY s);
 
 static void copy_salt_to_sipkey(XML_Parser parser, struct sipkey *key);
-
-/* For probing (after a collision) we need a step size relative prime
-   to the hash table size, which is a power of 2. We use double-hashing,
+static unsigned long FASTCALL hash(XML_Parser parser, XML_Bool sipHash,
+                                   KEY s, size_t keyLen);
+static unsigned long FASTCALL hashWithKey(const struct sipkey *key,
+                                          XML_Bool sipHash, KEY s,
+                                          size_t keyLen);
+static uint64_t FASTCALL fastHash64(const struct sipkey *key, const void *s,
+                                    size_t len);
+
+/* The slots of a hash table are probed in groups of HASH_GROUP_SIZE
+   consecutive slots.  Every slot has a tag byte next to it, which is zero
+   for an empty slot and is made of the top bits of the hash value of the
+   entry otherwise.  That way, most slots that cannot match are skipped
+   without touching the entry or its name.  Groups are visited in
+   triangular order, i.e. at offsets 1, 3, 6, 10, ... from the first one,
+   which visits every group once since the number of groups is a power
+   of 2.  Entries are never removed, so the first empty slot ends a
+   search, and is where a missing entry goes.
+*/
+#define HASH_GROUP_SIZE 8
+/* Names are hashed with fastHash until a lookup has to probe more than
+   HASH_MAX_PROBE_GROUPS groups, which random hash values practically never
+   make it do, and with SipHash from then on */
+#define HASH_MAX_PROBE_GROUPS 16
+#define FAST_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+#define FAST_HASH_FINAL_MULTIPLIER 0xFF51AFD7ED558CCDULL
+#define HASH_TAG(hash)                                                         \
+  ((unsigned char)(0x80u | ((hash) >> (sizeof(unsigned long) * 8 - 7))))
+#define HASH_TAGS(table) ((unsigned char *)((table)->v + (table)->size))
+#define HASH_ENTRY_HEADER_SIZE                                                 \
+  ROUND_UP(sizeof(unsigned long), EXPAT_MALLOC_ALIGNMENT)
+#define HASH_ENTRY_HASH(named)                                                 \
+  (*(const unsigned long *)((const char *)(named) - HASH_ENTRY_HEADER_SIZE))
+
+#define ARENA_BLOCK_HEADER_SIZE                                                \
+  ROUND_UP(sizeof(ARENA_BLOCK), EXPAT_MALLOC_ALIGNMENT)
+#define ARENA_MIN_BLOCK_SIZE 1024
+#define ARENA_MAX_BLOCK_SIZE 65536
+
+/* For probing (after a collision) in m_nsAtts we need a step size relative
+   prime to the hash table size, which is a power of 2. We use double-hashing,
    since we can calculate a second hash value cheaply by taking those bits
    of the first hash value that were discarded (masked out) when the table
    index was calculated: index = hash & mask, where mask = table->size - 1.
@@ -257,6 +327,8 @@ static void copy_salt_to_sipkey(XML_Parser parser, struct sipkey *key);
   ((((hash) & ~(mask)) >> ((power) - 1)) & ((mask) >> 2))
 #define PROBE_STEP(hash, mask, power)                                          \
   ((unsigned char)((SECOND_HASH(hash, mask, power)) | 1))
+/* m_nsAtts is at most half full, so this many probes means collisions */
+#define NS_ATTS_MAX_PROBES 16
 
 typedef struct {
   NAMED **p;
@@ -268,6 +340,10 @@ typedef struct {
 #define INIT_ATTS_SIZE 16
 #define INIT_ATTS_VERSION 0xFFFFFFFF
 #define INIT_BLOCK_SIZE 1024
+/* How many documents back string pools remember their peak size, and how
+   many of them XML_ParserReset sizes them for by default, see poolRetain */
+#define POOL_PEAK_HISTORY 16
+#define POOL_RETAINED_DOCUMENTS_DEFAULT 4
 #define INIT_BUFFER_SIZE 1024
 
 #define EXPAND_SPARE 24
@@ -294,6 +370,7 @@ typedef struct {
   size_t strLen;
   size_t uriLen;
   size_t prefixLen;
+  int symbolId; /* set by storeAtts for the element ID handlers */
 } TAG_NAME;
 
 /* TAG represents an open element.
@@ -365,6 +442,11 @@ typedef struct {
   XML_Char *ptr;
   XML_Char *start;
   XML_Parser parser;
+  size_t usedSize; // in XML_Char, of blocks but the first, see poolGrowBy
+  size_t peakSize; // most XML_Char used at once in the current document
+  size_t peaks[POOL_PEAK_HISTORY]; // of previous documents, see poolRetain
+  unsigned int nextPeak;
+  int firstBlockSize;
 } STRING_POOL;
 
 /* The XML_Char before the name is used to determine whether
@@ -374,6 +456,7 @@ typedef struct attribute_id {
   PREFIX *prefix;
   XML_Bool maybeTokenized;
   XML_Bool xmlns;
+  int symbolId; /* 0 until first needed, see getSymbolId */
 } ATTRIBUTE_ID;
 
 typedef struct {
@@ -402,8 +485,21 @@ typedef struct {
   unsigned long version;
   unsigned long hash;
   const XML_Char *uriName;
+  size_t hashedLen; // of uriName, which may have the prefix appended
 } NS_ATT;
 
+/* Element types and attribute IDs are also looked up by their name as it
+   appears in the input, so that names repeated across tags need not be
+   copied and hashed every time.  This only works where the input needs no
+   conversion, i.e. where the raw name already is the XML_Char string that
+   the hash tables hold.  The caches are small and lossy; an entry is only
+   used if its name equals the raw name, and anything else goes through
+   the hash tables as before.  Entries point into the DTD, so they are
+   dropped by parserInit, which precedes any reset of the DTD.
+*/
+#define NAME_CACHE_POWER 6
+#define NAME_CACHE_SIZE (1 << NAME_CACHE_POWER)
+
 typedef struct {
   const XML_Char *name;
   PREFIX *prefix;
@@ -412,9 +508,76 @@ typedef struct {
   size_t allocDefaultAtts;
   DEFAULT_ATTRIBUTE *defaultAtts;
   HASH_TABLE defaultAttForName;
+  /* For an element type copied from a DTD snapshot, the table of the
+     snapshot that stands in for defaultAttForName until a declaration
+     adds to the type, see dtdCopyBaseElementType */
+  const HASH_TABLE *baseDefaultAttForName;
+  int symbolId; /* 0 until first needed, see getSymbolId */
 } ELEMENT_TYPE;
 
+/* Symbol IDs are kept by the root parser, so that external entity parsers
+   with a DTD of their own hand out the same IDs */
 typedef struct {
+  const XML_Char *name;
+  int id;
+} SYMBOL;
+
+/* A vocabulary is a perfect hash table in the manner of "hash, displace
+   and compress": the low bits of the hash value of a name pick a bucket,
+   and the displacement of that bucket is mixed into the high bits to pick
+   the slot, which holds the index of the only name that can be there.
+   Buckets are placed largest first, trying displacements until all names
+   of a bucket land in free slots; should a bucket find none, we start over
+   with another key.  Lookups hash once and compare against one name.
+
+   The table maps names to indices only.  The element types and attribute
+   IDs that go with them live in the DTD of each parser as before, since
+   parsing writes to them, and parsers keep arrays of them by index.
+*/
+#define VOCABULARY_MAX_ATTEMPTS 64
+#define VOCABULARY_MIX(displacement) ((displacement) * 0x9E3779B9u)
+#define VOCABULARY_SLOT(hash, displacement)                                    \
+  ((unsigned int)((hash) >> 32) ^ VOCABULARY_MIX(displacement))
+
+struct XML_VocabularyStruct {
+  XML_Memory_Handling_Suite m_mem;
+  struct sipkey m_key;
+  int m_count;
+  unsigned int m_bucketMask;
+  unsigned int m_slotMask;
+  const XML_Char **m_names;      // stored right after the vocabulary
+  size_t *m_lengths;             // of m_names, in XML_Char
+  int *m_slots;                  // indices into m_names, or -1
+  unsigned int *m_displacements; // one per bucket
+};
+
+/* The DTD of a snapshot is held by a parser that never parses, so that
+   it can be copied and freed like any other */
+struct XML_DTDSnapshotStruct {
+  XML_Parser m_holder;
+};
+
+/* An external subset kept in a DTD cache, with the key it was read under */
+typedef struct dtd_cache_entry {
+  struct dtd_cache_entry *next;
+  const XML_Char *base; // these three are stored right after the entry
+  const XML_Char *systemId;
+  const XML_Char *publicId;
+  XML_Bool ns;
+  XML_DTDSnapshot snapshot;
+} DTD_CACHE_ENTRY;
+
+struct XML_DTDCacheStruct {
+  XML_Memory_Handling_Suite m_mem;
+  DTD_CACHE_ENTRY *m_entries;
+};
+
+static int vocabularyFind(const struct XML_VocabularyStruct *vocabulary,
+                          const XML_Char *s, size_t len);
+static XML_Bool setVocabulary(XML_Parser parser, XML_Vocabulary vocabulary);
+
+typedef struct dtd_struct {
+  ARENA arena; // for hash tables and default attributes
   HASH_TABLE generalEntities;
   HASH_TABLE elementTypes;
   HASH_TABLE attributeIds;
@@ -433,6 +596,9 @@ typedef struct {
   HASH_TABLE paramEntities;
 #endif /* XML_DTD */
   PREFIX defaultPrefix;
+  /* A DTD snapshot, see dtdLookup, and the salt its tables are hashed with */
+  const struct dtd_struct *base;
+  struct sipkey baseKey;
   /* === scaffolding for building content model === */
   XML_Bool in_eldecl;
   CONTENT_SCAFFOLD *scaffold;
@@ -460,6 +626,20 @@ typedef struct open_internal_entity {
   enum EntityType type;
 } OPEN_INTERNAL_ENTITY;
 
+/* Events recorded for the event batch handler, the event array handler
+   or XML_NextEvent; everything they point to comes from arena, so that
+   the batch can be read on any thread */
+struct XML_EventBatchStruct {
+  struct XML_EventBatchStruct *next;     // in m_eventBatches
+  struct XML_EventBatchStruct *nextFree; // in m_freeEventBatches
+  int size;
+  int count;
+  int pulled;            // events returned by XML_NextEvent
+  XML_Bool callerEvents; // events is the array of the event array handler
+  XML_Event *events;
+  ARENA arena;
+};
+
 enum XML_Account {
   XML_ACCOUNT_DIRECT,           /* bytes directly passed to the Expat parser */
   XML_ACCOUNT_ENTITY_EXPANSION, /* intermediate bytes produced during entity
@@ -543,9 +723,10 @@ static enum XML_Error doIgnoreSection(XML_Parser parser, const ENCODING *enc,
 
 static void freeBindings(XML_Parser parser, BINDING *bindings);
 static enum XML_Error storeAtts(XML_Parser parser, const ENCODING *enc,
-                                const char *attStr, TAG_NAME *tagNamePtr,
-                                BINDING **bindingsPtr,
+                                const char *attStr, const char *attStrEnd,
+                                TAG_NAME *tagNamePtr, BINDING **bindingsPtr,
                                 enum XML_Account account);
+static void nsAttsUseSipHash(XML_Parser parser, unsigned int nsAttsSize);
 static enum XML_Error addBinding(XML_Parser parser, PREFIX *prefix,
                                  const ATTRIBUTE_ID *attId, const XML_Char *uri,
                                  BINDING **bindingsPtr);
@@ -561,6 +742,15 @@ static enum XML_Error
 appendAttributeValue(XML_Parser parser, const ENCODING *enc, XML_Bool isCdata,
                      const char *ptr, const char *end, STRING_POOL *pool,
                      enum XML_Account account, const char **nextPtr);
+static NAMED *nameCacheGet(NAMED **cache, const ENCODING *enc,
+                           const char *raw, size_t length);
+static void nameCachePut(NAMED **cache, const ENCODING *enc, const char *raw,
+                         size_t length, NAMED *named);
+static int vocabularyFindRaw(XML_Parser parser, const ENCODING *enc,
+                             const char *raw, size_t length);
+static int getSymbolId(XML_Parser parser, const XML_Char *name);
+static XML_Bool copySymbols(XML_Parser parser, XML_Parser fromParser);
+static int getAttributeSymbolId(XML_Parser parser, ATTRIBUTE_ID *attId);
 static ATTRIBUTE_ID *getAttributeId(XML_Parser parser, const ENCODING *enc,
                                     const char *start, const char *end);
 static int setElementTypePrefix(XML_Parser parser, ELEMENT_TYPE *elementType);
@@ -596,25 +786,59 @@ static int dtdCopy(XML_Parser oldParser, DTD *newDtd, const DTD *oldDtd,
                    XML_Parser parser);
 static int copyEntityTable(XML_Parser oldParser, HASH_TABLE *newTable,
                            STRING_POOL *newPool, const HASH_TABLE *oldTable);
+static void dtdUseBase(DTD *dtd, const DTD *base, const struct sipkey *key);
 static NAMED *lookupWithLength(XML_Parser parser, HASH_TABLE *table, KEY name,
                                size_t nameLen, size_t createSize);
 static NAMED *lookup(XML_Parser parser, HASH_TABLE *table, KEY name,
                      size_t createSize);
-static void FASTCALL hashTableInit(HASH_TABLE *table, XML_Parser parser);
+static NAMED *hashTableFind(const HASH_TABLE *table, const struct sipkey *key,
+                            KEY name);
+static NAMED *dtdLookup(XML_Parser parser, DTD *dtd, HASH_TABLE *table,
+                        KEY name, size_t createSize);
+static ENTITY *dtdDeclareEntity(XML_Parser parser, DTD *dtd,
+                                HASH_TABLE *table, KEY name);
+static XML_Bool dtdIndexDefaultAtts(XML_Parser parser, ELEMENT_TYPE *type);
+static const NAME_AND_DEFAULT_ATTRIBUTE *
+findDefaultAttribute(XML_Parser parser, ELEMENT_TYPE *type,
+                     const ATTRIBUTE_ID *attId);
+static XML_DTDSnapshot dtdSnapshotCreate(XML_Parser parser);
+#ifdef XML_DTD
+static enum XML_Error readExternalSubset(XML_Parser parser,
+                                         const ENTITY *entity);
+#endif /* XML_DTD */
+static XML_Bool FASTCALL keyeq(KEY s1, KEY s2);
+static void FASTCALL hashTableInit(HASH_TABLE *table, ARENA *arena);
 static void FASTCALL hashTableClear(HASH_TABLE *table);
-static void FASTCALL hashTableDestroy(HASH_TABLE *table);
 static void FASTCALL hashTableIterInit(HASH_TABLE_ITER *iter,
                                        const HASH_TABLE *table);
 static NAMED *FASTCALL hashTableIterNext(HASH_TABLE_ITER *iter);
 
+static void FASTCALL arenaInit(ARENA *arena, XML_Parser parser);
+static void *arenaTake(ARENA *arena, size_t size);
+static void *arenaAlloc(ARENA *arena, size_t size);
+static void *arenaResize(ARENA *arena, void *ptr, size_t oldSize,
+                         size_t size);
+static void FASTCALL arenaClear(ARENA *arena);
+static void FASTCALL arenaTrim(ARENA *arena);
+static void FASTCALL arenaDestroy(ARENA *arena);
+
+static void *documentMalloc(XML_Parser parser, size_t size);
+static void *documentRealloc(XML_Parser parser, void *ptr, size_t oldSize,
+                             size_t size);
+static void documentFree(XML_Parser parser, void *ptr);
+static void destroyDocumentObjects(XML_Parser parser);
+
 static void FASTCALL poolInit(STRING_POOL *pool, XML_Parser parser);
 static void FASTCALL poolClear(STRING_POOL *pool);
+static void poolRetain(STRING_POOL *pool, unsigned int documents);
+static void FASTCALL poolTrim(STRING_POOL *pool);
 static void FASTCALL poolDestroy(STRING_POOL *pool);
 static XML_Char *poolAppend(STRING_POOL *pool, const ENCODING *enc,
                             const char *ptr, const char *end);
 static XML_Char *poolStoreString(STRING_POOL *pool, const ENCODING *enc,
                                  const char *ptr, const char *end);
 static XML_Bool FASTCALL poolGrow(STRING_POOL *pool);
+static XML_Bool FASTCALL poolGrowBy(STRING_POOL *pool, size_t needed);
 static bool FASTCALL poolGrowUntil(STRING_POOL *pool, size_t needed);
 static const XML_Char *FASTCALL poolCopyString(STRING_POOL *pool,
                                                const XML_Char *s);
@@ -633,7 +857,12 @@ static ELEMENT_TYPE *getElementType(XML_Parser parser, const ENCODING *enc,
 static XML_Char *copyString(const XML_Char *s, XML_Parser parser);
 
 static struct sipkey generate_hash_secret_salt(void);
+static void setHashSecretSalt(XML_Parser parser);
 static XML_Bool startParsing(XML_Parser parser);
+static XML_Parser externalEntityParserCreate(XML_Parser oldParser,
+                                             const XML_Char *context,
+                                             const XML_Char *encodingName,
+                                             XML_Bool detached);
 
 static XML_Parser parserCreate(const XML_Char *encodingName,
                                const XML_Memory_Handling_Suite *memsuite,
@@ -712,6 +941,7 @@ const
     = XML_TRUE; // write ONLY in runtests.c
 #if defined(XML_TESTING)
 unsigned int g_bytesScanned = 0; // used for testing only
+XML_Bool g_fastHashCollides = XML_FALSE; // used for testing only
 #endif
 
 struct XML_ParserStruct {
@@ -734,16 +964,24 @@ struct XML_ParserStruct {
   const char *m_bufferPtr; // first character to be parsed
   char *m_bufferEnd;       // past last character to be parsed
   const char *m_bufferLim; // allocated end of m_buffer
+  XML_Bool m_bufferHandedOut; // by XML_GetBuffer since XML_ParserReset
 
   uint64_t m_parseEndByteIndex;
   const char *m_parseEndPtr;
+  const char *m_externalBuffer; // application buffer parsed in place, or NULL
   size_t m_partialTokenBytesBefore; /* used in heuristic to avoid O(n^2) */
   XML_Bool m_reparseDeferralEnabled;
   int m_lastBufferRequestSize;
   XML_Char *m_dataBuf;
   XML_Char *m_dataBufEnd;
+  XML_Bool m_coalesceCharData;
+  XML_Char *m_coalescedCharData; // character data not reported yet
+  int m_coalescedCharDataLen;
+  int m_coalescedCharDataSize;
   XML_StartElementHandler m_startElementHandler;
   XML_EndElementHandler m_endElementHandler;
+  XML_StartElementIdHandler m_startElementIdHandler;
+  XML_EndElementIdHandler m_endElementIdHandler;
   XML_CharacterDataHandler m_characterDataHandler;
   XML_ProcessingInstructionHandler m_processingInstructionHandler;
   XML_CommentHandler m_commentHandler;
@@ -810,9 +1048,33 @@ struct XML_ParserStruct {
   int m_nSpecifiedAtts;
   int m_idAttIndex;
   ATTRIBUTE *m_atts;
+  int *m_attSymbolIds; /* for m_startElementIdHandler */
+  size_t m_attSymbolIdsSize;
+  ARENA m_symbolArena; /* for m_symbols and the names in it */
+  HASH_TABLE m_symbols;
+  int m_symbolCount;
+  XML_Vocabulary m_vocabulary;
+  ELEMENT_TYPE **m_vocabElementTypes;   // by vocabulary index, or NULL
+  ATTRIBUTE_ID **m_vocabAttributeIds;   // by vocabulary index, or NULL
+  XML_DTDSnapshot m_dtdSnapshot;
+  XML_DTDCache m_dtdCache;
+  unsigned int m_poolRetention; // in documents, see poolRetain
+  XML_Bool m_useDocumentArena;  // see XML_SetDocumentArena
+  ARENA m_documentArena;        // for tags, bindings and open entities
+  XML_Bool m_recordEvents; // for an event batch or array handler or pulling
+  XML_EventBatchHandler m_eventBatchHandler;
+  XML_EventArrayHandler m_eventArrayHandler;
+  XML_Event *m_eventArray; // for m_eventArrayHandler
+  int m_eventBatchSize;
+  XML_EventBatch m_eventBatch;       // being recorded, or NULL
+  XML_EventBatch m_eventBatches;     // all of them, for XML_ParserFree
+  XML_EventBatch m_freeEventBatches; // released for reuse
   NS_ATT *m_nsAtts;
   unsigned long m_nsAttsVersion;
   unsigned char m_nsAttsPower;
+  XML_Bool m_nsAttsSipHash;
+  NAMED *m_elementTypeCache[NAME_CACHE_SIZE];
+  NAMED *m_attributeIdCache[NAME_CACHE_SIZE];
 #ifdef XML_ATTR_INFO
   XML_AttrInfo *m_attInfo;
 #endif
@@ -823,6 +1085,7 @@ struct XML_ParserStruct {
   size_t m_groupSize;
   XML_Char m_namespaceSeparator;
   XML_Parser m_parentParser;
+  XML_Bool m_isFragment; // see XML_FragmentParserCreate
   XML_ParsingStatus m_parsingStatus;
 #ifdef XML_DTD
   XML_Bool m_isParamEntity;
@@ -840,6 +1103,21 @@ struct XML_ParserStruct {
   unsigned m_handlerCallDepth;
 };
 
+struct XML_ParserPoolStruct {
+  XML_Memory_Handling_Suite m_mem;
+  const XML_Char *m_encoding; // stored after m_idle, or NULL
+  XML_Bool m_ns;
+  XML_Char m_namespaceSeparator[2];
+  unsigned int m_idleCount;
+  unsigned int m_maxIdle;
+  XML_Parser *m_idle; // stored right after the pool
+#if defined(XML_POOL_LOCKING) && defined(_WIN32)
+  CRITICAL_SECTION m_lock; // guards m_idle and m_idleCount
+#elif defined(XML_POOL_LOCKING)
+  pthread_mutex_t m_lock; // guards m_idle and m_idleCount
+#endif
+};
+
 #if XML_GE == 1
 #  define MALLOC(parser, s) (expat_malloc((parser), (s), __LINE__))
 #  define REALLOC(parser, p, s) (expat_realloc((parser), (p), (s), __LINE__))
@@ -1067,6 +1345,29 @@ expat_realloc(XML_Parser parser, void *ptr, size_t size, int sourceLine) {
 }
 #endif // XML_GE == 1
 
+/* Memory for tags, bindings and open entities, which is taken from
+   m_documentArena in document arena mode (see XML_SetDocumentArena) and
+   from the heap otherwise */
+static void *
+documentMalloc(XML_Parser parser, size_t size) {
+  if (parser->m_useDocumentArena)
+    return arenaTake(&parser->m_documentArena, size);
+  return MALLOC(parser, size);
+}
+
+static void *
+documentRealloc(XML_Parser parser, void *ptr, size_t oldSize, size_t size) {
+  if (parser->m_useDocumentArena)
+    return arenaResize(&parser->m_documentArena, ptr, oldSize, size);
+  return REALLOC(parser, ptr, size);
+}
+
+static void
+documentFree(XML_Parser parser, void *ptr) {
+  if (! parser->m_useDocumentArena)
+    FREE(parser, ptr);
+}
+
 XML_Parser XMLCALL
 XML_ParserCreate(const XML_Char *encodingName) {
   return XML_ParserCreate_MM(encodingName, NULL, NULL);
@@ -1129,38 +1430,111 @@ ENTROPY_DEBUG(const char *label, struct sipkey entropy_128) {
   return entropy_128;
 }
 
-static struct sipkey
-generate_hash_secret_salt(void) {
-  struct sipkey entropy;
-
+/* Fills target with count bytes from the best source of entropy we have,
+   and returns the name of that source; returns NULL if none worked. */
+static const char *
+writeRandomBytes(void *target, size_t count) {
   /* "Failproof" high quality providers: */
 #if defined(HAVE_ARC4RANDOM_BUF)
-  writeRandomBytes_arc4random_buf(&entropy, sizeof(entropy));
-  return ENTROPY_DEBUG("arc4random_buf", entropy);
+  writeRandomBytes_arc4random_buf(target, count);
+  return "arc4random_buf";
 #elif defined(HAVE_ARC4RANDOM)
-  writeRandomBytes_arc4random(&entropy, sizeof(entropy));
-  return ENTROPY_DEBUG("arc4random", entropy);
+  writeRandomBytes_arc4random(target, count);
+  return "arc4random";
 #else
   /* Try high quality providers first .. */
 #  ifdef _WIN32
-  if (writeRandomBytes_rand_s(&entropy, sizeof(entropy))) {
-    return ENTROPY_DEBUG("rand_s", entropy);
+  if (writeRandomBytes_rand_s(target, count)) {
+    return "rand_s";
   }
 #  elif defined(HAVE_GETENTROPY)
-  if (writeRandomBytes_getentropy(&entropy, sizeof(entropy))) {
-    return ENTROPY_DEBUG("getentropy", entropy);
+  if (writeRandomBytes_getentropy(target, count)) {
+    return "getentropy";
   }
   errno = 0;
 #  elif defined(HAVE_GETRANDOM) || defined(HAVE_SYSCALL_GETRANDOM)
-  if (writeRandomBytes_getrandom_nonblock(&entropy, sizeof(entropy))) {
-    return ENTROPY_DEBUG("getrandom", entropy);
+  if (writeRandomBytes_getrandom_nonblock(target, count)) {
+    return "getrandom";
   }
 #  endif
 #  if ! defined(_WIN32) && defined(XML_DEV_URANDOM)
-  if (writeRandomBytes_dev_urandom(&entropy, sizeof(entropy))) {
-    return ENTROPY_DEBUG("/dev/urandom", entropy);
+  if (writeRandomBytes_dev_urandom(target, count)) {
+    return "/dev/urandom";
   }
 #  endif /* ! defined(_WIN32) && defined(XML_DEV_URANDOM) */
+  return NULL;
+#endif
+}
+
+#if defined(XML_ENTROPY_BATCH)
+
+/* Salts are handed out from a batch of entropy per thread, so that parsing
+   many small documents does not cost a system call each.  They come from
+   the same sources and are used only once, so they are no weaker than
+   salts fetched one by one.  A child process drops the batch it inherited
+   from fork, since it would repeat the salts of its parent otherwise;
+   batching is only used once that is taken care of.  This is limited to
+   Linux: elsewhere, arc4random_buf is already cheap or there is no fork.
+   Children made with _Fork, vfork or a raw clone skip pthread_atfork
+   handlers and keep the batch of their parent.  After vfork, only exec
+   and _exit are allowed anyway; a child of _Fork or clone that creates
+   parsers without exec would repeat salts of its parent. */
+#  define ENTROPY_BATCH_SALTS 16 // 256 bytes, the limit of getentropy
+
+static __thread struct {
+  struct sipkey salts[ENTROPY_BATCH_SALTS];
+  unsigned int count; // salts not handed out yet, from the end
+  const char *label;
+} g_entropyBatch;
+
+static bool g_entropyBatchForkSafe = false;
+
+static void
+dropEntropyBatch(void) {
+  memset(&g_entropyBatch, 0, sizeof(g_entropyBatch));
+}
+
+__attribute__((constructor)) static void
+registerEntropyBatchForkHandler(void) {
+  g_entropyBatchForkSafe = (pthread_atfork(NULL, NULL, dropEntropyBatch) == 0);
+}
+
+static const char *
+takeBatchedEntropy(struct sipkey *entropy) {
+  if (! g_entropyBatchForkSafe)
+    return NULL;
+  if (g_entropyBatch.count == 0) {
+    g_entropyBatch.label
+        = writeRandomBytes(g_entropyBatch.salts, sizeof(g_entropyBatch.salts));
+    if (g_entropyBatch.label == NULL)
+      return NULL;
+    g_entropyBatch.count = ENTROPY_BATCH_SALTS;
+  }
+  struct sipkey *const salt = &g_entropyBatch.salts[--g_entropyBatch.count];
+  *entropy = *salt;
+  memset(salt, 0, sizeof(*salt));
+  return g_entropyBatch.label;
+}
+
+#endif /* defined(XML_ENTROPY_BATCH) */
+
+static struct sipkey
+generate_hash_secret_salt(void) {
+  struct sipkey entropy;
+  const char *label;
+
+#if defined(XML_ENTROPY_BATCH)
+  label = takeBatchedEntropy(&entropy);
+  if (label != NULL) {
+    return ENTROPY_DEBUG(label, entropy);
+  }
+#endif
+  label = writeRandomBytes(&entropy, sizeof(entropy));
+  if (label != NULL) {
+    return ENTROPY_DEBUG(label, entropy);
+  }
+
+#if ! defined(HAVE_ARC4RANDOM_BUF) && ! defined(HAVE_ARC4RANDOM)
   /* .. and self-made low quality for backup: */
 
   entropy.k[0] = 0;
@@ -1178,9 +1552,20 @@ generate_hash_secret_salt(void) {
     entropy.k[1] *= 2305843009213693951ULL;
     return ENTROPY_DEBUG("fallback(8)", entropy);
   }
+#else
+  assert(0); /* never gets here, the providers above cannot fail */
+  return entropy;
 #endif
 }
 
+#if defined(XML_TESTING)
+void
+testingGetHashSalt(XML_Parser parser, unsigned char salt[16]) {
+  assert(sizeof(parser->m_hash_secret_salt_128) == 16);
+  memcpy(salt, &parser->m_hash_secret_salt_128, 16);
+}
+#endif
+
 static void
 beforeHandler(XML_Parser parser) {
   assert(parser->m_handlerCallDepth < UINT_MAX);
@@ -1193,6 +1578,343 @@ afterHandler(XML_Parser parser) {
   parser->m_handlerCallDepth--;
 }
 
+/* Reports the character data collected while coalescing */
+static void
+flushCharacterData(XML_Parser parser) {
+  const int len = parser->m_coalescedCharDataLen;
+  parser->m_coalescedCharDataLen = 0;
+  if (parser->m_characterDataHandler) {
+    beforeHandler(parser);
+    parser->m_characterDataHandler(parser->m_handlerArg,
+                                   parser->m_coalescedCharData, len);
+    afterHandler(parser);
+  }
+}
+
+/* Appends to the character data collected while coalescing.
+   Returns XML_FALSE if we are out of memory.
+*/
+static XML_Bool
+coalesceCharacterData(XML_Parser parser, const XML_Char *s, int len) {
+  const int have = parser->m_coalescedCharDataLen;
+  if (len > parser->m_coalescedCharDataSize - have) {
+    /* Detect and prevent integer overflow */
+    if (len > INT_MAX - have)
+      return XML_FALSE;
+    const int needed = have + len;
+    int newSize = parser->m_coalescedCharDataSize;
+    if (newSize == 0)
+      newSize = INIT_DATA_BUF_SIZE;
+    while (newSize < needed)
+      newSize = (newSize > INT_MAX / 2) ? needed : 2 * newSize;
+    /* Detect and prevent integer overflow */
+    if ((size_t)newSize > SIZE_MAX / sizeof(XML_Char))
+      return XML_FALSE;
+    XML_Char *const newData = REALLOC(parser, parser->m_coalescedCharData,
+                                      (size_t)newSize * sizeof(XML_Char));
+    if (newData == NULL)
+      return XML_FALSE;
+    parser->m_coalescedCharData = newData;
+    parser->m_coalescedCharDataSize = newSize;
+  }
+  memcpy(parser->m_coalescedCharData + have, s, len * sizeof(XML_Char));
+  parser->m_coalescedCharDataLen = have + len;
+  return XML_TRUE;
+}
+
+/* Whether events are recorded for XML_NextEvent */
+static XML_Bool
+pullsEvents(XML_Parser parser) {
+  return parser->m_recordEvents && ! parser->m_eventBatchHandler
+         && ! parser->m_eventArrayHandler;
+}
+
+/* Passes the batch being recorded to the event batch handler, or its
+   events to the event array handler, after which the batch is recorded
+   anew.  External entity parsers record into the batches of their root
+   parser.
+*/
+static void
+deliverEventBatch(XML_Parser parser) {
+  const XML_Parser rootParser = getRootParserOf(parser, NULL);
+  const XML_EventBatch batch = rootParser->m_eventBatch;
+  if ((batch == NULL) || (batch->count == 0))
+    return;
+  if (rootParser->m_eventArrayHandler) {
+    beforeHandler(parser);
+    rootParser->m_eventArrayHandler(rootParser->m_handlerArg, batch->events,
+                                    batch->count);
+    afterHandler(parser);
+    batch->count = 0;
+    arenaClear(&batch->arena);
+    return;
+  }
+  rootParser->m_eventBatch = NULL;
+  beforeHandler(parser);
+  rootParser->m_eventBatchHandler(rootParser->m_handlerArg, batch);
+  afterHandler(parser);
+}
+
+static void
+freeEventBatch(XML_Parser rootParser, XML_EventBatch batch) {
+  arenaDestroy(&batch->arena);
+  if (! batch->callerEvents)
+    FREE(rootParser, batch->events);
+  FREE(rootParser, batch);
+}
+
+/* Frees the released batches that do not hold size events of their own */
+static void
+freeEventBatches(XML_Parser rootParser, int size) {
+  XML_EventBatch *freePtr = &rootParser->m_freeEventBatches;
+  while (*freePtr) {
+    const XML_EventBatch batch = *freePtr;
+    if ((batch->size == size) && ! batch->callerEvents) {
+      freePtr = &batch->nextFree;
+      continue;
+    }
+    *freePtr = batch->nextFree;
+    XML_EventBatch *batchPtr = &rootParser->m_eventBatches;
+    while (*batchPtr != batch)
+      batchPtr = &(*batchPtr)->next;
+    *batchPtr = batch->next;
+    freeEventBatch(rootParser, batch);
+  }
+}
+
+/* Makes room for more events in the batch of XML_NextEvent, which may
+   have to hold more than m_eventBatchSize of them when parsing cannot be
+   suspended right away.  Returns XML_FALSE if we are out of memory.
+*/
+static XML_Bool
+growEventBatch(XML_Parser rootParser, XML_EventBatch batch) {
+  /* Detect and prevent integer overflow */
+  if ((batch->size > INT_MAX / 2)
+      || ((size_t)batch->size > SIZE_MAX / 2 / sizeof(XML_Event)))
+    return XML_FALSE;
+  XML_Event *const events = REALLOC(
+      rootParser, batch->events, (size_t)batch->size * 2 * sizeof(XML_Event));
+  if (events == NULL)
+    return XML_FALSE;
+  batch->events = events;
+  batch->size *= 2;
+  return XML_TRUE;
+}
+
+/* Returns the batch being recorded, with room for another event, or NULL
+   if we are out of memory */
+static XML_EventBatch
+currentEventBatch(XML_Parser parser) {
+  const XML_Parser rootParser = getRootParserOf(parser, NULL);
+  XML_EventBatch batch = rootParser->m_eventBatch;
+  if ((batch != NULL) && (batch->count < batch->size))
+    return batch;
+  if ((batch != NULL) && pullsEvents(rootParser))
+    return growEventBatch(rootParser, batch) ? batch : NULL;
+  deliverEventBatch(parser);
+  if ((batch != NULL) && rootParser->m_eventArrayHandler)
+    return batch;
+  batch = rootParser->m_freeEventBatches;
+  if ((batch != NULL) && ! rootParser->m_eventArrayHandler) {
+    rootParser->m_freeEventBatches = batch->nextFree;
+  } else {
+    const int size = rootParser->m_eventBatchSize;
+    /* Detect and prevent integer overflow */
+    if ((size_t)size > SIZE_MAX / sizeof(XML_Event))
+      return NULL;
+    batch = MALLOC(rootParser, sizeof(struct XML_EventBatchStruct));
+    if (batch == NULL)
+      return NULL;
+    batch->callerEvents = (rootParser->m_eventArrayHandler != NULL);
+    if (batch->callerEvents)
+      batch->events = rootParser->m_eventArray;
+    else
+      batch->events = MALLOC(rootParser, (size_t)size * sizeof(XML_Event));
+    if (batch->events == NULL) {
+      FREE(rootParser, batch);
+      return NULL;
+    }
+    batch->size = size;
+    arenaInit(&batch->arena, rootParser);
+    batch->next = rootParser->m_eventBatches;
+    rootParser->m_eventBatches = batch;
+  }
+  batch->nextFree = NULL;
+  batch->count = 0;
+  batch->pulled = 0;
+  rootParser->m_eventBatch = batch;
+  return batch;
+}
+
+/* Returns a copy of s in batch, '\0'-terminated, or NULL if we are out of
+   memory */
+static const XML_Char *
+copyEventString(XML_EventBatch batch, const XML_Char *s, size_t len) {
+  /* Detect and prevent integer overflow */
+  if (len >= SIZE_MAX / sizeof(XML_Char))
+    return NULL;
+  XML_Char *const copy = arenaTake(&batch->arena, (len + 1) * sizeof(XML_Char));
+  if (copy == NULL)
+    return NULL;
+  memcpy(copy, s, len * sizeof(XML_Char));
+  copy[len] = XML_T('\0');
+  return copy;
+}
+
+static XML_Event *
+addEvent(XML_Parser parser, XML_EventBatch batch, enum XML_EventType type) {
+  XML_Event *const event = &batch->events[batch->count++];
+  event->type = type;
+  event->name = NULL;
+  event->nameId = 0;
+  event->atts = NULL;
+  event->attIds = NULL;
+  event->data = NULL;
+  event->dataLen = 0;
+  event->byteIndex = XML_GetCurrentByteIndex(parser);
+  /* For XML_NextEvent, stop once there are enough events to return, but
+     not after character data, which more character data may follow */
+  if (pullsEvents(parser) && (parser->m_parentParser == NULL)
+      && (type != XML_EVENT_CHARACTER_DATA)
+      && (batch->count - batch->pulled >= parser->m_eventBatchSize)
+      && (parser->m_parsingStatus.parsing == XML_PARSING))
+    XML_StopParser(parser, XML_TRUE);
+  return event;
+}
+
+/* Records an event with an optional name, its symbol ID, and
+   '\0'-terminated data.  Returns XML_FALSE if we are out of memory.
+*/
+static XML_Bool
+recordEvent(XML_Parser parser, enum XML_EventType type, const XML_Char *name,
+            int nameId, const XML_Char *data) {
+  const XML_EventBatch batch = currentEventBatch(parser);
+  if (batch == NULL)
+    return XML_FALSE;
+  const size_t dataLen = data ? xcslen(data) : 0;
+  /* Detect and prevent integer overflow */
+  if (dataLen > INT_MAX)
+    return XML_FALSE;
+  const XML_Char *nameCopy = NULL;
+  const XML_Char *dataCopy = NULL;
+  if (name && ! (nameCopy = copyEventString(batch, name, xcslen(name))))
+    return XML_FALSE;
+  if (data && ! (dataCopy = copyEventString(batch, data, dataLen)))
+    return XML_FALSE;
+  XML_Event *const event = addEvent(parser, batch, type);
+  event->name = nameCopy;
+  event->nameId = nameId;
+  event->data = dataCopy;
+  event->dataLen = (int)dataLen;
+  return XML_TRUE;
+}
+
+static XML_Bool
+recordStartElement(XML_Parser parser, const XML_Char *name, int nameId,
+                   const XML_Char **atts, const int *attIds) {
+  const XML_EventBatch batch = currentEventBatch(parser);
+  if (batch == NULL)
+    return XML_FALSE;
+  int n = 0;
+  while (atts[n])
+    n++;
+  const XML_Char *const nameCopy = copyEventString(batch, name, xcslen(name));
+  if (nameCopy == NULL)
+    return XML_FALSE;
+  const XML_Char **const attsCopy
+      = arenaTake(&batch->arena, ((size_t)n + 1) * sizeof(XML_Char *));
+  if (attsCopy == NULL)
+    return XML_FALSE;
+  for (int i = 0; i < n; i++) {
+    attsCopy[i] = copyEventString(batch, atts[i], xcslen(atts[i]));
+    if (attsCopy[i] == NULL)
+      return XML_FALSE;
+  }
+  attsCopy[n] = NULL;
+  int *attIdsCopy = NULL;
+  if (n > 0) {
+    attIdsCopy = arenaTake(&batch->arena, (size_t)n / 2 * sizeof(int));
+    if (attIdsCopy == NULL)
+      return XML_FALSE;
+    memcpy(attIdsCopy, attIds, (size_t)n / 2 * sizeof(int));
+  }
+  XML_Event *const event = addEvent(parser, batch, XML_EVENT_START_ELEMENT);
+  event->name = nameCopy;
+  event->nameId = nameId;
+  event->atts = attsCopy;
+  event->attIds = attIdsCopy;
+  return XML_TRUE;
+}
+
+/* Records character data, appending it to the character data recorded
+   last if nothing came in between and XML_NextEvent has not returned it
+   yet.  Returns XML_FALSE if we are out of memory.
+*/
+static XML_Bool
+recordCharacterData(XML_Parser parser, const XML_Char *s, int len) {
+  if (len == 0)
+    return XML_TRUE;
+  const XML_Parser rootParser = getRootParserOf(parser, NULL);
+  const XML_EventBatch last = rootParser->m_eventBatch;
+  if ((last != NULL) && (last->count > last->pulled)
+      && (last->events[last->count - 1].type == XML_EVENT_CHARACTER_DATA)) {
+    XML_Event *const event = &last->events[last->count - 1];
+    /* Detect and prevent integer overflow */
+    if (len > INT_MAX - event->dataLen
+        || (size_t)event->dataLen + len > SIZE_MAX / sizeof(XML_Char))
+      return XML_FALSE;
+    XML_Char *const data
+        = arenaResize(&last->arena, (void *)event->data,
+                      (size_t)event->dataLen * sizeof(XML_Char),
+                      ((size_t)event->dataLen + len) * sizeof(XML_Char));
+    if (data == NULL)
+      return XML_FALSE;
+    memcpy(data + event->dataLen, s, len * sizeof(XML_Char));
+    event->data = data;
+    event->dataLen += len;
+    return XML_TRUE;
+  }
+  const XML_EventBatch batch = currentEventBatch(parser);
+  if (batch == NULL)
+    return XML_FALSE;
+  XML_Char *const data = arenaTake(&batch->arena, len * sizeof(XML_Char));
+  if (data == NULL)
+    return XML_FALSE;
+  memcpy(data, s, len * sizeof(XML_Char));
+  XML_Event *const event = addEvent(parser, batch, XML_EVENT_CHARACTER_DATA);
+  event->data = data;
+  event->dataLen = len;
+  return XML_TRUE;
+}
+
+/* Whether character data is reported, to the handler or as events */
+static XML_Bool
+reportsCharacterData(XML_Parser parser) {
+  return (parser->m_characterDataHandler != NULL) || parser->m_recordEvents;
+}
+
+/* Reports character data to the character data handler, or collects it
+   for a single call when coalescing is enabled.  If collecting fails for
+   lack of memory, the data is reported right away instead.  With event
+   batches, the data is recorded as an event instead.  Returns XML_FALSE
+   if we are out of memory.
+*/
+static XML_Bool
+reportCharacterData(XML_Parser parser, const XML_Char *s, int len) {
+  if (parser->m_recordEvents)
+    return recordCharacterData(parser, s, len);
+  if (parser->m_characterDataHandler == NULL)
+    return XML_TRUE;
+  if (parser->m_coalesceCharData && coalesceCharacterData(parser, s, len))
+    return XML_TRUE;
+  if (parser->m_coalescedCharDataLen > 0)
+    flushCharacterData(parser);
+  beforeHandler(parser);
+  parser->m_characterDataHandler(parser->m_handlerArg, s, len);
+  afterHandler(parser);
+  return XML_TRUE;
+}
+
 static bool
 isCalledFromInsideHandler(XML_Parser parser) {
   return parser->m_handlerCallDepth > 0;
@@ -1279,19 +2001,27 @@ callProcessor(XML_Parser parser, const char *start, const char *end,
       parser->m_partialTokenBytesBefore = 0;
     }
   }
+  if (parser->m_eventBatchHandler || parser->m_eventArrayHandler)
+    deliverEventBatch(parser);
   return ret;
 }
 
-static XML_Bool /* only valid for root parser */
-startParsing(XML_Parser parser) {
-  /* hash functions must be initialized before setContext() is called */
+static void /* only valid for root parser */
+setHashSecretSalt(XML_Parser parser) {
   if (parser->m_hash_secret_salt_set != XML_TRUE) {
     parser->m_hash_secret_salt_128 = generate_hash_secret_salt();
     parser->m_hash_secret_salt_set = XML_TRUE;
   }
-  if (parser->m_ns) {
+}
+
+static XML_Bool /* only valid for root parser */
+startParsing(XML_Parser parser) {
+  /* hash functions must be initialized before setContext() is called */
+  setHashSecretSalt(parser);
+  if (parser->m_ns && ! parser->m_isFragment) {
     /* implicit context only set for root parser, since child
-       parsers (i.e. external entity parsers) will inherit it
+       parsers (i.e. external entity parsers) and fragment parsers
+       will inherit it
     */
     return setContext(parser, implicitContext);
   }
@@ -1458,6 +2188,9 @@ parserCreate(const XML_Char *encodingName,
   parser->m_groupSize = 0;
   parser->m_groupConnector = NULL;
 
+  parser->m_coalescedCharData = NULL;
+  parser->m_coalescedCharDataSize = 0;
+
   parser->m_unknownEncodingHandler = NULL;
   parser->m_unknownEncodingHandlerData = NULL;
 
@@ -1469,10 +2202,32 @@ parserCreate(const XML_Char *encodingName,
   parser->m_nsAttsVersion = 0;
   parser->m_nsAttsPower = 0;
 
+  parser->m_attSymbolIds = NULL;
+  parser->m_attSymbolIdsSize = 0;
+  arenaInit(&parser->m_symbolArena, parser);
+  hashTableInit(&parser->m_symbols, &parser->m_symbolArena);
+  parser->m_symbolCount = 0;
+  parser->m_vocabulary = NULL;
+  parser->m_vocabElementTypes = NULL;
+  parser->m_vocabAttributeIds = NULL;
+  parser->m_dtdSnapshot = NULL;
+  parser->m_dtdCache = NULL;
+  parser->m_poolRetention = POOL_RETAINED_DOCUMENTS_DEFAULT;
+  parser->m_useDocumentArena = XML_FALSE;
+  arenaInit(&parser->m_documentArena, parser);
+  parser->m_eventBatch = NULL;
+  parser->m_eventBatches = NULL;
+  parser->m_freeEventBatches = NULL;
+
   parser->m_protocolEncodingName = NULL;
 
   poolInit(&parser->m_tempPool, parser);
   poolInit(&parser->m_temp2Pool, parser);
+#if XML_GE == 1
+  // Read only once per parser, parserInit keeps these on XML_ParserReset
+  parser->m_accounting.debugLevel = getDebugLevel("EXPAT_ACCOUNTING_DEBUG", 0u);
+  parser->m_entity_stats.debugLevel = getDebugLevel("EXPAT_ENTITY_DEBUG", 0u);
+#endif
   parserInit(parser, encodingName);
 
   if (encodingName && ! parser->m_protocolEncodingName) {
@@ -1512,11 +2267,18 @@ parserInit(XML_Parser parser, const XML_Char *encodingName) {
   parser->m_handlerArg = NULL;
   parser->m_startElementHandler = NULL;
   parser->m_endElementHandler = NULL;
+  parser->m_startElementIdHandler = NULL;
+  parser->m_endElementIdHandler = NULL;
   parser->m_characterDataHandler = NULL;
   parser->m_processingInstructionHandler = NULL;
   parser->m_commentHandler = NULL;
   parser->m_startCdataSectionHandler = NULL;
   parser->m_endCdataSectionHandler = NULL;
+  parser->m_recordEvents = XML_FALSE;
+  parser->m_eventBatchHandler = NULL;
+  parser->m_eventArrayHandler = NULL;
+  parser->m_eventArray = NULL;
+  parser->m_eventBatchSize = 0;
   parser->m_defaultHandler = NULL;
   parser->m_startDoctypeDeclHandler = NULL;
   parser->m_endDoctypeDeclHandler = NULL;
@@ -1534,11 +2296,22 @@ parserInit(XML_Parser parser, const XML_Char *encodingName) {
   parser->m_xmlDeclHandler = NULL;
   parser->m_bufferPtr = parser->m_buffer;
   parser->m_bufferEnd = parser->m_buffer;
+  parser->m_bufferHandedOut = XML_FALSE;
   parser->m_parseEndByteIndex = 0;
   parser->m_parseEndPtr = NULL;
+  parser->m_externalBuffer = NULL;
   parser->m_partialTokenBytesBefore = 0;
   parser->m_reparseDeferralEnabled = g_reparseDeferralEnabledDefault;
   parser->m_lastBufferRequestSize = 0;
+  parser->m_coalesceCharData = XML_FALSE;
+  memset(parser->m_elementTypeCache, 0, sizeof(parser->m_elementTypeCache));
+  memset(parser->m_attributeIdCache, 0, sizeof(parser->m_attributeIdCache));
+  if (parser->m_vocabulary != NULL) {
+    const size_t count = (size_t)parser->m_vocabulary->m_count;
+    memset(parser->m_vocabElementTypes, 0, count * sizeof(ELEMENT_TYPE *));
+    memset(parser->m_vocabAttributeIds, 0, count * sizeof(ATTRIBUTE_ID *));
+  }
+  parser->m_coalescedCharDataLen = 0;
   parser->m_declElementType = NULL;
   parser->m_declAttributeId = NULL;
   parser->m_declEntity = NULL;
@@ -1571,6 +2344,7 @@ parserInit(XML_Parser parser, const XML_Char *encodingName) {
   // Reentry can only be triggered inside m_processor calls
   parser->m_reenter = XML_FALSE;
   parser->m_handlerCallDepth = 0;
+  parser->m_isFragment = XML_FALSE;
 #ifdef XML_DTD
   parser->m_isParamEntity = XML_FALSE;
   parser->m_useForeignDTD = XML_FALSE;
@@ -1578,18 +2352,21 @@ parserInit(XML_Parser parser, const XML_Char *encodingName) {
 #endif
   parser->m_hash_secret_salt_128.k[0] = 0;
   parser->m_hash_secret_salt_128.k[1] = 0;
+  parser->m_nsAttsSipHash = XML_FALSE;
   parser->m_hash_secret_salt_set = XML_FALSE;
 
 #if XML_GE == 1
+  const unsigned long accountingDebugLevel = parser->m_accounting.debugLevel;
   memset(&parser->m_accounting, 0, sizeof(ACCOUNTING));
-  parser->m_accounting.debugLevel = getDebugLevel("EXPAT_ACCOUNTING_DEBUG", 0u);
+  parser->m_accounting.debugLevel = accountingDebugLevel;
   parser->m_accounting.maximumAmplificationFactor
       = EXPAT_BILLION_LAUGHS_ATTACK_PROTECTION_MAXIMUM_AMPLIFICATION_DEFAULT;
   parser->m_accounting.activationThresholdBytes
       = EXPAT_BILLION_LAUGHS_ATTACK_PROTECTION_ACTIVATION_THRESHOLD_DEFAULT;
 
+  const unsigned long entityDebugLevel = parser->m_entity_stats.debugLevel;
   memset(&parser->m_entity_stats, 0, sizeof(ENTITY_STATS));
-  parser->m_entity_stats.debugLevel = getDebugLevel("EXPAT_ENTITY_DEBUG", 0u);
+  parser->m_entity_stats.debugLevel = entityDebugLevel;
 #endif
 }
 
@@ -1624,84 +2401,729 @@ XML_ParserReset(XML_Parser parser, const XML_Char *encodingName) {
 
   if (parser->m_parentParser)
     return XML_FALSE;
-  /* move m_tagStack to m_freeTagList */
-  tStk = parser->m_tagStack;
-  while (tStk) {
-    TAG *tag = tStk;
-    tStk = tStk->parent;
-    tag->parent = parser->m_freeTagList;
-    moveToFreeBindingList(parser, tag->bindings);
-    tag->bindings = NULL;
-    parser->m_freeTagList = tag;
-  }
-  /* move m_openInternalEntities to m_freeEntities */
-  moveEntityList(&parser->m_freeEntities, &parser->m_openInternalEntities);
-  /* move m_openAttributeEntities to m_freeEntities (i.e. same task but for
-   * attributes) */
-  moveEntityList(&parser->m_freeEntities, &parser->m_openAttributeEntities);
-  /* move m_openValueEntities to m_freeEntities (i.e. same task but for value
-   * entities) */
-  moveEntityList(&parser->m_freeEntities, &parser->m_openValueEntities);
-  moveToFreeBindingList(parser, parser->m_inheritedBindings);
+  if (parser->m_useDocumentArena) {
+    /* Tags, bindings and open entities all go at once with the arena;
+       parserInit below forgets the lists that are still in use */
+    parser->m_freeTagList = NULL;
+    parser->m_freeBindingList = NULL;
+    parser->m_freeEntities = NULL;
+    arenaClear(&parser->m_documentArena);
+  } else {
+    /* move m_tagStack to m_freeTagList */
+    tStk = parser->m_tagStack;
+    while (tStk) {
+      TAG *tag = tStk;
+      tStk = tStk->parent;
+      tag->parent = parser->m_freeTagList;
+      moveToFreeBindingList(parser, tag->bindings);
+      tag->bindings = NULL;
+      parser->m_freeTagList = tag;
+    }
+    /* move m_openInternalEntities to m_freeEntities */
+    moveEntityList(&parser->m_freeEntities, &parser->m_openInternalEntities);
+    /* move m_openAttributeEntities to m_freeEntities (i.e. same task but for
+     * attributes) */
+    moveEntityList(&parser->m_freeEntities, &parser->m_openAttributeEntities);
+    /* move m_openValueEntities to m_freeEntities (i.e. same task but for
+     * value entities) */
+    moveEntityList(&parser->m_freeEntities, &parser->m_openValueEntities);
+    moveToFreeBindingList(parser, parser->m_inheritedBindings);
+  }
   FREE(parser, parser->m_unknownEncodingMem);
   if (parser->m_unknownEncodingRelease)
     callUnknownEncodingRelease(parser);
-  poolClear(&parser->m_tempPool);
-  poolClear(&parser->m_temp2Pool);
+  poolRetain(&parser->m_tempPool, parser->m_poolRetention);
+  poolRetain(&parser->m_temp2Pool, parser->m_poolRetention);
   FREE(parser, (void *)parser->m_protocolEncodingName);
   parser->m_protocolEncodingName = NULL;
+  /* Nobody has seen the rest of the batch being recorded */
+  if (parser->m_eventBatch != NULL) {
+    XML_ReleaseEventBatch(parser, parser->m_eventBatch);
+    parser->m_eventBatch = NULL;
+  }
   parserInit(parser, encodingName);
   dtdReset(parser->m_dtd, parser);
+  if (parser->m_dtdSnapshot != NULL)
+    dtdUseBase(parser->m_dtd, parser->m_dtdSnapshot->m_holder->m_dtd,
+               &parser->m_dtdSnapshot->m_holder->m_hash_secret_salt_128);
+  hashTableClear(&parser->m_symbols);
+  arenaClear(&parser->m_symbolArena);
+  parser->m_symbolCount
+      = (parser->m_vocabulary != NULL) ? parser->m_vocabulary->m_count : 0;
   return XML_TRUE;
 }
 
+/* The idle parsers of a pool are shared by all threads using the pool.
+   The lock is only held to take a parser from the list or to put one
+   back; creating, resetting and freeing parsers happens outside of it.
+   Without XML_POOL_LOCKING, pools do no locking and the application has
+   to serialize calls, so that Expat does not depend on a threads library
+   by default. */
 static XML_Bool
-parserBusy(XML_Parser parser) {
-  switch (parser->m_parsingStatus.parsing) {
-  case XML_PARSING:
-  case XML_SUSPENDED:
-    return XML_TRUE;
-  case XML_INITIALIZED:
-  case XML_FINISHED:
-  default:
+poolLockInit(XML_ParserPool pool) {
+#if defined(XML_POOL_LOCKING) && defined(_WIN32)
+  InitializeCriticalSection(&pool->m_lock);
+#elif defined(XML_POOL_LOCKING)
+  if (pthread_mutex_init(&pool->m_lock, NULL) != 0)
     return XML_FALSE;
-  }
+#else
+  UNUSED_P(pool);
+#endif
+  return XML_TRUE;
 }
 
-enum XML_Status XMLCALL
-XML_SetEncoding(XML_Parser parser, const XML_Char *encodingName) {
-  if (parser == NULL)
-    return XML_STATUS_ERROR;
-  /* Block after XML_Parse()/XML_ParseBuffer() has been called.
-     XXX There's no way for the caller to determine which of the
-     XXX possible error cases caused the XML_STATUS_ERROR return.
-  */
-  if (parserBusy(parser))
-    return XML_STATUS_ERROR;
-
-  /* Get rid of any previous encoding name */
-  FREE(parser, (void *)parser->m_protocolEncodingName);
-
-  if (encodingName == NULL)
-    /* No new encoding name */
-    parser->m_protocolEncodingName = NULL;
-  else {
-    /* Copy the new encoding name into allocated memory */
-    parser->m_protocolEncodingName = copyString(encodingName, parser);
-    if (! parser->m_protocolEncodingName)
-      return XML_STATUS_ERROR;
-  }
-  return XML_STATUS_OK;
+static void
+poolLock(XML_ParserPool pool) {
+#if defined(XML_POOL_LOCKING) && defined(_WIN32)
+  EnterCriticalSection(&pool->m_lock);
+#elif defined(XML_POOL_LOCKING)
+  pthread_mutex_lock(&pool->m_lock);
+#else
+  UNUSED_P(pool);
+#endif
 }
 
-XML_Parser XMLCALL
+static void
+poolUnlock(XML_ParserPool pool) {
+#if defined(XML_POOL_LOCKING) && defined(_WIN32)
+  LeaveCriticalSection(&pool->m_lock);
+#elif defined(XML_POOL_LOCKING)
+  pthread_mutex_unlock(&pool->m_lock);
+#else
+  UNUSED_P(pool);
+#endif
+}
+
+static void
+poolLockDestroy(XML_ParserPool pool) {
+#if defined(XML_POOL_LOCKING) && defined(_WIN32)
+  DeleteCriticalSection(&pool->m_lock);
+#elif defined(XML_POOL_LOCKING)
+  pthread_mutex_destroy(&pool->m_lock);
+#else
+  UNUSED_P(pool);
+#endif
+}
+
+XML_ParserPool XMLCALL
+XML_ParserPoolCreate(const XML_Char *encodingName,
+                     const XML_Memory_Handling_Suite *memsuite,
+                     const XML_Char *nameSep, unsigned int maxIdle) {
+  const size_t encodingChars
+      = (encodingName != NULL) ? xcslen(encodingName) + 1 : 0;
+  /* Detect and prevent integer overflow */
+#if UINT_MAX >= SIZE_MAX
+  if (maxIdle > (SIZE_MAX - sizeof(struct XML_ParserPoolStruct))
+                    / sizeof(XML_Parser))
+    return NULL;
+#endif
+  if (encodingChars > (SIZE_MAX - sizeof(struct XML_ParserPoolStruct)
+                       - maxIdle * sizeof(XML_Parser))
+                          / sizeof(XML_Char))
+    return NULL;
+  const size_t bytes = sizeof(struct XML_ParserPoolStruct)
+                       + maxIdle * sizeof(XML_Parser)
+                       + encodingChars * sizeof(XML_Char);
+
+  XML_ParserPool pool
+      = (memsuite != NULL) ? memsuite->malloc_fcn(bytes) : malloc(bytes);
+  if (pool == NULL)
+    return NULL;
+  if (memsuite != NULL) {
+    pool->m_mem = *memsuite;
+  } else {
+    pool->m_mem.malloc_fcn = malloc;
+    pool->m_mem.realloc_fcn = realloc;
+    pool->m_mem.free_fcn = free;
+  }
+  pool->m_idle = (XML_Parser *)(pool + 1);
+  pool->m_encoding = NULL;
+  if (encodingName != NULL) {
+    XML_Char *const encoding = (XML_Char *)(pool->m_idle + maxIdle);
+    memcpy(encoding, encodingName, encodingChars * sizeof(XML_Char));
+    pool->m_encoding = encoding;
+  }
+  pool->m_ns = (nameSep != NULL) ? XML_TRUE : XML_FALSE;
+  pool->m_namespaceSeparator[0] = (nameSep != NULL) ? *nameSep : 0;
+  pool->m_namespaceSeparator[1] = 0;
+  pool->m_idleCount = 0;
+  pool->m_maxIdle = maxIdle;
+  if (! poolLockInit(pool)) {
+    pool->m_mem.free_fcn(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+XML_Parser XMLCALL
+XML_ParserPoolAcquire(XML_ParserPool pool) {
+  if (pool == NULL)
+    return NULL;
+  XML_Parser parser = NULL;
+  poolLock(pool);
+  if (pool->m_idleCount > 0)
+    parser = pool->m_idle[--pool->m_idleCount];
+  poolUnlock(pool);
+  if (parser != NULL)
+    return parser;
+  return XML_ParserCreate_MM(pool->m_encoding, &pool->m_mem,
+                             pool->m_ns ? pool->m_namespaceSeparator : NULL);
+}
+
+XML_Bool XMLCALL
+XML_ParserPoolRelease(XML_ParserPool pool, XML_Parser parser) {
+  if ((pool == NULL) || (parser == NULL) || (parser->m_parentParser != NULL)
+      || isCalledFromInsideHandler(parser))
+    return XML_FALSE;
+
+  /* A parser that does not match the pool is not worth keeping */
+  if ((pool->m_maxIdle == 0) || (parser->m_ns != pool->m_ns)
+      || (parser->m_namespaceSeparator != pool->m_namespaceSeparator[0])
+      || (parser->m_mem.malloc_fcn != pool->m_mem.malloc_fcn)
+      || ! XML_ParserReset(parser, pool->m_encoding)
+      || ((pool->m_encoding != NULL)
+          && (parser->m_protocolEncodingName == NULL))) {
+    XML_ParserFree(parser);
+    return XML_TRUE;
+  }
+
+  /* Drop what XML_ParserReset keeps, so that the next user gets a parser
+     that behaves like a new one */
+  parser->m_unknownEncodingHandler = NULL;
+  parser->m_unknownEncodingHandlerData = NULL;
+  parser->m_ns_triplets = XML_FALSE;
+  setVocabulary(parser, NULL);
+  parser->m_dtdSnapshot = NULL;
+  parser->m_dtdCache = NULL;
+  parser->m_poolRetention = POOL_RETAINED_DOCUMENTS_DEFAULT;
+  XML_SetDocumentArena(parser, XML_FALSE);
+  dtdUseBase(parser->m_dtd, NULL, NULL);
+#if XML_GE == 1
+  parser->m_alloc_tracker.maximumAmplificationFactor
+      = EXPAT_ALLOC_TRACKER_MAXIMUM_AMPLIFICATION_DEFAULT;
+  parser->m_alloc_tracker.activationThresholdBytes
+      = EXPAT_ALLOC_TRACKER_ACTIVATION_THRESHOLD_DEFAULT;
+#endif
+
+  /* Neither is one that there is no room for */
+  XML_Bool kept = XML_FALSE;
+  poolLock(pool);
+  if (pool->m_idleCount < pool->m_maxIdle) {
+    pool->m_idle[pool->m_idleCount++] = parser;
+    kept = XML_TRUE;
+  }
+  poolUnlock(pool);
+  if (! kept)
+    XML_ParserFree(parser);
+  return XML_TRUE;
+}
+
+void XMLCALL
+XML_ParserPoolFree(XML_ParserPool pool) {
+  if (pool == NULL)
+    return;
+  while (pool->m_idleCount > 0)
+    XML_ParserFree(pool->m_idle[--pool->m_idleCount]);
+  poolLockDestroy(pool);
+  pool->m_mem.free_fcn(pool);
+}
+
+/* Adds count times size to *bytes, returning XML_FALSE on overflow */
+static XML_Bool
+vocabularyAddBytes(size_t *bytes, size_t count, size_t size) {
+  if (count > (SIZE_MAX - *bytes) / size)
+    return XML_FALSE;
+  *bytes += count * size;
+  return XML_TRUE;
+}
+
+/* Tries to place the names with the given key, see XML_VocabularyStruct.
+   hashes, starts (one per bucket and one more), items and chosen are
+   scratch space.  Returns 1 on success, 0 if another key may do better
+   and -1 if two names are equal. */
+static int
+vocabularyPlace(XML_Vocabulary vocabulary, uint64_t *hashes,
+                unsigned int *starts, unsigned int *items,
+                unsigned int *chosen) {
+  const unsigned int count = (unsigned int)vocabulary->m_count;
+  const unsigned int buckets = vocabulary->m_bucketMask + 1;
+  unsigned int i;
+  unsigned int maxSize = 0;
+
+  for (i = 0; i < count; i++)
+    hashes[i] = fastHash64(&vocabulary->m_key, vocabulary->m_names[i],
+                           vocabulary->m_lengths[i] * sizeof(XML_Char));
+
+  /* Group the names by bucket, a counting sort */
+  memset(starts, 0, (buckets + 1) * sizeof(unsigned int));
+  for (i = 0; i < count; i++)
+    starts[((unsigned int)hashes[i] & vocabulary->m_bucketMask) + 1]++;
+  for (i = 0; i < buckets; i++) {
+    if (starts[i + 1] > maxSize)
+      maxSize = starts[i + 1];
+    starts[i + 1] += starts[i];
+  }
+  for (i = 0; i < count; i++) {
+    const unsigned int bucket
+        = (unsigned int)hashes[i] & vocabulary->m_bucketMask;
+    items[starts[bucket]++] = i;
+  }
+  /* Every start has moved up to the next one, move them back */
+  for (i = buckets; i > 0; i--)
+    starts[i] = starts[i - 1];
+  starts[0] = 0;
+
+  for (i = 0; i <= vocabulary->m_slotMask; i++)
+    vocabulary->m_slots[i] = -1;
+
+  for (unsigned int size = maxSize; size > 0; size--) {
+    for (unsigned int bucket = 0; bucket < buckets; bucket++) {
+      const unsigned int *const members = items + starts[bucket];
+      if (starts[bucket + 1] - starts[bucket] != size)
+        continue;
+
+      /* Names whose slots agree stay together whatever the displacement */
+      for (unsigned int j = 1; j < size; j++) {
+        for (unsigned int k = 0; k < j; k++) {
+          if ((VOCABULARY_SLOT(hashes[members[j]], 0)
+               ^ VOCABULARY_SLOT(hashes[members[k]], 0))
+              & vocabulary->m_slotMask)
+            continue;
+          if ((hashes[members[j]] == hashes[members[k]])
+              && (vocabulary->m_lengths[members[j]]
+               == vocabulary->m_lengths[members[k]])
+              && (memcmp(vocabulary->m_names[members[j]],
+                         vocabulary->m_names[members[k]],
+                         vocabulary->m_lengths[members[j]] * sizeof(XML_Char))
+                  == 0))
+            return -1;
+          return 0;
+        }
+      }
+
+      unsigned int displacement = 0;
+      for (;; displacement++) {
+        unsigned int j;
+        for (j = 0; j < size; j++) {
+          unsigned int k;
+          chosen[j] = VOCABULARY_SLOT(hashes[members[j]], displacement)
+                      & vocabulary->m_slotMask;
+          if (vocabulary->m_slots[chosen[j]] != -1)
+            break;
+          for (k = 0; k < j; k++) {
+            if (chosen[k] == chosen[j])
+              break;
+          }
+          if (k < j)
+            break;
+        }
+        if (j == size)
+          break;
+        if (displacement == vocabulary->m_slotMask)
+          return 0;
+      }
+      for (unsigned int j = 0; j < size; j++)
+        vocabulary->m_slots[chosen[j]] = (int)members[j];
+      vocabulary->m_displacements[bucket] = displacement;
+    }
+  }
+  return 1;
+}
+
+XML_Vocabulary XMLCALL
+XML_VocabularyCreate(const XML_Char *const *names,
+                     const XML_Memory_Handling_Suite *memsuite) {
+  if (names == NULL)
+    return NULL;
+
+  size_t count = 0;
+  size_t chars = 0;
+  for (; names[count] != NULL; count++) {
+    /* Keeps the slot count and the symbol IDs in range */
+    if (count == (size_t)(INT_MAX >> 2))
+      return NULL;
+    const size_t len = xcslen(names[count]) + 1;
+    if (len > SIZE_MAX - chars)
+      return NULL;
+    chars += len;
+  }
+
+  /* At least two slots per name and four names per bucket on average */
+  unsigned int slots = 1;
+  while (slots < 2 * count)
+    slots <<= 1;
+  unsigned int buckets = 1;
+  while (buckets < count / 4)
+    buckets <<= 1;
+
+  size_t bytes = sizeof(struct XML_VocabularyStruct);
+  if (! vocabularyAddBytes(&bytes, count, sizeof(XML_Char *))
+      || ! vocabularyAddBytes(&bytes, count, sizeof(size_t))
+      || ! vocabularyAddBytes(&bytes, slots, sizeof(int))
+      || ! vocabularyAddBytes(&bytes, buckets, sizeof(unsigned int))
+      || ! vocabularyAddBytes(&bytes, chars, sizeof(XML_Char)))
+    return NULL;
+  size_t scratchBytes = 0;
+  if (! vocabularyAddBytes(&scratchBytes, count, sizeof(uint64_t))
+      || ! vocabularyAddBytes(&scratchBytes, (size_t)buckets + 1,
+                              sizeof(unsigned int))
+      || ! vocabularyAddBytes(&scratchBytes, count, 2 * sizeof(unsigned int)))
+    return NULL;
+
+  XML_Vocabulary vocabulary
+      = (memsuite != NULL) ? memsuite->malloc_fcn(bytes) : malloc(bytes);
+  if (vocabulary == NULL)
+    return NULL;
+  if (memsuite != NULL) {
+    vocabulary->m_mem = *memsuite;
+  } else {
+    vocabulary->m_mem.malloc_fcn = malloc;
+    vocabulary->m_mem.realloc_fcn = realloc;
+    vocabulary->m_mem.free_fcn = free;
+  }
+  vocabulary->m_count = (int)count;
+  vocabulary->m_bucketMask = buckets - 1;
+  vocabulary->m_slotMask = slots - 1;
+  vocabulary->m_names = (const XML_Char **)(vocabulary + 1);
+  vocabulary->m_lengths = (size_t *)(vocabulary->m_names + count);
+  vocabulary->m_slots = (int *)(vocabulary->m_lengths + count);
+  vocabulary->m_displacements
+      = (unsigned int *)(vocabulary->m_slots + slots);
+  XML_Char *copy = (XML_Char *)(vocabulary->m_displacements + buckets);
+  for (size_t i = 0; i < count; i++) {
+    const size_t len = xcslen(names[i]);
+    memcpy(copy, names[i], (len + 1) * sizeof(XML_Char));
+    vocabulary->m_names[i] = copy;
+    vocabulary->m_lengths[i] = len;
+    copy += len + 1;
+  }
+  memset(vocabulary->m_displacements, 0, buckets * sizeof(unsigned int));
+
+  /* A vocabulary with no names still gets its one slot and bucket */
+  uint64_t *const hashes = (count > 0)
+                               ? vocabulary->m_mem.malloc_fcn(scratchBytes)
+                               : (uint64_t *)NULL;
+  int placed = (count > 0) ? 0 : 1;
+  if ((count > 0) && (hashes != NULL)) {
+    unsigned int *const starts = (unsigned int *)(hashes + count);
+    unsigned int *const items = starts + buckets + 1;
+    unsigned int *const chosen = items + count;
+    for (unsigned int attempt = 0;
+         (placed == 0) && (attempt < VOCABULARY_MAX_ATTEMPTS); attempt++) {
+      vocabulary->m_key.k[0] = FAST_HASH_MULTIPLIER * (attempt + 1);
+      vocabulary->m_key.k[1] = FAST_HASH_FINAL_MULTIPLIER ^ attempt;
+      placed = vocabularyPlace(vocabulary, hashes, starts, items, chosen);
+    }
+    vocabulary->m_mem.free_fcn(hashes);
+  } else if (count == 0) {
+    vocabulary->m_key.k[0] = 0;
+    vocabulary->m_key.k[1] = 0;
+    vocabulary->m_slots[0] = -1;
+  }
+  if (placed != 1) {
+    vocabulary->m_mem.free_fcn(vocabulary);
+    return NULL;
+  }
+  return vocabulary;
+}
+
+void XMLCALL
+XML_VocabularyFree(XML_Vocabulary vocabulary) {
+  if (vocabulary == NULL)
+    return;
+  vocabulary->m_mem.free_fcn(vocabulary);
+}
+
+/* Attaches vocabulary to parser, or detaches any if it is NULL, with empty
+   arrays of element types and attribute IDs */
+static XML_Bool
+setVocabulary(XML_Parser parser, XML_Vocabulary vocabulary) {
+  ELEMENT_TYPE **elementTypes = NULL;
+  ATTRIBUTE_ID **attributeIds = NULL;
+  if ((vocabulary != NULL) && (vocabulary->m_count > 0)) {
+    const size_t count = (size_t)vocabulary->m_count;
+    elementTypes = MALLOC(parser, count * sizeof(ELEMENT_TYPE *));
+    attributeIds = MALLOC(parser, count * sizeof(ATTRIBUTE_ID *));
+    if ((elementTypes == NULL) || (attributeIds == NULL)) {
+      FREE(parser, elementTypes);
+      FREE(parser, attributeIds);
+      return XML_FALSE;
+    }
+    memset(elementTypes, 0, count * sizeof(ELEMENT_TYPE *));
+    memset(attributeIds, 0, count * sizeof(ATTRIBUTE_ID *));
+  }
+  FREE(parser, parser->m_vocabElementTypes);
+  FREE(parser, parser->m_vocabAttributeIds);
+  parser->m_vocabulary = (elementTypes != NULL) ? vocabulary : NULL;
+  parser->m_vocabElementTypes = elementTypes;
+  parser->m_vocabAttributeIds = attributeIds;
+  parser->m_symbolCount
+      = (parser->m_vocabulary != NULL) ? parser->m_vocabulary->m_count : 0;
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_SetVocabulary(XML_Parser parser, XML_Vocabulary vocabulary) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL))
+    return XML_FALSE;
+  /* Block once parsing has started, and once the symbol IDs of names
+     outside the vocabulary are given out */
+  if ((parser->m_parsingStatus.parsing != XML_INITIALIZED)
+      || parser->m_symbols.used)
+    return XML_FALSE;
+  return setVocabulary(parser, vocabulary);
+}
+
+static XML_Bool
+parserBusy(XML_Parser parser) {
+  switch (parser->m_parsingStatus.parsing) {
+  case XML_PARSING:
+  case XML_SUSPENDED:
+    return XML_TRUE;
+  case XML_INITIALIZED:
+  case XML_FINISHED:
+  default:
+    return XML_FALSE;
+  }
+}
+
+XML_DTDSnapshot XMLCALL
+XML_DTDSnapshotCreate(XML_Parser parser) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || parserBusy(parser) || (parser->m_dtd->base != NULL))
+    return NULL;
+  return dtdSnapshotCreate(parser);
+}
+
+/* Snapshots the DTD of parser, which must not have a base */
+static XML_DTDSnapshot
+dtdSnapshotCreate(XML_Parser parser) {
+  XML_Char nameSep[2] = {parser->m_namespaceSeparator, 0};
+  XML_Parser holder = XML_ParserCreate_MM(NULL, &parser->m_mem,
+                                          parser->m_ns ? nameSep : NULL);
+  if (holder == NULL)
+    return NULL;
+  /* The tables of the copy are hashed like those of the original */
+  setHashSecretSalt(parser);
+  holder->m_hash_secret_salt_128 = parser->m_hash_secret_salt_128;
+  holder->m_hash_secret_salt_set = XML_TRUE;
+  XML_DTDSnapshot snapshot = MALLOC(holder, sizeof(*snapshot));
+  if ((snapshot == NULL)
+      || ! dtdCopy(holder, holder->m_dtd, parser->m_dtd, holder)) {
+    FREE(holder, snapshot);
+    /* dtdCopy shares the content model scaffolding */
+    holder->m_dtd->scaffold = NULL;
+    holder->m_dtd->scaffIndex = NULL;
+    XML_ParserFree(holder);
+    return NULL;
+  }
+  holder->m_dtd->in_eldecl = XML_FALSE;
+  holder->m_dtd->scaffold = NULL;
+  holder->m_dtd->scaffIndex = NULL;
+  holder->m_dtd->scaffIndexSize = 0;
+  holder->m_dtd->scaffSize = 0;
+  holder->m_dtd->scaffLevel = 0;
+  holder->m_dtd->contentStringLen = 0;
+  snapshot->m_holder = holder;
+  return snapshot;
+}
+
+void XMLCALL
+XML_DTDSnapshotFree(XML_DTDSnapshot snapshot) {
+  if (snapshot == NULL)
+    return;
+  XML_Parser holder = snapshot->m_holder;
+  FREE(holder, snapshot);
+  XML_ParserFree(holder);
+}
+
+XML_Bool XMLCALL
+XML_SetDTDSnapshot(XML_Parser parser, XML_DTDSnapshot snapshot) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED))
+    return XML_FALSE;
+  if (snapshot == NULL) {
+    parser->m_dtdSnapshot = NULL;
+    dtdUseBase(parser->m_dtd, NULL, NULL);
+    return XML_TRUE;
+  }
+  const XML_Parser holder = snapshot->m_holder;
+  if (holder->m_ns != parser->m_ns)
+    return XML_FALSE;
+  parser->m_dtdSnapshot = snapshot;
+  dtdUseBase(parser->m_dtd, holder->m_dtd, &holder->m_hash_secret_salt_128);
+  return XML_TRUE;
+}
+
+XML_DTDCache XMLCALL
+XML_DTDCacheCreate(const XML_Memory_Handling_Suite *memsuite) {
+  XML_DTDCache cache = (memsuite != NULL)
+                           ? memsuite->malloc_fcn(sizeof(*cache))
+                           : malloc(sizeof(*cache));
+  if (cache == NULL)
+    return NULL;
+  if (memsuite != NULL) {
+    cache->m_mem = *memsuite;
+  } else {
+    cache->m_mem.malloc_fcn = malloc;
+    cache->m_mem.realloc_fcn = realloc;
+    cache->m_mem.free_fcn = free;
+  }
+  cache->m_entries = NULL;
+  return cache;
+}
+
+void XMLCALL
+XML_DTDCacheFree(XML_DTDCache cache) {
+  if (cache == NULL)
+    return;
+  DTD_CACHE_ENTRY *entry = cache->m_entries;
+  while (entry != NULL) {
+    DTD_CACHE_ENTRY *const next = entry->next;
+    XML_DTDSnapshotFree(entry->snapshot);
+    cache->m_mem.free_fcn(entry);
+    entry = next;
+  }
+  cache->m_mem.free_fcn(cache);
+}
+
+XML_Bool XMLCALL
+XML_SetDTDCache(XML_Parser parser, XML_DTDCache cache) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED))
+    return XML_FALSE;
+  parser->m_dtdCache = cache;
+  return XML_TRUE;
+}
+
+enum XML_Status XMLCALL
+XML_SetEncoding(XML_Parser parser, const XML_Char *encodingName) {
+  if (parser == NULL)
+    return XML_STATUS_ERROR;
+  /* Block after XML_Parse()/XML_ParseBuffer() has been called.
+     XXX There's no way for the caller to determine which of the
+     XXX possible error cases caused the XML_STATUS_ERROR return.
+  */
+  if (parserBusy(parser))
+    return XML_STATUS_ERROR;
+
+  /* Get rid of any previous encoding name */
+  FREE(parser, (void *)parser->m_protocolEncodingName);
+
+  if (encodingName == NULL)
+    /* No new encoding name */
+    parser->m_protocolEncodingName = NULL;
+  else {
+    /* Copy the new encoding name into allocated memory */
+    parser->m_protocolEncodingName = copyString(encodingName, parser);
+    if (! parser->m_protocolEncodingName)
+      return XML_STATUS_ERROR;
+  }
+  return XML_STATUS_OK;
+}
+
+XML_Parser XMLCALL
 XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
                                const XML_Char *encodingName) {
+  return externalEntityParserCreate(oldParser, context, encodingName,
+                                    XML_FALSE);
+}
+
+XML_Parser XMLCALL
+XML_FragmentParserCreate(XML_Parser oldParser, const XML_Char *encodingName) {
+  if (oldParser == NULL)
+    return NULL;
+#ifdef XML_DTD
+  if (oldParser->m_isParamEntity)
+    return NULL;
+#endif /* XML_DTD */
+  XML_Parser parser = NULL;
+  const XML_Char *const context = getContext(oldParser);
+  if (context != NULL)
+    parser = externalEntityParserCreate(oldParser, context, encodingName,
+                                        XML_TRUE);
+  poolDiscard(&oldParser->m_tempPool);
+  return parser;
+}
+
+int XMLCALL
+XML_ScanRecords(XML_Parser parser, const char *s, int len,
+                XML_RecordHandler handler, void *userData) {
+  if (parser == NULL || handler == NULL || len < 0 || (s == NULL && len != 0))
+    return -1;
+  /* The input has to continue content that the parser is done with */
+  if (parser->m_parsingStatus.parsing != XML_PARSING
+      || (parser->m_processor != contentProcessor
+          && parser->m_processor != externalEntityContentProcessor)
+      || parser->m_bufferPtr != parser->m_bufferEnd)
+    return -1;
+  if (len == 0)
+    return 0;
+
+  const ENCODING *const enc = parser->m_encoding;
+  const char *const end = s + len;
+  const char *recordStart = s;
+  const char *tokStart = s;
+  unsigned int level = 0;
+  for (;;) {
+    const char *next = tokStart; /* in case of XML_TOK_NONE */
+    int tok = XmlContentTok(enc, tokStart, end, &next);
+    switch (tok) {
+    case XML_TOK_START_TAG_WITH_ATTS:
+    case XML_TOK_START_TAG_NO_ATTS:
+      if (level++ == 0)
+        recordStart = tokStart;
+      break;
+    case XML_TOK_EMPTY_ELEMENT_WITH_ATTS:
+    case XML_TOK_EMPTY_ELEMENT_NO_ATTS:
+      if (level == 0)
+        handler(userData, tokStart, (int)(next - tokStart));
+      break;
+    case XML_TOK_END_TAG:
+      if (level == 0) /* of the element that the records are children of */
+        return (int)(tokStart - s);
+      if (--level == 0)
+        handler(userData, recordStart, (int)(next - recordStart));
+      break;
+    case XML_TOK_CDATA_SECT_OPEN:
+      do {
+        tok = XmlCdataSectionTok(enc, next, end, &next);
+      } while (tok > 0 && tok != XML_TOK_CDATA_SECT_CLOSE);
+      if (tok == XML_TOK_INVALID)
+        return -1;
+      if (tok < 0)
+        return (int)(((level == 0) ? tokStart : recordStart) - s);
+      break;
+    case XML_TOK_INVALID:
+      return -1;
+    case XML_TOK_NONE:
+    case XML_TOK_PARTIAL:
+    case XML_TOK_PARTIAL_CHAR:
+    case XML_TOK_TRAILING_CR:
+    case XML_TOK_TRAILING_RSQB:
+      /* Whatever is incomplete is left for the next call */
+      return (int)(((level == 0) ? tokStart : recordStart) - s);
+    default:
+      break;
+    }
+    tokStart = next;
+  }
+}
+
+/* Creates a parser for an external entity of oldParser: a parameter entity
+   if context is NULL, and a parsed general entity otherwise.  A detached
+   parser, which has to be for a parsed general entity, is a root parser
+   that shares nothing with oldParser, see XML_FragmentParserCreate. */
+static XML_Parser
+externalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
+                           const XML_Char *encodingName, XML_Bool detached) {
   XML_Parser parser = oldParser;
   DTD *newDtd = NULL;
   DTD *oldDtd;
   XML_StartElementHandler oldStartElementHandler;
   XML_EndElementHandler oldEndElementHandler;
+  XML_StartElementIdHandler oldStartElementIdHandler;
+  XML_EndElementIdHandler oldEndElementIdHandler;
   XML_CharacterDataHandler oldCharacterDataHandler;
   XML_ProcessingInstructionHandler oldProcessingInstructionHandler;
   XML_CommentHandler oldCommentHandler;
@@ -1739,7 +3161,9 @@ XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
   */
   struct sipkey oldhash_secret_salt_128;
   XML_Bool oldhash_secret_salt_set;
+  XML_Vocabulary oldVocabulary;
   XML_Bool oldReparseDeferralEnabled;
+  XML_Bool oldCoalesceCharData;
 
   /* Validate the oldParser parameter before we pull everything out of it */
   if (oldParser == NULL)
@@ -1749,6 +3173,8 @@ XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
   oldDtd = parser->m_dtd;
   oldStartElementHandler = parser->m_startElementHandler;
   oldEndElementHandler = parser->m_endElementHandler;
+  oldStartElementIdHandler = parser->m_startElementIdHandler;
+  oldEndElementIdHandler = parser->m_endElementIdHandler;
   oldCharacterDataHandler = parser->m_characterDataHandler;
   oldProcessingInstructionHandler = parser->m_processingInstructionHandler;
   oldCommentHandler = parser->m_commentHandler;
@@ -1786,19 +3212,23 @@ XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
   */
   oldhash_secret_salt_128 = parser->m_hash_secret_salt_128;
   oldhash_secret_salt_set = parser->m_hash_secret_salt_set;
+  oldVocabulary = parser->m_vocabulary;
   oldReparseDeferralEnabled = parser->m_reparseDeferralEnabled;
+  oldCoalesceCharData = parser->m_coalesceCharData;
 
 #ifdef XML_DTD
   if (! context)
     newDtd = oldDtd;
 #endif /* XML_DTD */
 
+  const XML_Parser parentParser = detached ? NULL : oldParser;
   if (parser->m_ns) {
     XML_Char tmp[2] = {parser->m_namespaceSeparator, 0};
-    parser = parserCreate(encodingName, &parser->m_mem, tmp, newDtd, oldParser);
-  } else {
     parser
-        = parserCreate(encodingName, &parser->m_mem, NULL, newDtd, oldParser);
+        = parserCreate(encodingName, &parser->m_mem, tmp, newDtd, parentParser);
+  } else {
+    parser = parserCreate(encodingName, &parser->m_mem, NULL, newDtd,
+                          parentParser);
   }
 
   if (! parser)
@@ -1806,6 +3236,8 @@ XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
 
   parser->m_startElementHandler = oldStartElementHandler;
   parser->m_endElementHandler = oldEndElementHandler;
+  parser->m_startElementIdHandler = oldStartElementIdHandler;
+  parser->m_endElementIdHandler = oldEndElementIdHandler;
   parser->m_characterDataHandler = oldCharacterDataHandler;
   parser->m_processingInstructionHandler = oldProcessingInstructionHandler;
   parser->m_commentHandler = oldCommentHandler;
@@ -1838,7 +3270,45 @@ XML_ExternalEntityParserCreate(XML_Parser oldParser, const XML_Char *context,
   parser->m_hash_secret_salt_128 = oldhash_secret_salt_128;
   parser->m_hash_secret_salt_set = oldhash_secret_salt_set;
   parser->m_reparseDeferralEnabled = oldReparseDeferralEnabled;
-  parser->m_parentParser = oldParser;
+  parser->m_coalesceCharData = oldCoalesceCharData;
+  parser->m_useDocumentArena = oldParser->m_useDocumentArena;
+  parser->m_recordEvents = oldParser->m_recordEvents;
+  parser->m_eventBatchHandler = oldParser->m_eventBatchHandler;
+  parser->m_eventArrayHandler = oldParser->m_eventArrayHandler;
+  parser->m_eventArray = oldParser->m_eventArray;
+  parser->m_eventBatchSize = oldParser->m_eventBatchSize;
+  parser->m_parentParser = parentParser;
+  if (detached) {
+    /* Nothing may point into the DTD of oldParser, and the limits of its
+       root parser apply */
+    parser->m_isFragment = XML_TRUE;
+    parser->m_declElementType = NULL;
+    /* The event array of oldParser is not ours to write into, maybe while
+       oldParser does on another thread, so events go to the handlers */
+    if (parser->m_eventArrayHandler) {
+      parser->m_recordEvents = XML_FALSE;
+      parser->m_eventArrayHandler = NULL;
+      parser->m_eventArray = NULL;
+      parser->m_eventBatchSize = 0;
+    }
+#if XML_GE == 1
+    const XML_Parser rootParser = getRootParserOf(oldParser, NULL);
+    parser->m_accounting.maximumAmplificationFactor
+        = rootParser->m_accounting.maximumAmplificationFactor;
+    parser->m_accounting.activationThresholdBytes
+        = rootParser->m_accounting.activationThresholdBytes;
+    parser->m_alloc_tracker.maximumAmplificationFactor
+        = rootParser->m_alloc_tracker.maximumAmplificationFactor;
+    parser->m_alloc_tracker.activationThresholdBytes
+        = rootParser->m_alloc_tracker.activationThresholdBytes;
+#endif
+  }
+  if (! setVocabulary(parser, oldVocabulary)
+      || (detached
+          && ! copySymbols(parser, getRootParserOf(oldParser, NULL)))) {
+    XML_ParserFree(parser);
+    return NULL;
+  }
 #ifdef XML_DTD
   parser->m_paramEntityParsing = oldParamEntityParsing;
   parser->m_prologState.inEntityValue = oldInEntityValue;
@@ -1879,58 +3349,80 @@ destroyBindings(BINDING *bindings, XML_Parser parser) {
   }
 }
 
+/* Frees the tags, bindings and open entities of parser, in use or not */
+static void
+destroyDocumentObjects(XML_Parser parser) {
+  if (parser->m_useDocumentArena)
+    arenaDestroy(&parser->m_documentArena);
+  else {
+    TAG *tagList;
+    /* free m_tagStack and m_freeTagList */
+    tagList = parser->m_tagStack;
+    for (;;) {
+      TAG *p;
+      if (tagList == NULL) {
+        if (parser->m_freeTagList == NULL)
+          break;
+        tagList = parser->m_freeTagList;
+        parser->m_freeTagList = NULL;
+      }
+      p = tagList;
+      tagList = tagList->parent;
+      FREE(parser, p->buf.raw);
+      destroyBindings(p->bindings, parser);
+      FREE(parser, p);
+    }
+    /* free m_openInternalEntities */
+    for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openInternalEntities;
+         entityList != NULL;) {
+      OPEN_INTERNAL_ENTITY *const openEntity = entityList;
+      entityList = entityList->next;
+      FREE(parser, openEntity);
+    }
+    /* free m_openAttributeEntities */
+    for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openAttributeEntities;
+         entityList != NULL;) {
+      OPEN_INTERNAL_ENTITY *const openEntity = entityList;
+      entityList = entityList->next;
+      FREE(parser, openEntity);
+    }
+    /* free m_openValueEntities */
+    for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openValueEntities;
+         entityList != NULL;) {
+      OPEN_INTERNAL_ENTITY *const openEntity = entityList;
+      entityList = entityList->next;
+      FREE(parser, openEntity);
+    }
+    /* free m_freeEntities */
+    for (OPEN_INTERNAL_ENTITY *entityList = parser->m_freeEntities;
+         entityList != NULL;) {
+      OPEN_INTERNAL_ENTITY *const openEntity = entityList;
+      entityList = entityList->next;
+      FREE(parser, openEntity);
+    }
+    destroyBindings(parser->m_freeBindingList, parser);
+    destroyBindings(parser->m_inheritedBindings, parser);
+  }
+  parser->m_tagStack = NULL;
+  parser->m_freeTagList = NULL;
+  parser->m_openInternalEntities = NULL;
+  parser->m_openAttributeEntities = NULL;
+  parser->m_openValueEntities = NULL;
+  parser->m_freeEntities = NULL;
+  parser->m_freeBindingList = NULL;
+  parser->m_inheritedBindings = NULL;
+}
+
 void XMLCALL
 XML_ParserFree(XML_Parser parser) {
-  TAG *tagList;
   if ((parser == NULL) || isCalledFromInsideHandler(parser))
     return;
-  /* free m_tagStack and m_freeTagList */
-  tagList = parser->m_tagStack;
-  for (;;) {
-    TAG *p;
-    if (tagList == NULL) {
-      if (parser->m_freeTagList == NULL)
-        break;
-      tagList = parser->m_freeTagList;
-      parser->m_freeTagList = NULL;
-    }
-    p = tagList;
-    tagList = tagList->parent;
-    FREE(parser, p->buf.raw);
-    destroyBindings(p->bindings, parser);
-    FREE(parser, p);
-  }
-  /* free m_openInternalEntities */
-  for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openInternalEntities;
-       entityList != NULL;) {
-    OPEN_INTERNAL_ENTITY *const openEntity = entityList;
-    entityList = entityList->next;
-    FREE(parser, openEntity);
-  }
-  /* free m_openAttributeEntities */
-  for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openAttributeEntities;
-       entityList != NULL;) {
-    OPEN_INTERNAL_ENTITY *const openEntity = entityList;
-    entityList = entityList->next;
-    FREE(parser, openEntity);
-  }
-  /* free m_openValueEntities */
-  for (OPEN_INTERNAL_ENTITY *entityList = parser->m_openValueEntities;
-       entityList != NULL;) {
-    OPEN_INTERNAL_ENTITY *const openEntity = entityList;
-    entityList = entityList->next;
-    FREE(parser, openEntity);
-  }
-  /* free m_freeEntities */
-  for (OPEN_INTERNAL_ENTITY *entityList = parser->m_freeEntities;
-       entityList != NULL;) {
-    OPEN_INTERNAL_ENTITY *const openEntity = entityList;
-    entityList = entityList->next;
-    FREE(parser, openEntity);
+  destroyDocumentObjects(parser);
+  while (parser->m_eventBatches) {
+    const XML_EventBatch batch = parser->m_eventBatches;
+    parser->m_eventBatches = batch->next;
+    freeEventBatch(parser, batch);
   }
-  parser->m_freeEntities = NULL;
-  destroyBindings(parser->m_freeBindingList, parser);
-  destroyBindings(parser->m_inheritedBindings, parser);
   poolDestroy(&parser->m_tempPool);
   poolDestroy(&parser->m_temp2Pool);
   FREE(parser, (void *)parser->m_protocolEncodingName);
@@ -1953,7 +3445,12 @@ XML_ParserFree(XML_Parser parser) {
   //       .malloc_fcn(..).
   parser->m_mem.free_fcn(parser->m_buffer);
   FREE(parser, parser->m_dataBuf);
+  FREE(parser, parser->m_coalescedCharData);
   FREE(parser, parser->m_nsAtts);
+  FREE(parser, parser->m_attSymbolIds);
+  arenaDestroy(&parser->m_symbolArena);
+  FREE(parser, parser->m_vocabElementTypes);
+  FREE(parser, parser->m_vocabAttributeIds);
   FREE(parser, parser->m_unknownEncodingMem);
   if (parser->m_unknownEncodingRelease)
     callUnknownEncodingRelease(parser);
@@ -2067,6 +3564,22 @@ XML_SetEndElementHandler(XML_Parser parser, XML_EndElementHandler end) {
     parser->m_endElementHandler = end;
 }
 
+void XMLCALL
+XML_SetElementIdHandler(XML_Parser parser, XML_StartElementIdHandler start,
+                        XML_EndElementIdHandler end) {
+  if (parser == NULL)
+    return;
+  parser->m_startElementIdHandler = start;
+  parser->m_endElementIdHandler = end;
+}
+
+int XMLCALL
+XML_GetSymbolId(XML_Parser parser, const XML_Char *name) {
+  if ((parser == NULL) || (name == NULL))
+    return 0;
+  return getSymbolId(parser, name);
+}
+
 void XMLCALL
 XML_SetCharacterDataHandler(XML_Parser parser,
                             XML_CharacterDataHandler handler) {
@@ -2275,8 +3788,9 @@ XML_SetHashSalt(XML_Parser parser, unsigned long hash_salt) {
   const XML_Parser rootParser = getRootParserOf(parser, NULL);
   assert(! rootParser->m_parentParser);
 
-  /* block after XML_Parse()/XML_ParseBuffer() has been called */
-  if (parserBusy(rootParser))
+  /* block after XML_Parse()/XML_ParseBuffer() has been called,
+     and once the symbol IDs depend on the salt */
+  if (parserBusy(rootParser) || rootParser->m_symbols.used)
     return 0;
 
   rootParser->m_hash_secret_salt_128.k[0] = 0;
@@ -2305,8 +3819,9 @@ XML_SetHashSalt16Bytes(XML_Parser parser, const uint8_t entropy[16]) {
   const XML_Parser rootParser = getRootParserOf(parser, NULL);
   assert(! rootParser->m_parentParser);
 
-  /* block after XML_Parse()/XML_ParseBuffer() has been called */
-  if (parserBusy(rootParser))
+  /* block after XML_Parse()/XML_ParseBuffer() has been called,
+     and once the symbol IDs depend on the salt */
+  if (parserBusy(rootParser) || rootParser->m_symbols.used)
     return XML_FALSE;
 
   sip_tokey(&(rootParser->m_hash_secret_salt_128), entropy);
@@ -2318,6 +3833,150 @@ XML_SetHashSalt16Bytes(XML_Parser parser, const uint8_t entropy[16]) {
   return XML_TRUE;
 }
 
+/* Moves the position up to the current event so that position queries made
+   after the parse call do not need to look at the input again.
+*/
+static void
+updatePositionToEvent(XML_Parser parser) {
+  if (parser->m_eventPtr && parser->m_eventPtr >= parser->m_positionPtr) {
+    XmlUpdatePosition(parser->m_encoding, parser->m_positionPtr,
+                      parser->m_eventPtr, &parser->m_position);
+    parser->m_positionPtr = parser->m_eventPtr;
+  }
+}
+
+/* Appends input that has not been parsed yet to the internal buffer, even
+   while parsing is suspended.  Returns XML_FALSE if we are out of memory.
+*/
+static XML_Bool
+keepUnparsedInput(XML_Parser parser, const char *s, int len) {
+  if (len == 0)
+    return XML_TRUE;
+  // Back up and restore the parsing status to avoid XML_ERROR_SUSPENDED
+  // (and XML_ERROR_FINISHED) from XML_GetBuffer.
+  const enum XML_Parsing originalStatus = parser->m_parsingStatus.parsing;
+  const int lastBufferRequestSize = parser->m_lastBufferRequestSize;
+  parser->m_parsingStatus.parsing = XML_PARSING;
+  void *const temp = XML_GetBuffer(parser, len);
+  parser->m_parsingStatus.parsing = originalStatus;
+  // GetBuffer may have overwritten this, but we want to remember what the
+  // app requested, not how many bytes were left over after parsing.
+  parser->m_lastBufferRequestSize = lastBufferRequestSize;
+  if (temp == NULL) {
+    // NOTE: parser->m_errorCode has already been set by XML_GetBuffer().
+    parser->m_eventPtr = parser->m_eventEndPtr = NULL;
+    parser->m_processor = errorProcessor;
+    return XML_FALSE;
+  }
+  memcpy(temp, s, len);
+  parser->m_bufferEnd += len;
+  return XML_TRUE;
+}
+
+/* Copies the input around an error in a buffer that was parsed in place
+   to the internal buffer, as the application may free its buffer as soon
+   as we return.  Without memory for the copy, the error is reported
+   without input context or byte index.
+*/
+static void
+keepErrorContext(XML_Parser parser) {
+#if XML_CONTEXT_BYTES > 0
+  const char *const start = parser->m_externalBuffer;
+  const char *const eventPtr = parser->m_eventPtr;
+  const char *const parseEndPtr = parser->m_parseEndPtr;
+  const enum XML_Error errorCode = parser->m_errorCode;
+  parser->m_externalBuffer = NULL;
+  if (eventPtr == NULL)
+    return;
+  const int before = (int)EXPAT_MIN(eventPtr - start, XML_CONTEXT_BYTES);
+  const int after = (int)EXPAT_MIN(parseEndPtr - eventPtr, XML_CONTEXT_BYTES);
+  parser->m_bufferPtr = parser->m_bufferEnd = parser->m_buffer;
+  if (! keepUnparsedInput(parser, eventPtr - before, before + after)) {
+    parser->m_errorCode = errorCode;
+    return;
+  }
+  parser->m_eventPtr = parser->m_bufferPtr + before;
+  parser->m_eventEndPtr = parser->m_positionPtr = parser->m_eventPtr;
+  // Keep the byte index of the error where it was
+  parser->m_parseEndByteIndex -= (parseEndPtr - eventPtr) - after;
+  parser->m_parseEndPtr = parser->m_bufferEnd;
+#else
+  // There is no input context to keep; the event pointers are only
+  // compared, never read.
+  parser->m_externalBuffer = NULL;
+#endif /* XML_CONTEXT_BYTES > 0 */
+}
+
+/* Parses s without copying it to the internal buffer first, which has to be
+   empty.  Only input that could not be parsed yet (a token that is cut off
+   at the end of s, or everything after the point of suspension) is copied.
+*/
+static enum XML_Status
+parseInPlace(XML_Parser parser, const char *s, int len, int isFinal) {
+  const char *end;
+  int nLeftOver;
+  enum XML_Status result;
+  /* Detect overflow (a+b > MAX <==> b > MAX-a) */
+  if ((uint64_t)len > UINT64_MAX - parser->m_parseEndByteIndex) {
+    parser->m_errorCode = XML_ERROR_NO_MEMORY;
+    parser->m_eventPtr = parser->m_eventEndPtr = NULL;
+    parser->m_processor = errorProcessor;
+    return XML_STATUS_ERROR;
+  }
+  // though this isn't a buffer request, we assume that `len` is the app's
+  // preferred buffer fill size, and therefore save it here.
+  parser->m_lastBufferRequestSize = len;
+  parser->m_parseEndByteIndex += len;
+  parser->m_positionPtr = s;
+  parser->m_externalBuffer = s;
+  // The event pointers may still point into input passed before, which
+  // errorProcessor leaves alone; the position is updated from them below.
+  parser->m_eventPtr = parser->m_eventEndPtr = s;
+  parser->m_parsingStatus.finalBuffer = (XML_Bool)isFinal;
+
+  parser->m_errorCode
+      = callProcessor(parser, s, parser->m_parseEndPtr = s + len, &end);
+
+  if (parser->m_errorCode != XML_ERROR_NONE) {
+    parser->m_eventEndPtr = parser->m_eventPtr;
+    parser->m_processor = errorProcessor;
+    updatePositionToEvent(parser);
+    keepErrorContext(parser);
+    return XML_STATUS_ERROR;
+  } else {
+    switch (parser->m_parsingStatus.parsing) {
+    case XML_SUSPENDED:
+      result = XML_STATUS_SUSPENDED;
+      break;
+    case XML_INITIALIZED:
+    case XML_PARSING:
+      if (isFinal) {
+        parser->m_parsingStatus.parsing = XML_FINISHED;
+        updatePositionToEvent(parser);
+        return XML_STATUS_OK;
+      }
+      EXPAT_FALLTHROUGH;
+    default:
+      result = XML_STATUS_OK;
+    }
+  }
+
+  XmlUpdatePosition(parser->m_encoding, parser->m_positionPtr, end,
+                    &parser->m_position);
+  nLeftOver = (int)(s + len - end);
+  // Whatever the internal buffer held before is not followed by s, so it
+  // cannot serve as context for the bytes left over.
+  parser->m_bufferPtr = parser->m_bufferEnd = parser->m_buffer;
+  if (! keepUnparsedInput(parser, end, nLeftOver))
+    return XML_STATUS_ERROR;
+  parser->m_positionPtr = parser->m_bufferPtr;
+  parser->m_parseEndPtr = parser->m_bufferEnd;
+  parser->m_eventPtr = parser->m_bufferPtr;
+  parser->m_eventEndPtr = parser->m_bufferPtr;
+  parser->m_externalBuffer = NULL;
+  return result;
+}
+
 enum XML_Status XMLCALL
 XML_Parse(XML_Parser parser, const char *s, int len, int isFinal) {
   if ((parser == NULL) || (len < 0) || ((s == NULL) && (len != 0))) {
@@ -2345,81 +4004,8 @@ XML_Parse(XML_Parser parser, const char *s, int len, int isFinal) {
   }
 
 #if XML_CONTEXT_BYTES == 0
-  if (parser->m_bufferPtr == parser->m_bufferEnd) {
-    const char *end;
-    int nLeftOver;
-    enum XML_Status result;
-    /* Detect overflow (a+b > MAX <==> b > MAX-a) */
-    if ((uint64_t)len > UINT64_MAX - parser->m_parseEndByteIndex) {
-      parser->m_errorCode = XML_ERROR_NO_MEMORY;
-      parser->m_eventPtr = parser->m_eventEndPtr = NULL;
-      parser->m_processor = errorProcessor;
-      return XML_STATUS_ERROR;
-    }
-    // though this isn't a buffer request, we assume that `len` is the app's
-    // preferred buffer fill size, and therefore save it here.
-    parser->m_lastBufferRequestSize = len;
-    parser->m_parseEndByteIndex += len;
-    parser->m_positionPtr = s;
-    parser->m_parsingStatus.finalBuffer = (XML_Bool)isFinal;
-
-    parser->m_errorCode
-        = callProcessor(parser, s, parser->m_parseEndPtr = s + len, &end);
-
-    if (parser->m_errorCode != XML_ERROR_NONE) {
-      parser->m_eventEndPtr = parser->m_eventPtr;
-      parser->m_processor = errorProcessor;
-      return XML_STATUS_ERROR;
-    } else {
-      switch (parser->m_parsingStatus.parsing) {
-      case XML_SUSPENDED:
-        result = XML_STATUS_SUSPENDED;
-        break;
-      case XML_INITIALIZED:
-      case XML_PARSING:
-        if (isFinal) {
-          parser->m_parsingStatus.parsing = XML_FINISHED;
-          return XML_STATUS_OK;
-        }
-        EXPAT_FALLTHROUGH;
-      default:
-        result = XML_STATUS_OK;
-      }
-    }
-
-    XmlUpdatePosition(parser->m_encoding, parser->m_positionPtr, end,
-                      &parser->m_position);
-    nLeftOver = s + len - end;
-    if (nLeftOver) {
-      // Back up and restore the parsing status to avoid XML_ERROR_SUSPENDED
-      // (and XML_ERROR_FINISHED) from XML_GetBuffer.
-      const enum XML_Parsing originalStatus = parser->m_parsingStatus.parsing;
-      parser->m_parsingStatus.parsing = XML_PARSING;
-      void *const temp = XML_GetBuffer(parser, nLeftOver);
-      parser->m_parsingStatus.parsing = originalStatus;
-      // GetBuffer may have overwritten this, but we want to remember what the
-      // app requested, not how many bytes were left over after parsing.
-      parser->m_lastBufferRequestSize = len;
-      if (temp == NULL) {
-        // NOTE: parser->m_errorCode has already been set by XML_GetBuffer().
-        parser->m_eventPtr = parser->m_eventEndPtr = NULL;
-        parser->m_processor = errorProcessor;
-        return XML_STATUS_ERROR;
-      }
-      // Since we know that the buffer was empty and XML_CONTEXT_BYTES is 0, we
-      // don't have any data to preserve, and can copy straight into the start
-      // of the buffer rather than the GetBuffer return pointer (which may be
-      // pointing further into the allocated buffer).
-      memcpy(parser->m_buffer, end, nLeftOver);
-    }
-    parser->m_bufferPtr = parser->m_buffer;
-    parser->m_bufferEnd = parser->m_buffer + nLeftOver;
-    parser->m_positionPtr = parser->m_bufferPtr;
-    parser->m_parseEndPtr = parser->m_bufferEnd;
-    parser->m_eventPtr = parser->m_bufferPtr;
-    parser->m_eventEndPtr = parser->m_bufferPtr;
-    return result;
-  }
+  if (parser->m_bufferPtr == parser->m_bufferEnd)
+    return parseInPlace(parser, s, len, isFinal);
 #endif /* XML_CONTEXT_BYTES == 0 */
   void *buff = XML_GetBuffer(parser, len);
   if (buff == NULL)
@@ -2511,6 +4097,85 @@ XML_ParseBuffer(XML_Parser parser, int len, int isFinal) {
   return result;
 }
 
+enum XML_Status XMLCALL
+XML_ParseExternalBuffer(XML_Parser parser, const char *s, int len,
+                        int isFinal) {
+  if ((parser == NULL) || (len < 0) || ((s == NULL) && (len != 0))) {
+    if (parser != NULL)
+      parser->m_errorCode = XML_ERROR_INVALID_ARGUMENT;
+    return XML_STATUS_ERROR;
+  }
+  if (isCalledFromInsideHandler(parser))
+    return XML_STATUS_ERROR;
+  switch (parser->m_parsingStatus.parsing) {
+  case XML_SUSPENDED:
+    parser->m_errorCode = XML_ERROR_SUSPENDED;
+    return XML_STATUS_ERROR;
+  case XML_FINISHED:
+    parser->m_errorCode = XML_ERROR_FINISHED;
+    return XML_STATUS_ERROR;
+  case XML_INITIALIZED:
+    if (parser->m_parentParser == NULL && ! startParsing(parser)) {
+      parser->m_errorCode = XML_ERROR_NO_MEMORY;
+      return XML_STATUS_ERROR;
+    }
+    EXPAT_FALLTHROUGH;
+  default:
+    parser->m_parsingStatus.parsing = XML_PARSING;
+  }
+
+  // A token cut off at the end of the previous buffer is still waiting in
+  // the internal buffer.  We copy just enough of s behind it to complete it,
+  // and continue in place once the parser has moved on into s.
+  // An empty buffer has nothing to parse in place, so it goes the usual way.
+  int chunkSize = INIT_BUFFER_SIZE;
+  while ((parser->m_bufferPtr != parser->m_bufferEnd) || (len == 0)) {
+    const int waiting
+        = (int)EXPAT_SAFE_PTR_DIFF(parser->m_bufferEnd, parser->m_bufferPtr);
+    // Offering at least as many new bytes as are waiting keeps reparse
+    // deferral from skipping the attempt
+    if (chunkSize < waiting)
+      chunkSize = waiting;
+    const int chunk = (len < chunkSize) ? len : chunkSize;
+    void *const buff = XML_GetBuffer(parser, chunk);
+    if (buff == NULL)
+      return XML_STATUS_ERROR;
+    if (chunk > 0)
+      memcpy(buff, s, chunk);
+    const enum XML_Status status
+        = XML_ParseBuffer(parser, chunk, isFinal && (chunk == len));
+    if (status == XML_STATUS_SUSPENDED) {
+      // XML_ResumeParser will continue from the internal buffer
+      if (! keepUnparsedInput(parser, s + chunk, len - chunk))
+        return XML_STATUS_ERROR;
+      parser->m_parseEndByteIndex += (uint64_t)(len - chunk);
+      parser->m_positionPtr = parser->m_bufferPtr;
+      parser->m_parseEndPtr = parser->m_bufferEnd;
+      parser->m_eventPtr = parser->m_bufferPtr;
+      parser->m_eventEndPtr = parser->m_bufferPtr;
+      return status;
+    }
+    if ((status != XML_STATUS_OK) || (chunk == len)
+        || (parser->m_parsingStatus.parsing != XML_PARSING))
+      return status;
+    const int unparsed
+        = (int)EXPAT_SAFE_PTR_DIFF(parser->m_bufferEnd, parser->m_bufferPtr);
+    if (unparsed < chunk) {
+      // The bytes still unparsed are also in s, so drop them here
+      parser->m_bufferEnd = (char *)parser->m_bufferPtr;
+      parser->m_parseEndByteIndex -= (uint64_t)unparsed;
+      s += chunk - unparsed;
+      len -= chunk - unparsed;
+    } else {
+      s += chunk;
+      len -= chunk;
+      if (chunkSize <= INT_MAX / 2)
+        chunkSize *= 2;
+    }
+  }
+  return parseInPlace(parser, s, len, isFinal);
+}
+
 /* Modifies `parser`’s buffer to be backed by `newBuf`. */
 static void
 setParserBuffer(XML_Parser parser, char *newBuf, int newBufSize, int keep) {
@@ -2552,6 +4217,13 @@ XML_GetBuffer(XML_Parser parser, int len) {
   default:;
   }
 
+  // Events from a buffer that was parsed in place are not in the internal
+  // buffer, so they cannot be reported relative to it.
+  if (parser->m_externalBuffer) {
+    parser->m_externalBuffer = NULL;
+    parser->m_eventPtr = parser->m_eventEndPtr = NULL;
+  }
+
   // whether or not the request succeeds, `len` seems to be the app's preferred
   // buffer fill size; remember it.
   parser->m_lastBufferRequestSize = len;
@@ -2626,6 +4298,7 @@ XML_GetBuffer(XML_Parser parser, int len) {
     parser->m_eventPtr = parser->m_eventEndPtr = NULL;
     parser->m_positionPtr = NULL;
   }
+  parser->m_bufferHandedOut = XML_TRUE;
   return parser->m_bufferEnd;
 }
 
@@ -2756,6 +4429,13 @@ XML_GetInputContext(XML_Parser parser, int *offset, int *size) {
 #if XML_CONTEXT_BYTES > 0
   if (parser == NULL)
     return NULL;
+  if (parser->m_eventPtr && parser->m_externalBuffer) {
+    if (offset != NULL)
+      *offset = (int)(parser->m_eventPtr - parser->m_externalBuffer);
+    if (size != NULL)
+      *size = (int)(parser->m_parseEndPtr - parser->m_externalBuffer);
+    return parser->m_externalBuffer;
+  }
   if (parser->m_eventPtr && parser->m_buffer) {
     if (offset != NULL)
       *offset = (int)(parser->m_eventPtr - parser->m_buffer);
@@ -3051,6 +4731,8 @@ XML_GetFeatureList(void) {
        XML_L("XML_AT_ACT_THRES"),
        (long int)EXPAT_ALLOC_TRACKER_ACTIVATION_THRESHOLD_DEFAULT},
 #endif
+      /* Added in Expat 2.8.4. */
+      {XML_FEATURE_ADAPTIVE_HASH, XML_L("XML_ADAPTIVE_HASH"), 0},
       {XML_FEATURE_END, NULL, 0}};
 
   return features;
@@ -3112,6 +4794,163 @@ XML_SetReparseDeferralEnabled(XML_Parser parser, XML_Bool enabled) {
   return XML_FALSE;
 }
 
+XML_Bool XMLCALL
+XML_SetCharacterDataCoalescing(XML_Parser parser, XML_Bool enabled) {
+  if (parser != NULL && (enabled == XML_TRUE || enabled == XML_FALSE)) {
+    parser->m_coalesceCharData = enabled;
+    return XML_TRUE;
+  }
+  return XML_FALSE;
+}
+
+XML_Bool XMLCALL
+XML_SetMemoryRetention(XML_Parser parser, unsigned int documents) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (documents > POOL_PEAK_HISTORY))
+    return XML_FALSE;
+  parser->m_poolRetention = documents;
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_TrimMemory(XML_Parser parser) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED))
+    return XML_FALSE;
+  poolTrim(&parser->m_tempPool);
+  poolTrim(&parser->m_temp2Pool);
+  poolTrim(&parser->m_dtd->pool);
+  poolTrim(&parser->m_dtd->entityValuePool);
+  arenaTrim(&parser->m_dtd->arena);
+  arenaTrim(&parser->m_symbolArena);
+  destroyDocumentObjects(parser);
+  freeEventBatches(parser, 0);
+  /* The application may be filling a buffer from XML_GetBuffer for the
+     next XML_ParseBuffer call */
+  if (! parser->m_bufferHandedOut
+      && (parser->m_bufferEnd <= parser->m_buffer)) {
+    parser->m_mem.free_fcn(parser->m_buffer);
+    parser->m_buffer = NULL;
+    parser->m_bufferPtr = NULL;
+    parser->m_bufferEnd = NULL;
+    parser->m_bufferLim = NULL;
+  }
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_SetDocumentArena(XML_Parser parser, XML_Bool enabled) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED)
+      || ((enabled != XML_TRUE) && (enabled != XML_FALSE)))
+    return XML_FALSE;
+  if (enabled != parser->m_useDocumentArena) {
+    /* Nothing is in use before parsing, and what is kept for later came
+       from the other place */
+    destroyDocumentObjects(parser);
+    parser->m_useDocumentArena = enabled;
+  }
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_SetEventBatchHandler(XML_Parser parser, XML_EventBatchHandler handler,
+                         int maxEvents) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED)
+      || ((handler != NULL) && (maxEvents < 1)))
+    return XML_FALSE;
+  parser->m_recordEvents = (handler != NULL);
+  parser->m_eventBatchHandler = handler;
+  parser->m_eventArrayHandler = NULL;
+  parser->m_eventBatchSize = handler ? maxEvents : 0;
+  freeEventBatches(parser, parser->m_eventBatchSize);
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_SetEventArrayHandler(XML_Parser parser, XML_EventArrayHandler handler,
+                         XML_Event *events, int maxEvents) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED)
+      || ((handler != NULL) && ((events == NULL) || (maxEvents < 1))))
+    return XML_FALSE;
+  parser->m_recordEvents = (handler != NULL);
+  parser->m_eventBatchHandler = NULL;
+  parser->m_eventArrayHandler = handler;
+  parser->m_eventArray = handler ? events : NULL;
+  parser->m_eventBatchSize = handler ? maxEvents : 0;
+  freeEventBatches(parser, 0);
+  return XML_TRUE;
+}
+
+XML_Bool XMLCALL
+XML_SetPullParsing(XML_Parser parser, int maxEvents) {
+  if ((parser == NULL) || (parser->m_parentParser != NULL)
+      || (parser->m_parsingStatus.parsing != XML_INITIALIZED)
+      || (maxEvents < 0))
+    return XML_FALSE;
+  parser->m_recordEvents = (maxEvents > 0);
+  parser->m_eventBatchHandler = NULL;
+  parser->m_eventArrayHandler = NULL;
+  parser->m_eventBatchSize = maxEvents;
+  freeEventBatches(parser, parser->m_eventBatchSize);
+  return XML_TRUE;
+}
+
+enum XML_Status XMLCALL
+XML_NextEvent(XML_Parser parser, const XML_Event **event) {
+  if (parser == NULL)
+    return XML_STATUS_ERROR;
+  if ((event == NULL) || ! pullsEvents(parser)
+      || (parser->m_parentParser != NULL)) {
+    parser->m_errorCode = XML_ERROR_INVALID_ARGUMENT;
+    return XML_STATUS_ERROR;
+  }
+  *event = NULL;
+  XML_EventBatch batch = parser->m_eventBatch;
+  if ((batch == NULL) || (batch->pulled == batch->count)) {
+    /* Everything recorded has been returned, so start over */
+    if (batch != NULL) {
+      batch->count = 0;
+      batch->pulled = 0;
+      arenaClear(&batch->arena);
+    }
+    if (parser->m_parsingStatus.parsing != XML_SUSPENDED)
+      return XML_STATUS_OK;
+    if (XML_ResumeParser(parser) == XML_STATUS_ERROR)
+      return XML_STATUS_ERROR;
+    batch = parser->m_eventBatch;
+    if ((batch == NULL) || (batch->count == 0))
+      return XML_STATUS_OK;
+  }
+  *event = &batch->events[batch->pulled++];
+  return XML_STATUS_OK;
+}
+
+const XML_Event *XMLCALL
+XML_GetEventBatchEvents(XML_EventBatch batch, int *count) {
+  if (count != NULL)
+    *count = batch ? batch->count : 0;
+  return batch ? batch->events : NULL;
+}
+
+void XMLCALL
+XML_ReleaseEventBatch(XML_Parser parser, XML_EventBatch batch) {
+  if ((parser == NULL) || (batch == NULL))
+    return;
+  const XML_Parser rootParser = getRootParserOf(parser, NULL);
+  batch->count = 0;
+  batch->pulled = 0;
+  arenaClear(&batch->arena);
+  batch->nextFree = rootParser->m_freeEventBatches;
+  rootParser->m_freeEventBatches = batch;
+  /* A batch of another size or of the event array handler is of no use
+     any more */
+  if ((batch->size != rootParser->m_eventBatchSize) || batch->callerEvents)
+    freeEventBatches(rootParser, rootParser->m_eventBatchSize);
+}
+
 /* Initially tag->rawName always points into the parse buffer;
    for those TAG instances opened while the current parse buffer was
    processed, and not yet closed, we need to store tag->rawName in a more
@@ -3141,7 +4980,9 @@ storeRawNames(XML_Parser parser) {
       return XML_FALSE;
     bufSize = nameLen + rawNameLen;
     if (bufSize > (size_t)(tag->bufEnd - tag->buf.raw)) {
-      char *temp = REALLOC(parser, tag->buf.raw, bufSize);
+      char *temp = documentRealloc(parser, tag->buf.raw,
+                                   (size_t)(tag->bufEnd - tag->buf.raw),
+                                   bufSize);
       if (temp == NULL)
         return XML_FALSE;
       /* if tag->name.str points to tag->buf.str (only when namespace
@@ -3301,6 +5142,66 @@ externalEntityContentProcessor(XML_Parser parser, const char *start,
   return result;
 }
 
+/* Whether the entity reference from s to next in content is reported to
+   a handler other than the character data handler; mirrors the handling
+   of XML_TOK_ENTITY_REF in doContent.  References that are expanded or
+   turned into character data merge with the text around them. */
+static XML_Bool
+entityRefEndsCharacterData(XML_Parser parser, const ENCODING *enc,
+                           const char *s, const char *next) {
+  DTD *const dtd = parser->m_dtd;
+  if (XmlPredefinedEntityName(enc, s + enc->minBytesPerChar,
+                              next - enc->minBytesPerChar))
+    return XML_FALSE;
+  const XML_Char *const name = poolStoreString(
+      &dtd->pool, enc, s + enc->minBytesPerChar, next - enc->minBytesPerChar);
+  if (! name)
+    return XML_FALSE;
+  const ENTITY *const entity
+      = (ENTITY *)dtdLookup(parser, dtd, &dtd->generalEntities, name, 0);
+  poolDiscard(&dtd->pool);
+  const XML_Bool skippedOrDefault
+      = (parser->m_skippedEntityHandler != NULL)
+        || (parser->m_defaultHandler != NULL);
+  if (! dtd->hasParamEntityRefs || dtd->standalone) {
+    if (! entity || ! entity->is_internal)
+      return XML_FALSE;
+  } else if (! entity)
+    return skippedOrDefault;
+  if (entity->open || entity->notation)
+    return XML_FALSE;
+  if (entity->textPtr)
+    return ! parser->m_defaultExpandInternalEntities && skippedOrDefault;
+  return (parser->m_externalEntityRefHandler != NULL)
+         || (parser->m_defaultHandler != NULL);
+}
+
+/* Whether the token from s to next in content ends the character data
+   collected while coalescing, because the token is markup or is reported
+   to a handler other than the character data handler */
+static XML_Bool
+tokenEndsCharacterData(XML_Parser parser, const ENCODING *enc, int tok,
+                       const char *s, const char *next) {
+  switch (tok) {
+  case XML_TOK_START_TAG_NO_ATTS:
+  case XML_TOK_START_TAG_WITH_ATTS:
+  case XML_TOK_EMPTY_ELEMENT_NO_ATTS:
+  case XML_TOK_EMPTY_ELEMENT_WITH_ATTS:
+  case XML_TOK_END_TAG:
+  case XML_TOK_PI:
+  case XML_TOK_COMMENT:
+    /* Markup ends a text node even if no handler fires for it */
+    return XML_TRUE;
+  case XML_TOK_CDATA_SECT_OPEN:
+    return (parser->m_startCdataSectionHandler != NULL)
+           || (parser->m_defaultHandler != NULL);
+  case XML_TOK_ENTITY_REF:
+    return entityRefEndsCharacterData(parser, enc, s, next);
+  default:
+    return XML_FALSE;
+  }
+}
+
 static enum XML_Error
 doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
           const char *s, const char *end, const char **nextPtr,
@@ -3322,6 +5223,22 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
   for (;;) {
     const char *next = s; /* XmlContentTok doesn't always set the last arg */
     int tok = XmlContentTok(enc, s, end, &next);
+    /* Report the text before the token is accounted or dispatched, so
+       that stopping or suspending from the handler takes effect before the
+       token; the handler sees the position where the text ends */
+    if ((parser->m_coalescedCharDataLen > 0)
+        && tokenEndsCharacterData(parser, enc, tok, s, next)) {
+      *eventEndPP = s;
+      flushCharacterData(parser);
+      switch (parser->m_parsingStatus.parsing) {
+      case XML_SUSPENDED:
+        *nextPtr = s;
+        return XML_ERROR_NONE;
+      case XML_FINISHED:
+        return XML_ERROR_ABORTED;
+      default:;
+      }
+    }
 #if XML_GE == 1
     const char *accountAfter
         = ((tok == XML_TOK_TRAILING_RSQB) || (tok == XML_TOK_TRAILING_CR))
@@ -3341,13 +5258,14 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
         return XML_ERROR_NONE;
       }
       *eventEndPP = end;
-      if (parser->m_characterDataHandler) {
+      if (reportsCharacterData(parser)) {
         XML_Char c = 0xA;
-        beforeHandler(parser);
-        parser->m_characterDataHandler(parser->m_handlerArg, &c, 1);
-        afterHandler(parser);
+        if (! reportCharacterData(parser, &c, 1))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, end);
+      if (enc == parser->m_encoding && parser->m_coalescedCharDataLen > 0)
+        flushCharacterData(parser);
       /* We are at the end of the final buffer, should we check for
          XML_SUSPENDED, XML_FINISHED?
       */
@@ -3362,6 +5280,8 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
         *nextPtr = s;
         return XML_ERROR_NONE;
       }
+      if (enc == parser->m_encoding && parser->m_coalescedCharDataLen > 0)
+        flushCharacterData(parser);
       if (startTagLevel > 0) {
         if (parser->m_tagLevel != startTagLevel)
           return XML_ERROR_ASYNC_ENTITY;
@@ -3398,10 +5318,9 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
                                 ((char *)&ch) + sizeof(XML_Char), __LINE__,
                                 XML_ACCOUNT_ENTITY_EXPANSION);
 #endif /* XML_GE == 1 */
-        if (parser->m_characterDataHandler) {
-          beforeHandler(parser);
-          parser->m_characterDataHandler(parser->m_handlerArg, &ch, 1);
-          afterHandler(parser);
+        if (reportsCharacterData(parser)) {
+          if (! reportCharacterData(parser, &ch, 1))
+            return XML_ERROR_NO_MEMORY;
         } else if (parser->m_defaultHandler)
           reportDefault(parser, enc, s, next);
         break;
@@ -3410,7 +5329,7 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
                              next - enc->minBytesPerChar);
       if (! name)
         return XML_ERROR_NO_MEMORY;
-      entity = (ENTITY *)lookup(parser, &dtd->generalEntities, name, 0);
+      entity = (ENTITY *)dtdLookup(parser, dtd, &dtd->generalEntities, name, 0);
       poolDiscard(&dtd->pool);
       /* First, determine if a check for an existing declaration is needed;
          if yes, check that the entity exists, and that it is internal,
@@ -3477,12 +5396,12 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
         tag = parser->m_freeTagList;
         parser->m_freeTagList = parser->m_freeTagList->parent;
       } else {
-        tag = MALLOC(parser, sizeof(TAG));
+        tag = documentMalloc(parser, sizeof(TAG));
         if (! tag)
           return XML_ERROR_NO_MEMORY;
-        tag->buf.raw = MALLOC(parser, INIT_TAG_BUF_SIZE);
+        tag->buf.raw = documentMalloc(parser, INIT_TAG_BUF_SIZE);
         if (! tag->buf.raw) {
-          FREE(parser, tag);
+          documentFree(parser, tag);
           return XML_ERROR_NO_MEMORY;
         }
         tag->bufEnd = tag->buf.raw + INIT_TAG_BUF_SIZE;
@@ -3513,7 +5432,9 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
             return XML_ERROR_NO_MEMORY;
           const size_t bufSize = (size_t)(tag->bufEnd - tag->buf.raw) * 2;
           {
-            char *temp = REALLOC(parser, tag->buf.raw, bufSize);
+            char *temp = documentRealloc(
+                parser, tag->buf.raw, (size_t)(tag->bufEnd - tag->buf.raw),
+                bufSize);
             if (temp == NULL)
               return XML_ERROR_NO_MEMORY;
             tag->buf.raw = temp;
@@ -3524,11 +5445,22 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
       }
       tag->name.str = tag->buf.str;
       *toPtr = XML_T('\0');
-      result
-          = storeAtts(parser, enc, s, &(tag->name), &(tag->bindings), account);
+      result = storeAtts(parser, enc, s, next, &(tag->name), &(tag->bindings),
+                         account);
       if (result)
         return result;
-      if (parser->m_startElementHandler) {
+      if (parser->m_recordEvents) {
+        if (! recordStartElement(parser, tag->name.str, tag->name.symbolId,
+                                 (const XML_Char **)parser->m_atts,
+                                 parser->m_attSymbolIds))
+          return XML_ERROR_NO_MEMORY;
+      } else if (parser->m_startElementIdHandler) {
+        beforeHandler(parser);
+        parser->m_startElementIdHandler(
+            parser->m_handlerArg, tag->name.str, tag->name.symbolId,
+            (const XML_Char **)parser->m_atts, parser->m_attSymbolIds);
+        afterHandler(parser);
+      } else if (parser->m_startElementHandler) {
         beforeHandler(parser);
         parser->m_startElementHandler(parser->m_handlerArg, tag->name.str,
                                       (const XML_Char **)parser->m_atts);
@@ -3550,25 +5482,49 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
       if (! name.str)
         return XML_ERROR_NO_MEMORY;
       poolFinish(&parser->m_tempPool);
-      result = storeAtts(parser, enc, s, &name, &bindings,
+      result = storeAtts(parser, enc, s, next, &name, &bindings,
                          XML_ACCOUNT_NONE /* token spans whole start tag */);
       if (result != XML_ERROR_NONE) {
         freeBindings(parser, bindings);
         return result;
       }
       poolFinish(&parser->m_tempPool);
-      if (parser->m_startElementHandler) {
+      if (parser->m_recordEvents) {
+        const XML_Bool recorded = recordStartElement(
+            parser, name.str, name.symbolId, (const XML_Char **)parser->m_atts,
+            parser->m_attSymbolIds);
+        *eventPP = *eventEndPP;
+        if (! recorded
+            || ! recordEvent(parser, XML_EVENT_END_ELEMENT, name.str,
+                             name.symbolId, NULL)) {
+          freeBindings(parser, bindings);
+          return XML_ERROR_NO_MEMORY;
+        }
+        noElmHandlers = XML_FALSE;
+      } else if (parser->m_startElementIdHandler) {
+        beforeHandler(parser);
+        parser->m_startElementIdHandler(
+            parser->m_handlerArg, name.str, name.symbolId,
+            (const XML_Char **)parser->m_atts, parser->m_attSymbolIds);
+        afterHandler(parser);
+        noElmHandlers = XML_FALSE;
+      } else if (parser->m_startElementHandler) {
         beforeHandler(parser);
         parser->m_startElementHandler(parser->m_handlerArg, name.str,
                                       (const XML_Char **)parser->m_atts);
         afterHandler(parser);
         noElmHandlers = XML_FALSE;
       }
-      if (parser->m_endElementHandler) {
-        if (parser->m_startElementHandler)
+      if (! parser->m_recordEvents
+          && (parser->m_endElementIdHandler || parser->m_endElementHandler)) {
+        if (! noElmHandlers)
           *eventPP = *eventEndPP;
         beforeHandler(parser);
-        parser->m_endElementHandler(parser->m_handlerArg, name.str);
+        if (parser->m_endElementIdHandler)
+          parser->m_endElementIdHandler(parser->m_handlerArg, name.str,
+                                        name.symbolId);
+        else
+          parser->m_endElementHandler(parser->m_handlerArg, name.str);
         afterHandler(parser);
         noElmHandlers = XML_FALSE;
       }
@@ -3605,7 +5561,9 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
         tag->parent = parser->m_freeTagList;
         parser->m_freeTagList = tag;
         --parser->m_tagLevel;
-        if (parser->m_endElementHandler) {
+        XML_Bool recorded = XML_TRUE;
+        if (parser->m_recordEvents || parser->m_endElementIdHandler
+            || parser->m_endElementHandler) {
           const XML_Char *localPart;
           const XML_Char *prefix;
           XML_Char *uri;
@@ -3627,9 +5585,18 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
             }
             *uri = XML_T('\0');
           }
-          beforeHandler(parser);
-          parser->m_endElementHandler(parser->m_handlerArg, tag->name.str);
-          afterHandler(parser);
+          if (parser->m_recordEvents) {
+            recorded = recordEvent(parser, XML_EVENT_END_ELEMENT,
+                                   tag->name.str, tag->name.symbolId, NULL);
+          } else {
+            beforeHandler(parser);
+            if (parser->m_endElementIdHandler)
+              parser->m_endElementIdHandler(
+                  parser->m_handlerArg, tag->name.str, tag->name.symbolId);
+            else
+              parser->m_endElementHandler(parser->m_handlerArg, tag->name.str);
+            afterHandler(parser);
+          }
         } else if (parser->m_defaultHandler)
           reportDefault(parser, enc, s, next);
         while (tag->bindings) {
@@ -3645,6 +5612,8 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
           parser->m_freeBindingList = b;
           b->prefix->binding = b->prevPrefixBinding;
         }
+        if (! recorded)
+          return XML_ERROR_NO_MEMORY;
         if ((parser->m_tagLevel == 0)
             && (parser->m_parsingStatus.parsing != XML_FINISHED)) {
           if (parser->m_parsingStatus.parsing == XML_SUSPENDED
@@ -3660,29 +5629,30 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
       int n = XmlCharRefNumber(enc, s);
       if (n < 0)
         return XML_ERROR_BAD_CHAR_REF;
-      if (parser->m_characterDataHandler) {
+      if (reportsCharacterData(parser)) {
         XML_Char buf[XML_ENCODE_MAX];
-        beforeHandler(parser);
-        parser->m_characterDataHandler(parser->m_handlerArg, buf,
-                                       XmlEncode(n, (ICHAR *)buf));
-        afterHandler(parser);
+        if (! reportCharacterData(parser, buf, XmlEncode(n, (ICHAR *)buf)))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, next);
     } break;
     case XML_TOK_XML_DECL:
       return XML_ERROR_MISPLACED_XML_PI;
     case XML_TOK_DATA_NEWLINE:
-      if (parser->m_characterDataHandler) {
+      if (reportsCharacterData(parser)) {
         XML_Char c = 0xA;
-        beforeHandler(parser);
-        parser->m_characterDataHandler(parser->m_handlerArg, &c, 1);
-        afterHandler(parser);
+        if (! reportCharacterData(parser, &c, 1))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, next);
       break;
     case XML_TOK_CDATA_SECT_OPEN: {
       enum XML_Error result;
-      if (parser->m_startCdataSectionHandler) {
+      if (parser->m_recordEvents) {
+        if (! recordEvent(parser, XML_EVENT_START_CDATA_SECTION, NULL, 0,
+                          NULL))
+          return XML_ERROR_NO_MEMORY;
+      } else if (parser->m_startCdataSectionHandler) {
         beforeHandler(parser);
         parser->m_startCdataSectionHandler(parser->m_handlerArg);
         afterHandler(parser);
@@ -3721,24 +5691,22 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
         *nextPtr = s;
         return XML_ERROR_NONE;
       }
-      if (parser->m_characterDataHandler) {
+      if (reportsCharacterData(parser)) {
         if (MUST_CONVERT(enc, s)) {
           ICHAR *dataPtr = (ICHAR *)parser->m_dataBuf;
           XmlConvert(enc, &s, end, &dataPtr, (ICHAR *)parser->m_dataBufEnd);
-          beforeHandler(parser);
-          parser->m_characterDataHandler(
-              parser->m_handlerArg, parser->m_dataBuf,
-              (int)(dataPtr - (ICHAR *)parser->m_dataBuf));
-          afterHandler(parser);
-        } else {
-          beforeHandler(parser);
-          parser->m_characterDataHandler(
-              parser->m_handlerArg, (const XML_Char *)s,
-              (int)((const XML_Char *)end - (const XML_Char *)s));
-          afterHandler(parser);
-        }
+          if (! reportCharacterData(
+                  parser, parser->m_dataBuf,
+                  (int)(dataPtr - (ICHAR *)parser->m_dataBuf)))
+            return XML_ERROR_NO_MEMORY;
+        } else if (! reportCharacterData(
+                       parser, (const XML_Char *)s,
+                       (int)((const XML_Char *)end - (const XML_Char *)s)))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, end);
+      if (enc == parser->m_encoding && parser->m_coalescedCharDataLen > 0)
+        flushCharacterData(parser);
       /* We are at the end of the final buffer, should we check for
          XML_SUSPENDED, XML_FINISHED?
       */
@@ -3753,29 +5721,26 @@ doContent(XML_Parser parser, int startTagLevel, const ENCODING *enc,
       *nextPtr = end;
       return XML_ERROR_NONE;
     case XML_TOK_DATA_CHARS: {
-      XML_CharacterDataHandler charDataHandler = parser->m_characterDataHandler;
-      if (charDataHandler) {
+      if (reportsCharacterData(parser)) {
         if (MUST_CONVERT(enc, s)) {
           for (;;) {
             ICHAR *dataPtr = (ICHAR *)parser->m_dataBuf;
             const enum XML_Convert_Result convert_res = XmlConvert(
                 enc, &s, next, &dataPtr, (ICHAR *)parser->m_dataBufEnd);
             *eventEndPP = s;
-            beforeHandler(parser);
-            charDataHandler(parser->m_handlerArg, parser->m_dataBuf,
-                            (int)(dataPtr - (ICHAR *)parser->m_dataBuf));
-            afterHandler(parser);
+            if (! reportCharacterData(
+                    parser, parser->m_dataBuf,
+                    (int)(dataPtr - (ICHAR *)parser->m_dataBuf)))
+              return XML_ERROR_NO_MEMORY;
             if ((convert_res == XML_CONVERT_COMPLETED)
                 || (convert_res == XML_CONVERT_INPUT_INCOMPLETE))
               break;
             *eventPP = s;
           }
-        } else {
-          beforeHandler(parser);
-          charDataHandler(parser->m_handlerArg, (const XML_Char *)s,
-                          (int)((const XML_Char *)next - (const XML_Char *)s));
-          afterHandler(parser);
-        }
+        } else if (! reportCharacterData(
+                       parser, (const XML_Char *)s,
+                       (int)((const XML_Char *)next - (const XML_Char *)s)))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, next);
     } break;
@@ -3858,7 +5823,7 @@ freeBindings(XML_Parser parser, BINDING *bindings) {
 */
 static enum XML_Error
 storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
-          TAG_NAME *tagNamePtr, BINDING **bindingsPtr,
+          const char *attStrEnd, TAG_NAME *tagNamePtr, BINDING **bindingsPtr,
           enum XML_Account account) {
   DTD *const dtd = parser->m_dtd; /* save one level of indirection */
   int attIndex = 0;
@@ -3868,21 +5833,47 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
   const XML_Char *localPart;
 
   /* lookup the element type name */
-  ELEMENT_TYPE *elementType
-      = (ELEMENT_TYPE *)lookup(parser, &dtd->elementTypes, tagNamePtr->str, 0);
+  const char *const rawName = attStr + enc->minBytesPerChar;
+  const size_t rawNameLength = (size_t)XmlNameLength(enc, rawName);
+  ELEMENT_TYPE *elementType = (ELEMENT_TYPE *)nameCacheGet(
+      parser->m_elementTypeCache, enc, rawName, rawNameLength);
+  int vocabIndex = -1;
   if (! elementType) {
-    const XML_Char *name = poolCopyString(&dtd->pool, tagNamePtr->str);
-    if (! name)
-      return XML_ERROR_NO_MEMORY;
-    elementType = (ELEMENT_TYPE *)lookup(parser, &dtd->elementTypes, name,
-                                         sizeof(ELEMENT_TYPE));
-    if (! elementType)
-      return XML_ERROR_NO_MEMORY;
-    if (! elementType->defaultAttForName.parser)
-      hashTableInit(&(elementType->defaultAttForName), parser);
-    if (parser->m_ns && ! setElementTypePrefix(parser, elementType))
+    vocabIndex = vocabularyFindRaw(parser, enc, rawName, rawNameLength);
+    if (vocabIndex >= 0)
+      elementType = parser->m_vocabElementTypes[vocabIndex];
+  }
+  if (! elementType) {
+    elementType = (ELEMENT_TYPE *)dtdLookup(parser, dtd, &dtd->elementTypes,
+                                            tagNamePtr->str, 0);
+    if (! elementType) {
+      const XML_Char *name = poolCopyString(&dtd->pool, tagNamePtr->str);
+      if (! name)
+        return XML_ERROR_NO_MEMORY;
+      elementType = (ELEMENT_TYPE *)lookup(parser, &dtd->elementTypes, name,
+                                           sizeof(ELEMENT_TYPE));
+      if (! elementType)
+        return XML_ERROR_NO_MEMORY;
+      if (! elementType->defaultAttForName.arena)
+        hashTableInit(&(elementType->defaultAttForName), &dtd->arena);
+      if (parser->m_ns && ! setElementTypePrefix(parser, elementType))
+        return XML_ERROR_NO_MEMORY;
+    }
+    nameCachePut(parser->m_elementTypeCache, enc, rawName, rawNameLength,
+                 (NAMED *)elementType);
+    if (vocabIndex >= 0) {
+      elementType->symbolId = vocabIndex + 1;
+      parser->m_vocabElementTypes[vocabIndex] = elementType;
+    }
+  }
+  if ((parser->m_startElementIdHandler || parser->m_endElementIdHandler
+       || parser->m_recordEvents)
+      && ! elementType->symbolId) {
+    elementType->symbolId = getSymbolId(parser, elementType->name);
+    if (! elementType->symbolId)
       return XML_ERROR_NO_MEMORY;
   }
+  tagNamePtr->symbolId = elementType->symbolId;
   const size_t nDefaultAtts = elementType->nDefaultAtts;
 
   /* Detect and prevent integer overflow. */
@@ -3890,8 +5881,8 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
     return XML_ERROR_NO_MEMORY;
 
   /* get the attributes from the tokenizer */
-  size_t n = (size_t)XmlGetAttributes(enc, attStr, (int)parser->m_attsSize,
-                                      parser->m_atts);
+  size_t n = (size_t)XmlGetAttributes(enc, attStr, attStrEnd,
+                                      (int)parser->m_attsSize, parser->m_atts);
 
   /* Detect and prevent integer overflow */
   if (n > SIZE_MAX - nDefaultAtts) {
@@ -3941,8 +5932,25 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
       /* Detect and prevent integer overflow. */
       if (n > (size_t)INT_MAX)
         return XML_ERROR_NO_MEMORY;
-      XmlGetAttributes(enc, attStr, (int)n, parser->m_atts);
+      XmlGetAttributes(enc, attStr, attStrEnd, (int)n, parser->m_atts);
+    }
+  }
+
+  /* symbol IDs of the attribute names, one per name/value pair */
+  int *attSymbolIds = NULL;
+  if (parser->m_startElementIdHandler || parser->m_recordEvents) {
+    if (parser->m_attSymbolIdsSize < parser->m_attsSize) {
+      /* Detect and prevent integer overflow */
+      if (parser->m_attsSize > SIZE_MAX / sizeof(int))
+        return XML_ERROR_NO_MEMORY;
+      int *const temp = REALLOC(parser, parser->m_attSymbolIds,
+                                parser->m_attsSize * sizeof(int));
+      if (temp == NULL)
+        return XML_ERROR_NO_MEMORY;
+      parser->m_attSymbolIds = temp;
+      parser->m_attSymbolIdsSize = parser->m_attsSize;
     }
+    attSymbolIds = parser->m_attSymbolIds;
   }
 
   /* the attribute list for the application */
@@ -3986,15 +5994,19 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
       return XML_ERROR_DUPLICATE_ATTRIBUTE;
     }
     (attId->name)[-1] = 1;
+    if (attSymbolIds) {
+      attSymbolIds[attIndex / 2] = getAttributeSymbolId(parser, attId);
+      if (! attSymbolIds[attIndex / 2])
+        return XML_ERROR_NO_MEMORY;
+    }
     appAtts[attIndex++] = attId->name;
     if (! parser->m_atts[i].normalized) {
       XML_Bool isCdata = XML_TRUE;
 
       /* figure out whether declared as other than CDATA */
       if (attId->maybeTokenized) {
-        NAME_AND_DEFAULT_ATTRIBUTE *const nameAndDefaultAttribute
-            = (NAME_AND_DEFAULT_ATTRIBUTE *)lookup(
-                parser, &(elementType->defaultAttForName), attId->name, 0);
+        const NAME_AND_DEFAULT_ATTRIBUTE *const nameAndDefaultAttribute
+            = findDefaultAttribute(parser, elementType, attId);
         if (nameAndDefaultAttribute != NULL) {
           assert(nameAndDefaultAttribute->attIndex < elementType->nDefaultAtts);
           const DEFAULT_ATTRIBUTE *const att
@@ -4063,11 +6075,23 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
         } else {
           (da->id->name)[-1] = 2;
           nPrefixes++;
+          if (attSymbolIds) {
+            attSymbolIds[attIndex / 2]
+                = getAttributeSymbolId(parser, (ATTRIBUTE_ID *)da->id);
+            if (! attSymbolIds[attIndex / 2])
+              return XML_ERROR_NO_MEMORY;
+          }
           appAtts[attIndex++] = da->id->name;
           appAtts[attIndex++] = da->value;
         }
       } else {
         (da->id->name)[-1] = 1;
+        if (attSymbolIds) {
+          attSymbolIds[attIndex / 2]
+              = getAttributeSymbolId(parser, (ATTRIBUTE_ID *)da->id);
+          if (! attSymbolIds[attIndex / 2])
+            return XML_ERROR_NO_MEMORY;
+        }
         appAtts[attIndex++] = da->id->name;
         appAtts[attIndex++] = da->value;
       }
@@ -4129,8 +6153,9 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
       parser->m_nsAtts = temp;
       version = 0; /* force re-initialization of m_nsAtts hash table */
     }
-    /* using a version flag saves us from initializing m_nsAtts every time */
-    if (! version) { /* initialize version flags when version wraps around */
+    /* using a version flag saves us from initializing m_nsAtts every time;
+       versions are kept above zero for nsAttsUseSipHash */
+    if (version <= 1) { /* initialize version flags when version runs out */
       version = INIT_ATTS_VERSION;
       for (j = nsAttsSize; j != 0;)
         parser->m_nsAtts[--j].version = version;
@@ -4141,12 +6166,6 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
     for (; i < attIndex; i += 2) {
       const XML_Char *s = appAtts[i];
       if (s[-1] == 2) { /* prefixed */
-        struct siphash sip_state;
-        struct sipkey sip_key;
-
-        copy_salt_to_sipkey(parser, &sip_key);
-        sip24_init(&sip_state, &sip_key);
-
         ((XML_Char *)s)[-1] = 0; /* clear flag */
         ATTRIBUTE_ID *const id
             = (ATTRIBUTE_ID *)lookup(parser, &dtd->attributeIds, s, 0);
@@ -4174,25 +6193,26 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
         if (! poolAppendChars(&parser->m_tempPool, b->uri, b->uriLen))
           return XML_ERROR_NO_MEMORY;
 
-        sip24_update(&sip_state, b->uri, b->uriLen * sizeof(XML_Char));
-
         while (*s++ != XML_T(ASCII_COLON))
           ;
 
-        sip24_update(&sip_state, s, keylen(s) * sizeof(XML_Char));
-
         {
           const size_t len = xcslen(s) + /*null terminator*/ 1;
           if (! poolAppendChars(&parser->m_tempPool, s, len))
             return XML_ERROR_NO_MEMORY;
         }
 
-        const unsigned long uriHash = (unsigned long)sip24_final(&sip_state);
+        const size_t hashedLen
+            = (size_t)poolLength(&parser->m_tempPool) - 1;
+        unsigned long uriHash
+            = hash(parser, parser->m_nsAttsSipHash,
+                   poolStart(&parser->m_tempPool), hashedLen);
 
         { /* Check hash table for duplicate of expanded name (uriName).
              Derived from code in lookup(parser, HASH_TABLE *table, ...).
           */
           unsigned char step = 0;
+          unsigned int probes = 0;
           unsigned long mask = nsAttsSize - 1;
           j = uriHash & mask; /* index into hash table */
           while (parser->m_nsAtts[j].version == version) {
@@ -4206,6 +6226,16 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
               if (*s1 == 0)
                 return XML_ERROR_DUPLICATE_ATTRIBUTE;
             }
+            /* Probing this long is a sign of names picked to collide */
+            if ((++probes > NS_ATTS_MAX_PROBES) && ! parser->m_nsAttsSipHash) {
+              nsAttsUseSipHash(parser, nsAttsSize);
+              version = parser->m_nsAttsVersion;
+              uriHash = hash(parser, XML_TRUE, poolStart(&parser->m_tempPool),
+                             hashedLen);
+              step = 0;
+              j = uriHash & mask;
+              continue;
+            }
             if (! step)
               step = PROBE_STEP(uriHash, mask, parser->m_nsAttsPower);
             j < step ? (j += nsAttsSize - step) : (j -= step);
@@ -4229,6 +6259,7 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
         parser->m_nsAtts[j].version = version;
         parser->m_nsAtts[j].hash = uriHash;
         parser->m_nsAtts[j].uriName = s;
+        parser->m_nsAtts[j].hashedLen = hashedLen;
 
         if (! --nPrefixes) {
           i += 2;
@@ -4284,7 +6315,7 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
       return XML_ERROR_NO_MEMORY;
     }
 
-    uri = MALLOC(parser, (totalLen + EXPAND_SPARE) * sizeof(XML_Char));
+    uri = documentMalloc(parser, (totalLen + EXPAND_SPARE) * sizeof(XML_Char));
     if (! uri)
       return XML_ERROR_NO_MEMORY;
     binding->uriAlloc = totalLen + EXPAND_SPARE;
@@ -4292,7 +6323,7 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
     for (TAG *p = parser->m_tagStack; p; p = p->parent)
       if (p->name.str == binding->uri)
         p->name.str = uri;
-    FREE(parser, binding->uri);
+    documentFree(parser, binding->uri);
     binding->uri = uri;
   }
   /* if m_namespaceSeparator != '\0' then uri includes it already */
@@ -4312,6 +6343,44 @@ storeAtts(XML_Parser parser, const ENCODING *enc, const char *attStr,
   return XML_ERROR_NONE;
 }
 
+/* Moves the prefixed attributes of the current start tag to where SipHash
+   puts them in m_nsAtts, for when fastHash collides too much.  They get a
+   new version, so that the ones still to be moved can be told apart. */
+static void
+nsAttsUseSipHash(XML_Parser parser, unsigned int nsAttsSize) {
+  NS_ATT *const nsAtts = parser->m_nsAtts;
+  const unsigned long oldVersion = parser->m_nsAttsVersion;
+  const unsigned long version = oldVersion - 1; /* see storeAtts */
+  const unsigned long mask = nsAttsSize - 1;
+
+  parser->m_nsAttsSipHash = XML_TRUE;
+  parser->m_nsAttsVersion = version;
+  for (unsigned int i = 0; i < nsAttsSize; i++) {
+    if (nsAtts[i].version != oldVersion)
+      continue;
+    NS_ATT entry = nsAtts[i];
+    nsAtts[i].version = oldVersion + 1; /* free, like any stale version */
+    for (;;) {
+      unsigned char step = 0;
+      unsigned long j;
+      entry.version = version;
+      entry.hash = hash(parser, XML_TRUE, entry.uriName, entry.hashedLen);
+      j = entry.hash & mask;
+      while (nsAtts[j].version == version) {
+        if (! step)
+          step = PROBE_STEP(entry.hash, mask, parser->m_nsAttsPower);
+        j < step ? (j += nsAttsSize - step) : (j -= step);
+      }
+      /* An entry yet to be moved makes room, and is moved next */
+      const NS_ATT displaced = nsAtts[j];
+      nsAtts[j] = entry;
+      if (displaced.version != oldVersion)
+        break;
+      entry = displaced;
+    }
+  }
+}
+
 static XML_Bool
 is_rfc3986_uri_char(XML_Char candidate) {
   // For the RFC 3986 ANBF grammar see
@@ -4534,7 +6603,8 @@ addBinding(XML_Parser parser, PREFIX *prefix, const ATTRIBUTE_ID *attId,
       }
 
       XML_Char *temp
-          = REALLOC(parser, b->uri, sizeof(XML_Char) * (len + EXPAND_SPARE));
+          = documentRealloc(parser, b->uri, sizeof(XML_Char) * b->uriAlloc,
+                            sizeof(XML_Char) * (len + EXPAND_SPARE));
       if (temp == NULL)
         return XML_ERROR_NO_MEMORY;
       b->uri = temp;
@@ -4542,7 +6612,7 @@ addBinding(XML_Parser parser, PREFIX *prefix, const ATTRIBUTE_ID *attId,
     }
     parser->m_freeBindingList = b->nextTagBinding;
   } else {
-    b = MALLOC(parser, sizeof(BINDING));
+    b = documentMalloc(parser, sizeof(BINDING));
     if (! b)
       return XML_ERROR_NO_MEMORY;
 
@@ -4552,9 +6622,9 @@ addBinding(XML_Parser parser, PREFIX *prefix, const ATTRIBUTE_ID *attId,
       return XML_ERROR_NO_MEMORY;
     }
 
-    b->uri = MALLOC(parser, sizeof(XML_Char) * (len + EXPAND_SPARE));
+    b->uri = documentMalloc(parser, sizeof(XML_Char) * (len + EXPAND_SPARE));
     if (! b->uri) {
-      FREE(parser, b);
+      documentFree(parser, b);
       return XML_ERROR_NO_MEMORY;
     }
     b->uriAlloc = len + EXPAND_SPARE;
@@ -4595,7 +6665,8 @@ cdataSectionProcessor(XML_Parser parser, const char *start, const char *end,
   if (result != XML_ERROR_NONE)
     return result;
   if (start) {
-    if (parser->m_parentParser) { /* we are parsing an external entity */
+    /* are we parsing an external entity? */
+    if (parser->m_parentParser || parser->m_isFragment) {
       parser->m_processor = externalEntityContentProcessor;
       return externalEntityContentProcessor(parser, start, end, endPtr);
     } else {
@@ -4630,6 +6701,21 @@ doCdataSection(XML_Parser parser, const ENCODING *enc, const char **startPtr,
   for (;;) {
     const char *next = s; /* in case of XML_TOK_NONE or XML_TOK_PARTIAL */
     int tok = XmlCdataSectionTok(enc, s, end, &next);
+    if ((tok == XML_TOK_CDATA_SECT_CLOSE)
+        && (parser->m_coalescedCharDataLen > 0) && ! parser->m_recordEvents
+        && (parser->m_endCdataSectionHandler || parser->m_defaultHandler)) {
+      /* As in doContent, report the text before the markup ending it */
+      *eventEndPP = s;
+      flushCharacterData(parser);
+      switch (parser->m_parsingStatus.parsing) {
+      case XML_SUSPENDED:
+        *nextPtr = s;
+        return XML_ERROR_NONE;
+      case XML_FINISHED:
+        return XML_ERROR_ABORTED;
+      default:;
+      }
+    }
 #if XML_GE == 1
     if (! accountingDiffTolerated(parser, tok, s, next, __LINE__, account)) {
       accountingOnAbort(parser);
@@ -4641,7 +6727,11 @@ doCdataSection(XML_Parser parser, const ENCODING *enc, const char **startPtr,
     *eventEndPP = next;
     switch (tok) {
     case XML_TOK_CDATA_SECT_CLOSE:
-      if (parser->m_endCdataSectionHandler) {
+      if (parser->m_recordEvents) {
+        if (! recordEvent(parser, XML_EVENT_END_CDATA_SECTION, NULL, 0,
+                          NULL))
+          return XML_ERROR_NO_MEMORY;
+      } else if (parser->m_endCdataSectionHandler) {
         beforeHandler(parser);
         parser->m_endCdataSectionHandler(parser->m_handlerArg);
         afterHandler(parser);
@@ -4663,38 +6753,34 @@ doCdataSection(XML_Parser parser, const ENCODING *enc, const char **startPtr,
       else
         return XML_ERROR_NONE;
     case XML_TOK_DATA_NEWLINE:
-      if (parser->m_characterDataHandler) {
+      if (reportsCharacterData(parser)) {
         XML_Char c = 0xA;
-        beforeHandler(parser);
-        parser->m_characterDataHandler(parser->m_handlerArg, &c, 1);
-        afterHandler(parser);
+        if (! reportCharacterData(parser, &c, 1))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, next);
       break;
     case XML_TOK_DATA_CHARS: {
-      XML_CharacterDataHandler charDataHandler = parser->m_characterDataHandler;
-      if (charDataHandler) {
+      if (reportsCharacterData(parser)) {
         if (MUST_CONVERT(enc, s)) {
           for (;;) {
             ICHAR *dataPtr = (ICHAR *)parser->m_dataBuf;
             const enum XML_Convert_Result convert_res = XmlConvert(
                 enc, &s, next, &dataPtr, (ICHAR *)parser->m_dataBufEnd);
             *eventEndPP = next;
-            beforeHandler(parser);
-            charDataHandler(parser->m_handlerArg, parser->m_dataBuf,
-                            (int)(dataPtr - (ICHAR *)parser->m_dataBuf));
-            afterHandler(parser);
+            if (! reportCharacterData(
+                    parser, parser->m_dataBuf,
+                    (int)(dataPtr - (ICHAR *)parser->m_dataBuf)))
+              return XML_ERROR_NO_MEMORY;
             if ((convert_res == XML_CONVERT_COMPLETED)
                 || (convert_res == XML_CONVERT_INPUT_INCOMPLETE))
               break;
             *eventPP = s;
           }
-        } else {
-          beforeHandler(parser);
-          charDataHandler(parser->m_handlerArg, (const XML_Char *)s,
-                          (int)((const XML_Char *)next - (const XML_Char *)s));
-          afterHandler(parser);
-        }
+        } else if (! reportCharacterData(
+                       parser, (const XML_Char *)s,
+                       (int)((const XML_Char *)next - (const XML_Char *)s)))
+          return XML_ERROR_NO_MEMORY;
       } else if (parser->m_defaultHandler)
         reportDefault(parser, enc, s, next);
     } break;
@@ -5478,13 +7564,9 @@ doProlog(XML_Parser parser, const ENCODING *enc, const char *s, const char *end,
           if (parser->m_useForeignDTD)
             entity->base = parser->m_curBase;
           dtd->paramEntityRead = XML_FALSE;
-          beforeHandler(parser);
-          const int status = parser->m_externalEntityRefHandler(
-              parser->m_externalEntityRefHandlerArg, 0, entity->base,
-              entity->systemId, entity->publicId);
-          afterHandler(parser);
-          if (! status)
-            return XML_ERROR_EXTERNAL_ENTITY_HANDLING;
+          const enum XML_Error result = readExternalSubset(parser, entity);
+          if (result != XML_ERROR_NONE)
+            return result;
           if (dtd->paramEntityRead) {
             if (! dtd->standalone && parser->m_notStandaloneHandler) {
               beforeHandler(parser);
@@ -5528,13 +7610,9 @@ doProlog(XML_Parser parser, const ENCODING *enc, const char *s, const char *end,
             return XML_ERROR_NO_MEMORY;
           entity->base = parser->m_curBase;
           dtd->paramEntityRead = XML_FALSE;
-          beforeHandler(parser);
-          const int status = parser->m_externalEntityRefHandler(
-              parser->m_externalEntityRefHandlerArg, 0, entity->base,
-              entity->systemId, entity->publicId);
-          afterHandler(parser);
-          if (! status)
-            return XML_ERROR_EXTERNAL_ENTITY_HANDLING;
+          const enum XML_Error result = readExternalSubset(parser, entity);
+          if (result != XML_ERROR_NONE)
+            return result;
           if (dtd->paramEntityRead) {
             if (! dtd->standalone && parser->m_notStandaloneHandler) {
               beforeHandler(parser);
@@ -5860,8 +7938,8 @@ doProlog(XML_Parser parser, const ENCODING *enc, const char *s, const char *end,
         const XML_Char *name = poolStoreString(&dtd->pool, enc, s, next);
         if (! name)
           return XML_ERROR_NO_MEMORY;
-        parser->m_declEntity = (ENTITY *)lookup(parser, &dtd->generalEntities,
-                                                name, sizeof(ENTITY));
+        parser->m_declEntity
+            = dtdDeclareEntity(parser, dtd, &dtd->generalEntities, name);
         if (! parser->m_declEntity)
           return XML_ERROR_NO_MEMORY;
         if (parser->m_declEntity->name != name) {
@@ -5890,8 +7968,8 @@ doProlog(XML_Parser parser, const ENCODING *enc, const char *s, const char *end,
         const XML_Char *name = poolStoreString(&dtd->pool, enc, s, next);
         if (! name)
           return XML_ERROR_NO_MEMORY;
-        parser->m_declEntity = (ENTITY *)lookup(parser, &dtd->paramEntities,
-                                                name, sizeof(ENTITY));
+        parser->m_declEntity
+            = dtdDeclareEntity(parser, dtd, &dtd->paramEntities, name);
         if (! parser->m_declEntity)
           return XML_ERROR_NO_MEMORY;
         if (parser->m_declEntity->name != name) {
@@ -6085,7 +8163,7 @@ doProlog(XML_Parser parser, const ENCODING *enc, const char *s, const char *end,
                                next - enc->minBytesPerChar);
         if (! name)
           return XML_ERROR_NO_MEMORY;
-        entity = (ENTITY *)lookup(parser, &dtd->paramEntities, name, 0);
+        entity = (ENTITY *)dtdLookup(parser, dtd, &dtd->paramEntities, name, 0);
         poolDiscard(&dtd->pool);
         /* first, determine if a check for an existing declaration is needed;
            if yes, check that the entity exists, and that it is internal,
@@ -6478,7 +8556,7 @@ processEntity(XML_Parser parser, ENTITY *entity, XML_Bool betweenDecl,
     openEntity = *freeEntityList;
     *freeEntityList = openEntity->next;
   } else {
-    openEntity = MALLOC(parser, sizeof(OPEN_INTERNAL_ENTITY));
+    openEntity = documentMalloc(parser, sizeof(OPEN_INTERNAL_ENTITY));
     if (! openEntity)
       return XML_ERROR_NO_MEMORY;
   }
@@ -6770,7 +8848,7 @@ appendAttributeValue(XML_Parser parser, const ENCODING *enc, XML_Bool isCdata,
                              next - enc->minBytesPerChar);
       if (! name)
         return XML_ERROR_NO_MEMORY;
-      entity = (ENTITY *)lookup(parser, &dtd->generalEntities, name, 0);
+      entity = (ENTITY *)dtdLookup(parser, dtd, &dtd->generalEntities, name, 0);
       poolDiscard(&parser->m_temp2Pool);
       /* First, determine if a check for an existing declaration is needed;
          if yes, check that the entity exists, and that it is internal.
@@ -6923,7 +9001,7 @@ storeEntityValue(XML_Parser parser, const ENCODING *enc,
           result = XML_ERROR_NO_MEMORY;
           goto endEntityValue;
         }
-        entity = (ENTITY *)lookup(parser, &dtd->paramEntities, name, 0);
+        entity = (ENTITY *)dtdLookup(parser, dtd, &dtd->paramEntities, name, 0);
         poolDiscard(&parser->m_tempPool);
         if (! entity) {
           /* not a well-formedness error - see XML 1.0: WFC Entity Declared */
@@ -7187,7 +9265,8 @@ reportProcessingInstruction(XML_Parser parser, const ENCODING *enc,
   const XML_Char *target;
   XML_Char *data;
   const char *tem;
-  if (! parser->m_processingInstructionHandler) {
+  if (! parser->m_processingInstructionHandler
+      && ! parser->m_recordEvents) {
     if (parser->m_defaultHandler)
       reportDefault(parser, enc, start, end);
     return 1;
@@ -7203,6 +9282,12 @@ reportProcessingInstruction(XML_Parser parser, const ENCODING *enc,
   if (! data)
     return 0;
   normalizeLines(data);
+  if (parser->m_recordEvents) {
+    const XML_Bool recorded = recordEvent(
+        parser, XML_EVENT_PROCESSING_INSTRUCTION, target, 0, data);
+    poolClear(&parser->m_tempPool);
+    return recorded;
+  }
   beforeHandler(parser);
   parser->m_processingInstructionHandler(parser->m_handlerArg, target, data);
   afterHandler(parser);
@@ -7214,7 +9299,7 @@ static int
 reportComment(XML_Parser parser, const ENCODING *enc, const char *start,
               const char *end) {
   XML_Char *data;
-  if (! parser->m_commentHandler) {
+  if (! parser->m_commentHandler && ! parser->m_recordEvents) {
     if (parser->m_defaultHandler)
       reportDefault(parser, enc, start, end);
     return 1;
@@ -7225,6 +9310,12 @@ reportComment(XML_Parser parser, const ENCODING *enc, const char *start,
   if (! data)
     return 0;
   normalizeLines(data);
+  if (parser->m_recordEvents) {
+    const XML_Bool recorded
+        = recordEvent(parser, XML_EVENT_COMMENT, NULL, 0, data);
+    poolClear(&parser->m_tempPool);
+    return recorded;
+  }
   beforeHandler(parser);
   parser->m_commentHandler(parser->m_handlerArg, data);
   afterHandler(parser);
@@ -7288,6 +9379,8 @@ static int
 defineAttribute(ELEMENT_TYPE *type, ATTRIBUTE_ID *attId, XML_Bool isCdata,
                 XML_Bool isId, const XML_Char *value, XML_Parser parser) {
   DEFAULT_ATTRIBUTE *att;
+  if (type->baseDefaultAttForName && ! dtdIndexDefaultAtts(parser, type))
+    return 0;
   if (value || isId) {
     /* The handling of default attributes gets messed up if we have
        a default which duplicates a non-default. */
@@ -7314,10 +9407,14 @@ defineAttribute(ELEMENT_TYPE *type, ATTRIBUTE_ID *attId, XML_Bool isCdata,
       return 0;
     }
 
-    DEFAULT_ATTRIBUTE *const temp = REALLOC(
-        parser, type->defaultAtts, (count * sizeof(DEFAULT_ATTRIBUTE)));
+    /* The old array stays in the arena until the DTD goes */
+    DEFAULT_ATTRIBUTE *const temp
+        = arenaAlloc(&parser->m_dtd->arena, count * sizeof(DEFAULT_ATTRIBUTE));
     if (temp == NULL)
       return 0;
+    if (type->nDefaultAtts > 0)
+      memcpy(temp, type->defaultAtts,
+             type->nDefaultAtts * sizeof(DEFAULT_ATTRIBUTE));
     type->allocDefaultAtts = count;
     type->defaultAtts = temp;
   }
@@ -7379,12 +9476,81 @@ setElementTypePrefix(XML_Parser parser, ELEMENT_TYPE *elementType) {
   return 1;
 }
 
+static NAMED **
+nameCacheSlot(NAMED **cache, const char *raw, size_t length) {
+  /* Mix the length with the first and the last (up to) eight bytes; the
+     index only needs to be cheap, the names are compared in full after.
+     Each name may be in either of two neighbouring slots. */
+  unsigned long long head = 0;
+  unsigned long long tail = 0;
+  const size_t n = (length < sizeof(head)) ? length : sizeof(head);
+  memcpy(&head, raw, n);
+  memcpy(&tail, raw + length - n, n);
+  unsigned long long h = (head ^ (tail * 0x9E3779B97F4A7C15ULL)) + length;
+  h ^= h >> 29;
+  h *= 0x9E3779B97F4A7C15ULL;
+  return cache + ((size_t)(h >> (64 - NAME_CACHE_POWER)) & ~(size_t)1);
+}
+
+static NAMED *
+nameCacheGet(NAMED **cache, const ENCODING *enc, const char *raw,
+             size_t length) {
+  if ((length == 0) || MUST_CONVERT(enc, raw))
+    return NULL;
+  const XML_Char *const s = (const XML_Char *)raw;
+  const size_t len = length / sizeof(XML_Char);
+  NAMED **const slot = nameCacheSlot(cache, raw, length);
+  for (int i = 0; i < 2; i++) {
+    NAMED *const named = slot[i];
+    if (named == NULL)
+      continue;
+    /* Raw names contain no NUL, so this stops at the end of a shorter key */
+    size_t j = 0;
+    while ((j < len) && (named->name[j] == s[j]))
+      j++;
+    if ((j == len) && (named->name[len] == XML_T('\0')))
+      return named;
+  }
+  return NULL;
+}
+
+static void
+nameCachePut(NAMED **cache, const ENCODING *enc, const char *raw,
+             size_t length, NAMED *named) {
+  if ((length == 0) || MUST_CONVERT(enc, raw))
+    return;
+  NAMED **const slot = nameCacheSlot(cache, raw, length);
+  slot[1] = slot[0];
+  slot[0] = named;
+}
+
+/* Returns the vocabulary index of a name as it appears in the input, or -1
+   if the parser has no vocabulary, the name is not in it or needs
+   conversion, see the name caches */
+static int
+vocabularyFindRaw(XML_Parser parser, const ENCODING *enc, const char *raw,
+                  size_t length) {
+  if ((parser->m_vocabulary == NULL) || (length == 0)
+      || MUST_CONVERT(enc, raw))
+    return -1;
+  return vocabularyFind(parser->m_vocabulary, (const XML_Char *)raw,
+                        length / sizeof(XML_Char));
+}
+
 static ATTRIBUTE_ID *
 getAttributeId(XML_Parser parser, const ENCODING *enc, const char *start,
                const char *end) {
   DTD *const dtd = parser->m_dtd; /* save one level of indirection */
   ATTRIBUTE_ID *id;
   const XML_Char *name;
+  id = (ATTRIBUTE_ID *)nameCacheGet(parser->m_attributeIdCache, enc, start,
+                                    (size_t)(end - start));
+  if (id)
+    return id;
+  const int vocabIndex
+      = vocabularyFindRaw(parser, enc, start, (size_t)(end - start));
+  if ((vocabIndex >= 0) && parser->m_vocabAttributeIds[vocabIndex])
+    return parser->m_vocabAttributeIds[vocabIndex];
   if (! poolAppendChar(&dtd->pool, XML_T('\0')))
     return NULL;
   name = poolStoreString(&dtd->pool, enc, start, end);
@@ -7392,8 +9558,8 @@ getAttributeId(XML_Parser parser, const ENCODING *enc, const char *start,
     return NULL;
   /* skip quotation mark - its storage will be reused (like in name[-1]) */
   ++name;
-  id = (ATTRIBUTE_ID *)lookup(parser, &dtd->attributeIds, name,
-                              sizeof(ATTRIBUTE_ID));
+  id = (ATTRIBUTE_ID *)dtdLookup(parser, dtd, &dtd->attributeIds, name,
+                                 sizeof(ATTRIBUTE_ID));
   if (! id)
     return NULL;
   if (id->name != name)
@@ -7438,7 +9604,86 @@ getAttributeId(XML_Parser parser, const ENCODING *enc, const char *start,
       }
     }
   }
-  return id;
+  nameCachePut(parser->m_attributeIdCache, enc, start, (size_t)(end - start),
+               (NAMED *)id);
+  if (vocabIndex >= 0) {
+    id->symbolId = vocabIndex + 1;
+    parser->m_vocabAttributeIds[vocabIndex] = id;
+  }
+  return id;
+}
+
+/* Returns the symbol ID of name, handing out the next one if name has
+   none yet, or 0 if we are out of memory */
+static int
+getSymbolId(XML_Parser parser, const XML_Char *name) {
+  const XML_Parser rootParser = getRootParserOf(parser, NULL);
+  if (rootParser->m_vocabulary != NULL) {
+    const int index
+        = vocabularyFind(rootParser->m_vocabulary, name, keylen(name));
+    if (index >= 0)
+      return index + 1;
+  }
+  /* The table is looked up with the salt that parsing is going to use */
+  setHashSecretSalt(rootParser);
+  SYMBOL *symbol
+      = (SYMBOL *)lookup(parser, &rootParser->m_symbols, name, 0);
+  if (symbol)
+    return symbol->id;
+  if (rootParser->m_symbolCount == INT_MAX)
+    return 0;
+
+  /* The name is copied, since it may belong to an external entity parser
+     that is gone before the root parser */
+  const size_t nameBytes = (keylen(name) + 1) * sizeof(XML_Char);
+  XML_Char *const copy = arenaAlloc(&rootParser->m_symbolArena, nameBytes);
+  if (! copy)
+    return 0;
+  memcpy(copy, name, nameBytes);
+  symbol = (SYMBOL *)lookup(parser, &rootParser->m_symbols, copy,
+                            sizeof(SYMBOL));
+  if (! symbol)
+    return 0;
+  symbol->id = ++rootParser->m_symbolCount;
+  return symbol->id;
+}
+
+/* Gives parser, a detached fragment parser, the symbol IDs handed out by
+   fromParser so far, so that names keep their IDs.  The IDs that parser
+   hands out later are its own and may collide with later ones of
+   fromParser.  Returns XML_FALSE if we are out of memory. */
+static XML_Bool
+copySymbols(XML_Parser parser, XML_Parser fromParser) {
+  /* The table is filled with the salt that parsing is going to use */
+  setHashSecretSalt(parser);
+  HASH_TABLE_ITER iter;
+  hashTableIterInit(&iter, &fromParser->m_symbols);
+  for (;;) {
+    const SYMBOL *const oldSymbol = (SYMBOL *)hashTableIterNext(&iter);
+    if (! oldSymbol)
+      break;
+    const size_t nameBytes = (keylen(oldSymbol->name) + 1) * sizeof(XML_Char);
+    XML_Char *const name = arenaAlloc(&parser->m_symbolArena, nameBytes);
+    if (! name)
+      return XML_FALSE;
+    memcpy(name, oldSymbol->name, nameBytes);
+    SYMBOL *const newSymbol
+        = (SYMBOL *)lookup(parser, &parser->m_symbols, name, sizeof(SYMBOL));
+    if (! newSymbol)
+      return XML_FALSE;
+    newSymbol->id = oldSymbol->id;
+  }
+  parser->m_symbolCount = fromParser->m_symbolCount;
+  return XML_TRUE;
+}
+
+/* Returns the symbol ID of the name of attId, or 0 if we are out of
+   memory */
+static int
+getAttributeSymbolId(XML_Parser parser, ATTRIBUTE_ID *attId) {
+  if (! attId->symbolId)
+    attId->symbolId = getSymbolId(parser, attId->name);
+  return attId->symbolId;
 }
 
 #define CONTEXT_SEP XML_T(ASCII_FF)
@@ -7543,8 +9788,8 @@ setContext(XML_Parser parser, const XML_Char *context) {
       ENTITY *e;
       if (! poolAppendChar(&parser->m_tempPool, XML_T('\0')))
         return XML_FALSE;
-      e = (ENTITY *)lookup(parser, &dtd->generalEntities,
-                           poolStart(&parser->m_tempPool), 0);
+      e = (ENTITY *)dtdLookup(parser, dtd, &dtd->generalEntities,
+                              poolStart(&parser->m_tempPool), 0);
       if (e)
         e->open = XML_TRUE;
       if (*s != XML_T('\0'))
@@ -7627,18 +9872,20 @@ dtdCreate(XML_Parser parser) {
   DTD *p = MALLOC(parser, sizeof(DTD));
   if (p == NULL)
     return p;
+  arenaInit(&(p->arena), parser);
   poolInit(&(p->pool), parser);
   poolInit(&(p->entityValuePool), parser);
-  hashTableInit(&(p->generalEntities), parser);
-  hashTableInit(&(p->elementTypes), parser);
-  hashTableInit(&(p->attributeIds), parser);
-  hashTableInit(&(p->prefixes), parser);
+  hashTableInit(&(p->generalEntities), &(p->arena));
+  hashTableInit(&(p->elementTypes), &(p->arena));
+  hashTableInit(&(p->attributeIds), &(p->arena));
+  hashTableInit(&(p->prefixes), &(p->arena));
 #ifdef XML_DTD
   p->paramEntityRead = XML_FALSE;
-  hashTableInit(&(p->paramEntities), parser);
+  hashTableInit(&(p->paramEntities), &(p->arena));
 #endif /* XML_DTD */
   p->defaultPrefix.name = NULL;
   p->defaultPrefix.binding = NULL;
+  p->base = NULL;
 
   p->in_eldecl = XML_FALSE;
   p->scaffIndex = NULL;
@@ -7657,15 +9904,6 @@ dtdCreate(XML_Parser parser) {
 
 static void
 dtdReset(DTD *p, XML_Parser parser) {
-  HASH_TABLE_ITER iter;
-  hashTableIterInit(&iter, &(p->elementTypes));
-  for (;;) {
-    ELEMENT_TYPE *e = (ELEMENT_TYPE *)hashTableIterNext(&iter);
-    if (! e)
-      break;
-    hashTableDestroy(&(e->defaultAttForName));
-    FREE(parser, e->defaultAtts);
-  }
   hashTableClear(&(p->generalEntities));
 #ifdef XML_DTD
   p->paramEntityRead = XML_FALSE;
@@ -7674,8 +9912,9 @@ dtdReset(DTD *p, XML_Parser parser) {
   hashTableClear(&(p->elementTypes));
   hashTableClear(&(p->attributeIds));
   hashTableClear(&(p->prefixes));
-  poolClear(&(p->pool));
-  poolClear(&(p->entityValuePool));
+  arenaClear(&(p->arena));
+  poolRetain(&(p->pool), parser->m_poolRetention);
+  poolRetain(&(p->entityValuePool), parser->m_poolRetention);
   p->defaultPrefix.name = NULL;
   p->defaultPrefix.binding = NULL;
 
@@ -7695,26 +9934,12 @@ dtdReset(DTD *p, XML_Parser parser) {
   p->keepProcessing = XML_TRUE;
   p->hasParamEntityRefs = XML_FALSE;
   p->standalone = XML_FALSE;
+  p->base = NULL;
 }
 
 static void
 dtdDestroy(DTD *p, XML_Bool isDocEntity, XML_Parser parser) {
-  HASH_TABLE_ITER iter;
-  hashTableIterInit(&iter, &(p->elementTypes));
-  for (;;) {
-    ELEMENT_TYPE *e = (ELEMENT_TYPE *)hashTableIterNext(&iter);
-    if (! e)
-      break;
-    hashTableDestroy(&(e->defaultAttForName));
-    FREE(parser, e->defaultAtts);
-  }
-  hashTableDestroy(&(p->generalEntities));
-#ifdef XML_DTD
-  hashTableDestroy(&(p->paramEntities));
-#endif /* XML_DTD */
-  hashTableDestroy(&(p->elementTypes));
-  hashTableDestroy(&(p->attributeIds));
-  hashTableDestroy(&(p->prefixes));
+  arenaDestroy(&(p->arena));
   poolDestroy(&(p->pool));
   poolDestroy(&(p->entityValuePool));
   if (isDocEntity) {
@@ -7798,16 +10023,16 @@ dtdCopy(XML_Parser oldParser, DTD *newDtd, const DTD *oldDtd,
     if (! newE)
       return 0;
 
-    if (! newE->defaultAttForName.parser)
-      hashTableInit(&(newE->defaultAttForName), parser);
+    if (! newE->defaultAttForName.arena)
+      hashTableInit(&(newE->defaultAttForName), &newDtd->arena);
 
     if (oldE->nDefaultAtts) {
       /* Detect and prevent integer overflow. */
       if (oldE->nDefaultAtts > SIZE_MAX / sizeof(DEFAULT_ATTRIBUTE)) {
         return 0;
       }
-      newE->defaultAtts
-          = MALLOC(parser, oldE->nDefaultAtts * sizeof(DEFAULT_ATTRIBUTE));
+      newE->defaultAtts = arenaAlloc(
+          &newDtd->arena, oldE->nDefaultAtts * sizeof(DEFAULT_ATTRIBUTE));
       if (! newE->defaultAtts) {
         return 0;
       }
@@ -7832,9 +10057,11 @@ dtdCopy(XML_Parser oldParser, DTD *newDtd, const DTD *oldDtd,
       } else
         newE->defaultAtts[i].value = NULL;
 
+      /* Key with the name in newDtd, which may outlive oldDtd */
       NAME_AND_DEFAULT_ATTRIBUTE *const nameAndDefaultAttribute
           = (NAME_AND_DEFAULT_ATTRIBUTE *)lookup(
-              parser, &(newE->defaultAttForName), attributeName,
+              parser, &(newE->defaultAttForName),
+              newE->defaultAtts[i].id->name,
               sizeof(NAME_AND_DEFAULT_ATTRIBUTE));
       if (! nameAndDefaultAttribute) {
         return 0;
@@ -7866,6 +10093,8 @@ dtdCopy(XML_Parser oldParser, DTD *newDtd, const DTD *oldDtd,
   newDtd->keepProcessing = oldDtd->keepProcessing;
   newDtd->hasParamEntityRefs = oldDtd->hasParamEntityRefs;
   newDtd->standalone = oldDtd->standalone;
+  newDtd->base = oldDtd->base;
+  newDtd->baseKey = oldDtd->baseKey;
 
   /* Don't want deep copying for scaffolding */
   newDtd->in_eldecl = oldDtd->in_eldecl;
@@ -7942,7 +10171,351 @@ copyEntityTable(XML_Parser oldParser, HASH_TABLE *newTable,
   return 1;
 }
 
-#define INIT_POWER 6
+/* Makes base, the DTD of a snapshot (see XML_DTDSnapshotCreate), the base
+   of dtd, or drops the base of dtd if base is NULL.  What dtdLookup does
+   not find in the tables of dtd, it looks up in those of base, which are
+   hashed with key, and copies over on first use, also when only reading
+   it.  Parsing writes to entities (while open), attribute IDs (the
+   scratch byte before the name) and prefixes (the binding), so parsers
+   never use entries of base directly; the strings these point to are
+   shared though, and so is the index of default attributes by name until
+   a declaration adds to an element type.  Each document thus pays for
+   copying the entries it uses, but not for the rest of base. */
+static void
+dtdUseBase(DTD *dtd, const DTD *base, const struct sipkey *key) {
+  dtd->base = base;
+  if (base == NULL) {
+    dtd->keepProcessing = XML_TRUE;
+    dtd->hasParamEntityRefs = XML_FALSE;
+    dtd->standalone = XML_FALSE;
+#ifdef XML_DTD
+    dtd->paramEntityRead = XML_FALSE;
+#endif /* XML_DTD */
+    return;
+  }
+  dtd->baseKey = *key;
+  dtd->keepProcessing = base->keepProcessing;
+  dtd->hasParamEntityRefs = base->hasParamEntityRefs;
+  dtd->standalone = base->standalone;
+#ifdef XML_DTD
+  dtd->paramEntityRead = base->paramEntityRead;
+#endif /* XML_DTD */
+}
+
+/* The copy functions below allocate from the arena of dtd only, as their
+   callers may be in the middle of building a string in the pool of dtd */
+
+static PREFIX *
+dtdCopyBasePrefix(XML_Parser parser, DTD *dtd, const PREFIX *basePrefix) {
+  if (basePrefix == &dtd->base->defaultPrefix)
+    return &dtd->defaultPrefix;
+  return (PREFIX *)lookup(parser, &dtd->prefixes, basePrefix->name,
+                          sizeof(PREFIX));
+}
+
+static ATTRIBUTE_ID *
+dtdCopyBaseAttributeId(XML_Parser parser, DTD *dtd,
+                       const ATTRIBUTE_ID *baseId) {
+  ATTRIBUTE_ID *id
+      = (ATTRIBUTE_ID *)lookup(parser, &dtd->attributeIds, baseId->name, 0);
+  if (id)
+    return id;
+  /* Remember to allocate the scratch byte before the name. */
+  const size_t nameBytes = (keylen(baseId->name) + 1) * sizeof(XML_Char);
+  XML_Char *const name
+      = arenaAlloc(&dtd->arena, sizeof(XML_Char) + nameBytes);
+  if (! name)
+    return NULL;
+  name[0] = XML_T('\0');
+  memcpy(name + 1, baseId->name, nameBytes);
+  id = (ATTRIBUTE_ID *)lookup(parser, &dtd->attributeIds, name + 1,
+                              sizeof(ATTRIBUTE_ID));
+  if (! id)
+    return NULL;
+  id->maybeTokenized = baseId->maybeTokenized;
+  id->xmlns = baseId->xmlns;
+  if (baseId->prefix) {
+    id->prefix = dtdCopyBasePrefix(parser, dtd, baseId->prefix);
+    if (! id->prefix)
+      return NULL;
+  }
+  return id;
+}
+
+static ELEMENT_TYPE *
+dtdCopyBaseElementType(XML_Parser parser, DTD *dtd,
+                       const ELEMENT_TYPE *baseType) {
+  ELEMENT_TYPE *const type = (ELEMENT_TYPE *)lookup(
+      parser, &dtd->elementTypes, baseType->name, sizeof(ELEMENT_TYPE));
+  if (! type)
+    return NULL;
+  hashTableInit(&type->defaultAttForName, &dtd->arena);
+  if (baseType->prefix) {
+    type->prefix = dtdCopyBasePrefix(parser, dtd, baseType->prefix);
+    if (! type->prefix)
+      return NULL;
+  }
+  if (baseType->idAtt) {
+    type->idAtt = dtdCopyBaseAttributeId(parser, dtd, baseType->idAtt);
+    if (! type->idAtt)
+      return NULL;
+  }
+  if (baseType->nDefaultAtts) {
+    /* Detect and prevent integer overflow. */
+    if (baseType->nDefaultAtts > SIZE_MAX / sizeof(DEFAULT_ATTRIBUTE))
+      return NULL;
+    type->defaultAtts = arenaAlloc(
+        &dtd->arena, baseType->nDefaultAtts * sizeof(DEFAULT_ATTRIBUTE));
+    if (! type->defaultAtts)
+      return NULL;
+  }
+  for (size_t i = 0; i < baseType->nDefaultAtts; i++) {
+    const ATTRIBUTE_ID *const id
+        = dtdCopyBaseAttributeId(parser, dtd, baseType->defaultAtts[i].id);
+    if (! id)
+      return NULL;
+    type->defaultAtts[i].id = id;
+    type->defaultAtts[i].isCdata = baseType->defaultAtts[i].isCdata;
+    type->defaultAtts[i].value = baseType->defaultAtts[i].value;
+  }
+  type->allocDefaultAtts = type->nDefaultAtts = baseType->nDefaultAtts;
+  /* The defaults keep their order, so the index of the snapshot type is
+     good for the copy until a declaration adds to it */
+  if (baseType->nDefaultAtts)
+    type->baseDefaultAttForName = &baseType->defaultAttForName;
+  return type;
+}
+
+/* Builds the index of the default attributes of an element type copied
+   from a DTD snapshot, before a declaration adds to it */
+static XML_Bool
+dtdIndexDefaultAtts(XML_Parser parser, ELEMENT_TYPE *type) {
+  for (size_t i = 0; i < type->nDefaultAtts; i++) {
+    /* The first declaration is binding, see dtdCopy */
+    NAME_AND_DEFAULT_ATTRIBUTE *const nameAndDefaultAttribute
+        = (NAME_AND_DEFAULT_ATTRIBUTE *)lookup(
+            parser, &type->defaultAttForName, type->defaultAtts[i].id->name,
+            sizeof(NAME_AND_DEFAULT_ATTRIBUTE));
+    if (! nameAndDefaultAttribute)
+      return XML_FALSE;
+    if (! nameAndDefaultAttribute->initialized) {
+      nameAndDefaultAttribute->attIndex = i;
+      nameAndDefaultAttribute->initialized = true;
+    }
+  }
+  type->baseDefaultAttForName = NULL;
+  return XML_TRUE;
+}
+
+/* Finds the default attribute for attId among those of type, if any */
+static const NAME_AND_DEFAULT_ATTRIBUTE *
+findDefaultAttribute(XML_Parser parser, ELEMENT_TYPE *type,
+                     const ATTRIBUTE_ID *attId) {
+  if (type->baseDefaultAttForName)
+    return (const NAME_AND_DEFAULT_ATTRIBUTE *)hashTableFind(
+        type->baseDefaultAttForName, &parser->m_dtd->baseKey, attId->name);
+  return (const NAME_AND_DEFAULT_ATTRIBUTE *)lookup(
+      parser, &type->defaultAttForName, attId->name, 0);
+}
+
+static ENTITY *
+dtdCopyBaseEntity(XML_Parser parser, HASH_TABLE *table,
+                  const ENTITY *baseEntity) {
+  ENTITY *const entity
+      = (ENTITY *)lookup(parser, table, baseEntity->name, sizeof(ENTITY));
+  if (! entity)
+    return NULL;
+  entity->textPtr = baseEntity->textPtr;
+  entity->textLen = baseEntity->textLen;
+  entity->systemId = baseEntity->systemId;
+  entity->base = baseEntity->base;
+  entity->publicId = baseEntity->publicId;
+  entity->notation = baseEntity->notation;
+  entity->is_param = baseEntity->is_param;
+  entity->is_internal = baseEntity->is_internal;
+  return entity;
+}
+
+/* Returns the table of the base of dtd that goes with table of dtd */
+static const HASH_TABLE *
+dtdBaseTable(const DTD *dtd, const HASH_TABLE *table) {
+  if (table == &dtd->elementTypes)
+    return &dtd->base->elementTypes;
+  if (table == &dtd->attributeIds)
+    return &dtd->base->attributeIds;
+#ifdef XML_DTD
+  if (table == &dtd->paramEntities)
+    return &dtd->base->paramEntities;
+#endif /* XML_DTD */
+  assert(table == &dtd->generalEntities);
+  return &dtd->base->generalEntities;
+}
+
+/* Looks up name in a table of dtd like lookup does, falling back to the
+   same table of the base of dtd, if any, see dtdUseBase.  Entries found
+   there are copied into dtd, and come back instead of new ones. */
+static NAMED *
+dtdLookup(XML_Parser parser, DTD *dtd, HASH_TABLE *table, KEY name,
+          size_t createSize) {
+  if (dtd->base == NULL)
+    return lookup(parser, table, name, createSize);
+
+  NAMED *named = lookup(parser, table, name, 0);
+  if (named)
+    return named;
+  const NAMED *const baseNamed
+      = hashTableFind(dtdBaseTable(dtd, table), &dtd->baseKey, name);
+  if (baseNamed == NULL)
+    return createSize ? lookup(parser, table, name, createSize) : NULL;
+  if (table == &dtd->elementTypes)
+    return (NAMED *)dtdCopyBaseElementType(parser, dtd,
+                                           (const ELEMENT_TYPE *)baseNamed);
+  if (table == &dtd->attributeIds)
+    return (NAMED *)dtdCopyBaseAttributeId(parser, dtd,
+                                           (const ATTRIBUTE_ID *)baseNamed);
+  return (NAMED *)dtdCopyBaseEntity(parser, table, (const ENTITY *)baseNamed);
+}
+
+/* Like dtdLookup for the declaration of an entity: an entity that the base
+   of dtd has already comes back without being copied, so that declaring
+   it again costs nothing.  Callers only look at its name then. */
+static ENTITY *
+dtdDeclareEntity(XML_Parser parser, DTD *dtd, HASH_TABLE *table,
+                 KEY name) {
+  if (dtd->base != NULL) {
+    NAMED *const named
+        = hashTableFind(dtdBaseTable(dtd, table), &dtd->baseKey, name);
+    if (named)
+      return (ENTITY *)named;
+  }
+  return (ENTITY *)lookup(parser, table, name, sizeof(ENTITY));
+}
+
+#ifdef XML_DTD
+
+/* Whether reading the external subset into the DTD of parser gives the
+   same result as using the one in its DTD cache, and the other way round:
+   the subset is read into an empty DTD, and no handler but the external
+   entity reference handler, which is not called for the cached subset,
+   would be told about anything in it */
+static XML_Bool
+dtdCacheUsable(XML_Parser parser) {
+  const DTD *const dtd = parser->m_dtd;
+  return (parser->m_dtdCache != NULL) && (dtd->base == NULL)
+         && dtd->keepProcessing && (dtd->generalEntities.used == 0)
+         && (dtd->elementTypes.used == 0) && (dtd->attributeIds.used == 0)
+         /* just the entity for the external subset itself */
+         && (dtd->paramEntities.used == 1)
+         && (parser->m_elementDeclHandler == NULL)
+         && (parser->m_attlistDeclHandler == NULL)
+         && (parser->m_entityDeclHandler == NULL)
+         && (parser->m_unparsedEntityDeclHandler == NULL)
+         && (parser->m_notationDeclHandler == NULL)
+         && (parser->m_commentHandler == NULL)
+         && (parser->m_processingInstructionHandler == NULL)
+         && (parser->m_xmlDeclHandler == NULL)
+         && (parser->m_skippedEntityHandler == NULL)
+         && (parser->m_startDoctypeDeclHandler == NULL)
+         && (parser->m_endDoctypeDeclHandler == NULL)
+         && (parser->m_notStandaloneHandler == NULL)
+         && (parser->m_defaultHandler == NULL) && ! parser->m_recordEvents;
+}
+
+static XML_Bool
+dtdCacheKeyEq(const XML_Char *s1, const XML_Char *s2) {
+  if ((s1 == NULL) || (s2 == NULL))
+    return (s1 == s2) ? XML_TRUE : XML_FALSE;
+  return keyeq(s1, s2);
+}
+
+static const DTD_CACHE_ENTRY *
+dtdCacheFind(XML_Parser parser, const ENTITY *entity) {
+  const DTD_CACHE_ENTRY *entry = parser->m_dtdCache->m_entries;
+  for (; entry != NULL; entry = entry->next) {
+    if ((entry->ns == parser->m_ns)
+        && dtdCacheKeyEq(entry->systemId, entity->systemId)
+        && dtdCacheKeyEq(entry->publicId, entity->publicId)
+        && dtdCacheKeyEq(entry->base, entity->base))
+      return entry;
+  }
+  return NULL;
+}
+
+/* Keeps the DTD of parser, made of nothing but the external subset that
+   entity stands for, in the DTD cache of parser */
+static XML_Bool
+dtdCacheAdd(XML_Parser parser, const ENTITY *entity) {
+  const XML_DTDCache cache = parser->m_dtdCache;
+  const XML_Char *const ids[3]
+      = {entity->base, entity->systemId, entity->publicId};
+  size_t chars = 0;
+  for (size_t i = 0; i < 3; i++)
+    if (ids[i] != NULL)
+      chars += keylen(ids[i]) + 1;
+  /* Detect and prevent integer overflow */
+  if (chars > (SIZE_MAX - sizeof(DTD_CACHE_ENTRY)) / sizeof(XML_Char))
+    return XML_FALSE;
+  DTD_CACHE_ENTRY *const entry = cache->m_mem.malloc_fcn(
+      sizeof(DTD_CACHE_ENTRY) + chars * sizeof(XML_Char));
+  if (entry == NULL)
+    return XML_FALSE;
+  entry->snapshot = dtdSnapshotCreate(parser);
+  if (entry->snapshot == NULL) {
+    cache->m_mem.free_fcn(entry);
+    return XML_FALSE;
+  }
+  XML_Char *copy = (XML_Char *)(entry + 1);
+  const XML_Char **const copies[3]
+      = {&entry->base, &entry->systemId, &entry->publicId};
+  for (size_t i = 0; i < 3; i++) {
+    *copies[i] = NULL;
+    if (ids[i] != NULL) {
+      const size_t len = keylen(ids[i]) + 1;
+      memcpy(copy, ids[i], len * sizeof(XML_Char));
+      *copies[i] = copy;
+      copy += len;
+    }
+  }
+  entry->ns = parser->m_ns;
+  entry->next = cache->m_entries;
+  cache->m_entries = entry;
+  return XML_TRUE;
+}
+
+/* Reads the external subset that entity stands for through the external
+   entity reference handler, or takes it from the DTD cache of parser */
+static enum XML_Error
+readExternalSubset(XML_Parser parser, const ENTITY *entity) {
+  DTD *const dtd = parser->m_dtd;
+  const XML_Bool cacheUsable = dtdCacheUsable(parser);
+  if (cacheUsable) {
+    const DTD_CACHE_ENTRY *const entry = dtdCacheFind(parser, entity);
+    if (entry != NULL) {
+      const XML_Parser holder = entry->snapshot->m_holder;
+      dtd->base = holder->m_dtd;
+      dtd->baseKey = holder->m_hash_secret_salt_128;
+      dtd->paramEntityRead = XML_TRUE;
+      return XML_ERROR_NONE;
+    }
+  }
+
+  beforeHandler(parser);
+  const int status = parser->m_externalEntityRefHandler(
+      parser->m_externalEntityRefHandlerArg, 0, entity->base,
+      entity->systemId, entity->publicId);
+  afterHandler(parser);
+  if (! status)
+    return XML_ERROR_EXTERNAL_ENTITY_HANDLING;
+  /* Subsets with unreadable parameter entities are not worth keeping */
+  if (cacheUsable && dtd->paramEntityRead && dtd->keepProcessing
+      && ! dtdCacheAdd(parser, entity))
+    return XML_ERROR_NO_MEMORY;
+  return XML_ERROR_NONE;
+}
+
+#endif /* XML_DTD */
+
+#define INIT_POWER 3
 
 static XML_Bool FASTCALL
 keyeq(KEY s1, KEY s2) {
@@ -7973,17 +10546,185 @@ copy_salt_to_sipkey(XML_Parser parser, struct sipkey *key) {
   *key = rootParser->m_hash_secret_salt_128;
 }
 
+static uint64_t FASTCALL
+fastHashRead64(const unsigned char *p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static uint64_t FASTCALL
+fastHashRead32(const unsigned char *p) {
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static uint64_t FASTCALL
+fastHashMix(uint64_t h) {
+  h *= FAST_HASH_MULTIPLIER;
+  return h ^ (h >> 32);
+}
+
+/* A keyed hash in the manner of wyhash: every 8 bytes of input cost one
+   multiplication, and inputs of up to 8 bytes are read as two overlapping
+   words, or three single bytes.  Unlike SipHash it does not hold up against
+   an attacker who learns enough about its output, which is why callers
+   switch to SipHash once they see too many collisions. */
+static uint64_t FASTCALL
+fastHash64(const struct sipkey *key, const void *s, size_t len) {
+  const unsigned char *p = (const unsigned char *)s;
+  uint64_t h = key->k[0] ^ len;
+  uint64_t word;
+  if (len > 8) {
+    for (; len > 8; p += 8, len -= 8)
+      h = fastHashMix(h ^ key->k[1] ^ fastHashRead64(p));
+    word = fastHashRead64(p + len - 8);
+  } else if (len >= 4)
+    word = (fastHashRead32(p) << 32) | fastHashRead32(p + len - 4);
+  else if (len > 0)
+    word = ((uint64_t)p[0] << 16) | ((uint64_t)p[len / 2] << 8) | p[len - 1];
+  else
+    word = 0;
+  h = fastHashMix(h ^ key->k[1] ^ word);
+  h ^= h >> 29;
+  h *= FAST_HASH_FINAL_MULTIPLIER;
+  return h ^ (h >> 32);
+}
+
+static unsigned long FASTCALL
+fastHash(const struct sipkey *key, const void *s, size_t len) {
+#if defined(XML_TESTING)
+  if (g_fastHashCollides)
+    return 0;
+#endif
+  return (unsigned long)fastHash64(key, s, len);
+}
+
+/* Returns the index of the name s of len XML_Char in vocabulary, or -1 */
+static int
+vocabularyFind(const struct XML_VocabularyStruct *vocabulary,
+               const XML_Char *s, size_t len) {
+  const uint64_t h = fastHash64(&vocabulary->m_key, s, len * sizeof(XML_Char));
+  const unsigned int displacement
+      = vocabulary->m_displacements[(unsigned int)h & vocabulary->m_bucketMask];
+  const int index
+      = vocabulary->m_slots[VOCABULARY_SLOT(h, displacement)
+                            & vocabulary->m_slotMask];
+  if ((index < 0) || (vocabulary->m_lengths[index] != len)
+      || (memcmp(vocabulary->m_names[index], s, len * sizeof(XML_Char)) != 0))
+    return -1;
+  return index;
+}
+
 static unsigned long FASTCALL
-hash(XML_Parser parser, KEY s, size_t keyLen) {
+hashWithKey(const struct sipkey *key, XML_Bool sipHash, KEY s,
+            size_t keyLen) {
+  if (! sipHash)
+    return fastHash(key, s, keyLen * sizeof(XML_Char));
   struct siphash state;
-  struct sipkey key;
   (void)sip24_valid;
-  copy_salt_to_sipkey(parser, &key);
-  sip24_init(&state, &key);
+  sip24_init(&state, key);
   sip24_update(&state, s, keyLen * sizeof(XML_Char));
   return (unsigned long)sip24_final(&state);
 }
 
+static unsigned long FASTCALL
+hash(XML_Parser parser, XML_Bool sipHash, KEY s, size_t keyLen) {
+  struct sipkey key;
+  copy_salt_to_sipkey(parser, &key);
+  return hashWithKey(&key, sipHash, s, keyLen);
+}
+
+/* Finds the slot for an entry with hash value h, the one holding name if
+   there is one, or the empty slot that name would go into otherwise;
+   the number of groups probed after the first one goes to *steps */
+static size_t
+hashTableFindSlot(const HASH_TABLE *table, KEY name, unsigned long h,
+                  size_t *steps) {
+  const unsigned char *const tags = HASH_TAGS(table);
+  const unsigned char tag = HASH_TAG(h);
+  const size_t groupMask = table->size / HASH_GROUP_SIZE - 1;
+  size_t group = (size_t)h & groupMask;
+  size_t step = 0;
+  for (;;) {
+    const size_t first = group * HASH_GROUP_SIZE;
+    size_t i;
+    for (i = first; i < first + HASH_GROUP_SIZE; i++) {
+      if (tags[i] == tag) {
+        const NAMED *const named = table->v[i];
+        if ((HASH_ENTRY_HASH(named) == h) && keyeq(name, named->name))
+          break;
+      } else if (tags[i] == 0)
+        break;
+    }
+    if (i < first + HASH_GROUP_SIZE) {
+      *steps = step;
+      return i;
+    }
+    /* The table is never full, so this ends before visiting a group twice */
+    step++;
+    group = (group + step) & groupMask;
+  }
+}
+
+/* Makes room for size slots, size being a power of 2; existing entries
+   are placed by the hash values stored with them */
+static XML_Bool
+hashTableResize(HASH_TABLE *table, unsigned char power) {
+  /* Detect and prevent invalid shift */
+  if (power >= sizeof(unsigned long) * 8 /* bits per byte */)
+    return XML_FALSE;
+  const size_t size = (size_t)1 << power;
+  /* Detect and prevent integer overflow */
+  if (size > SIZE_MAX / (sizeof(NAMED *) + 1))
+    return XML_FALSE;
+  NAMED **const v = arenaAlloc(table->arena, size * (sizeof(NAMED *) + 1));
+  if (! v)
+    return XML_FALSE;
+
+  HASH_TABLE resized = *table;
+  resized.v = v;
+  resized.power = power;
+  resized.size = size;
+  for (size_t i = 0; i < table->size; i++) {
+    NAMED *const named = table->v[i];
+    if (named) {
+      const unsigned long h = HASH_ENTRY_HASH(named);
+      size_t steps;
+      const size_t j = hashTableFindSlot(&resized, named->name, h, &steps);
+      v[j] = named;
+      HASH_TAGS(&resized)[j] = HASH_TAG(h);
+    }
+  }
+  *table = resized;
+  return XML_TRUE;
+}
+
+/* Stores the hash value of every entry anew, e.g. after table->sipHash
+   has changed */
+static void
+hashTableRehashEntries(XML_Parser parser, HASH_TABLE *table) {
+  for (size_t i = 0; i < table->size; i++) {
+    NAMED *const named = table->v[i];
+    if (named)
+      *(unsigned long *)((char *)named - HASH_ENTRY_HEADER_SIZE) = hash(
+          parser, table->sipHash, named->name, keylen(named->name));
+  }
+}
+
+/* Moves the table over to SipHash, for when fastHash collides too much */
+static XML_Bool
+hashTableUseSipHash(XML_Parser parser, HASH_TABLE *table) {
+  table->sipHash = XML_TRUE;
+  hashTableRehashEntries(parser, table);
+  if (hashTableResize(table, table->power))
+    return XML_TRUE;
+  table->sipHash = XML_FALSE;
+  hashTableRehashEntries(parser, table);
+  return XML_FALSE;
+}
+
 // Function `lookupWithLength` can be used to either…
 //
 // a) check whether an element with key `name` exists in the given hash table
@@ -8000,99 +10741,55 @@ hash(XML_Parser parser, KEY s, size_t keyLen) {
 // with the structure returned.
 //
 // NOTE: Read-only lookup does not need zero-terminated keys but
-//       read-write mode does, because keys can be re-hashed later and the
-//       hash table does not store key length information.
+//       read-write mode does, because the hash table keeps the key
+//       rather than a copy, and compares it with other keys as a string.
 //
 static NAMED *
 lookupWithLength(XML_Parser parser, HASH_TABLE *table, KEY name, size_t nameLen,
                  size_t createSize) {
-  size_t i;
   if (table->size == 0) {
-    size_t tsize;
     if (! createSize)
       return NULL;
-    table->power = INIT_POWER;
-    /* table->size is a power of 2 */
-    table->size = (size_t)1 << INIT_POWER;
-    tsize = table->size * sizeof(NAMED *);
-    table->v = MALLOC(table->parser, tsize);
-    if (! table->v) {
-      table->size = 0;
-      return NULL;
-    }
-    memset(table->v, 0, tsize);
-    i = hash(parser, name, nameLen) & ((unsigned long)table->size - 1);
-  } else {
-    unsigned long h = hash(parser, name, nameLen);
-    unsigned long mask = (unsigned long)table->size - 1;
-    unsigned char step = 0;
-    i = h & mask;
-    while (table->v[i]) {
-      if (keyeq(name, table->v[i]->name))
-        return table->v[i];
-      if (! step)
-        step = PROBE_STEP(h, mask, table->power);
-      i < step ? (i += table->size - step) : (i -= step);
-    }
-    if (! createSize)
+    if (! hashTableResize(table, INIT_POWER))
       return NULL;
+  }
+  unsigned long h = hash(parser, table->sipHash, name, nameLen);
+  size_t steps;
+  size_t i = hashTableFindSlot(table, name, h, &steps);
+  if (table->v[i])
+    return table->v[i];
+  if (! createSize)
+    return NULL;
 
-    /* check for overflow (table is half full) */
-    if (table->used >> (table->power - 1)) {
-      unsigned char newPower = table->power + 1;
-
-      /* Detect and prevent invalid shift */
-      if (newPower >= sizeof(unsigned long) * 8 /* bits per byte */) {
-        return NULL;
-      }
-
-      size_t newSize = (size_t)1 << newPower;
-      unsigned long newMask = (unsigned long)newSize - 1;
-
-      /* Detect and prevent integer overflow */
-      if (newSize > SIZE_MAX / sizeof(NAMED *)) {
-        return NULL;
-      }
+  /* Probing this long is a sign of names picked to collide */
+  if ((steps > HASH_MAX_PROBE_GROUPS) && ! table->sipHash) {
+    if (! hashTableUseSipHash(parser, table))
+      return NULL;
+    h = hash(parser, XML_TRUE, name, nameLen);
+    i = hashTableFindSlot(table, name, h, &steps);
+  }
 
-      size_t tsize = newSize * sizeof(NAMED *);
-      NAMED **newV = MALLOC(table->parser, tsize);
-      if (! newV)
-        return NULL;
-      memset(newV, 0, tsize);
-      for (i = 0; i < table->size; i++)
-        if (table->v[i]) {
-          KEY const key = table->v[i]->name;
-          unsigned long newHash = hash(parser, key, keylen(key));
-          size_t j = newHash & newMask;
-          step = 0;
-          while (newV[j]) {
-            if (! step)
-              step = PROBE_STEP(newHash, newMask, newPower);
-            j < step ? (j += newSize - step) : (j -= step);
-          }
-          newV[j] = table->v[i];
-        }
-      FREE(table->parser, table->v);
-      table->v = newV;
-      table->power = newPower;
-      table->size = newSize;
-      i = h & newMask;
-      step = 0;
-      while (table->v[i]) {
-        if (! step)
-          step = PROBE_STEP(h, newMask, newPower);
-        i < step ? (i += newSize - step) : (i -= step);
-      }
-    }
+  /* Grow once the table is three quarters full */
+  if (table->used >= table->size - table->size / 4) {
+    if (! hashTableResize(table, (unsigned char)(table->power + 1)))
+      return NULL;
+    i = hashTableFindSlot(table, name, h, &steps);
   }
   assert(createSize >= sizeof(NAMED));
-  table->v[i] = MALLOC(table->parser, createSize);
-  if (! table->v[i])
+  /* Detect and prevent integer overflow */
+  if (createSize > SIZE_MAX - HASH_ENTRY_HEADER_SIZE)
     return NULL;
-  memset(table->v[i], 0, createSize);
-  table->v[i]->name = name; // NOTE: This requires and assumes zero termination!
+  char *const entry
+      = arenaAlloc(table->arena, HASH_ENTRY_HEADER_SIZE + createSize);
+  if (! entry)
+    return NULL;
+  *(unsigned long *)entry = h;
+  NAMED *const named = (NAMED *)(entry + HASH_ENTRY_HEADER_SIZE);
+  named->name = name; // NOTE: This requires and assumes zero termination!
+  table->v[i] = named;
+  HASH_TAGS(table)[i] = HASH_TAG(h);
   (table->used)++;
-  return table->v[i];
+  return named;
 }
 
 // Function `lookup` can be used to either…
@@ -8115,31 +10812,36 @@ lookup(XML_Parser parser, HASH_TABLE *table, KEY name, size_t createSize) {
   return lookupWithLength(parser, table, name, keylen(name), createSize);
 }
 
-static void FASTCALL
-hashTableClear(HASH_TABLE *table) {
-  size_t i;
-  for (i = 0; i < table->size; i++) {
-    FREE(table->parser, table->v[i]);
-    table->v[i] = NULL;
-  }
-  table->used = 0;
+/* Looks up name in a table that is hashed with key rather than the salt
+   of a parser, and that is never written to, see dtdLookup */
+static NAMED *
+hashTableFind(const HASH_TABLE *table, const struct sipkey *key, KEY name) {
+  if (table->size == 0)
+    return NULL;
+  const unsigned long h
+      = hashWithKey(key, table->sipHash, name, keylen(name));
+  size_t steps;
+  return table->v[hashTableFindSlot(table, name, h, &steps)];
 }
 
+/* Empties the table ahead of clearing its arena */
 static void FASTCALL
-hashTableDestroy(HASH_TABLE *table) {
-  size_t i;
-  for (i = 0; i < table->size; i++)
-    FREE(table->parser, table->v[i]);
-  FREE(table->parser, table->v);
+hashTableClear(HASH_TABLE *table) {
+  table->power = 0;
+  table->size = 0;
+  table->used = 0;
+  table->v = NULL;
+  table->sipHash = XML_FALSE;
 }
 
 static void FASTCALL
-hashTableInit(HASH_TABLE *p, XML_Parser parser) {
+hashTableInit(HASH_TABLE *p, ARENA *arena) {
   p->power = 0;
   p->size = 0;
   p->used = 0;
   p->v = NULL;
-  p->parser = parser;
+  p->arena = arena;
+  p->sipHash = XML_FALSE;
 }
 
 static void FASTCALL
@@ -8158,6 +10860,122 @@ hashTableIterNext(HASH_TABLE_ITER *iter) {
   return NULL;
 }
 
+static void FASTCALL
+arenaInit(ARENA *arena, XML_Parser parser) {
+  arena->blocks = NULL;
+  arena->block = NULL;
+  arena->parser = parser;
+}
+
+/* Returns memory for size bytes, or NULL if we are out of memory */
+static void *
+arenaTake(ARENA *arena, size_t size) {
+  /* Detect and prevent integer overflow */
+  if (size > SIZE_MAX - ARENA_BLOCK_HEADER_SIZE - EXPAT_MALLOC_ALIGNMENT)
+    return NULL;
+  const size_t bytes = ROUND_UP(size, EXPAT_MALLOC_ALIGNMENT);
+  ARENA_BLOCK *block = arena->block;
+  /* Move on to the next block, which may be left from before arenaClear,
+     or add a new one */
+  while ((block == NULL) || (block->size - block->used < bytes)) {
+    ARENA_BLOCK *const next = block ? block->next : arena->blocks;
+    if (next != NULL) {
+      next->used = 0;
+      block = next;
+      continue;
+    }
+    size_t blockSize = ARENA_MIN_BLOCK_SIZE;
+    if (block && (block->size < ARENA_MAX_BLOCK_SIZE))
+      blockSize = 2 * block->size;
+    if (blockSize < bytes)
+      blockSize = bytes;
+    ARENA_BLOCK *const newBlock
+        = MALLOC(arena->parser, ARENA_BLOCK_HEADER_SIZE + blockSize);
+    if (! newBlock)
+      return NULL;
+    newBlock->next = NULL;
+    newBlock->size = blockSize;
+    newBlock->used = 0;
+    if (block)
+      block->next = newBlock;
+    else
+      arena->blocks = newBlock;
+    block = newBlock;
+  }
+  arena->block = block;
+  char *const mem = (char *)block + ARENA_BLOCK_HEADER_SIZE + block->used;
+  block->used += bytes;
+  return mem;
+}
+
+/* Returns zeroed memory for size bytes, or NULL if we are out of memory */
+static void *
+arenaAlloc(ARENA *arena, size_t size) {
+  void *const mem = arenaTake(arena, size);
+  if (mem)
+    memset(mem, 0, size);
+  return mem;
+}
+
+/* Grows memory for oldSize bytes taken from arena to size bytes: in place
+   if nothing was taken from arena after it, and by copying it otherwise,
+   leaving the old memory unused until arenaClear */
+static void *
+arenaResize(ARENA *arena, void *ptr, size_t oldSize, size_t size) {
+  ARENA_BLOCK *const block = arena->block;
+  if (size <= oldSize)
+    return ptr;
+  /* Detect and prevent integer overflow */
+  if (size > SIZE_MAX - ARENA_BLOCK_HEADER_SIZE - EXPAT_MALLOC_ALIGNMENT)
+    return NULL;
+  const size_t oldBytes = ROUND_UP(oldSize, EXPAT_MALLOC_ALIGNMENT);
+  const size_t more = ROUND_UP(size, EXPAT_MALLOC_ALIGNMENT) - oldBytes;
+  if (block
+      && ((char *)ptr + oldBytes
+          == (char *)block + ARENA_BLOCK_HEADER_SIZE + block->used)
+      && (block->size - block->used >= more)) {
+    block->used += more;
+    return ptr;
+  }
+  void *const mem = arenaTake(arena, size);
+  if (mem)
+    memcpy(mem, ptr, oldSize);
+  return mem;
+}
+
+/* Takes back all memory handed out, keeping the blocks for reuse */
+static void FASTCALL
+arenaClear(ARENA *arena) {
+  arena->block = NULL;
+}
+
+/* Frees the blocks after the one that memory is taken from currently */
+static void FASTCALL
+arenaTrim(ARENA *arena) {
+  ARENA_BLOCK *block = arena->block ? arena->block->next : arena->blocks;
+  while (block) {
+    ARENA_BLOCK *const next = block->next;
+    FREE(arena->parser, block);
+    block = next;
+  }
+  if (arena->block)
+    arena->block->next = NULL;
+  else
+    arena->blocks = NULL;
+}
+
+static void FASTCALL
+arenaDestroy(ARENA *arena) {
+  ARENA_BLOCK *block = arena->blocks;
+  while (block) {
+    ARENA_BLOCK *const next = block->next;
+    FREE(arena->parser, block);
+    block = next;
+  }
+  arena->blocks = NULL;
+  arena->block = NULL;
+}
+
 static void FASTCALL
 poolInit(STRING_POOL *pool, XML_Parser parser) {
   pool->blocks = NULL;
@@ -8166,10 +10984,24 @@ poolInit(STRING_POOL *pool, XML_Parser parser) {
   pool->ptr = NULL;
   pool->end = NULL;
   pool->parser = parser;
+  pool->usedSize = 0;
+  pool->peakSize = 0;
+  memset(pool->peaks, 0, sizeof(pool->peaks));
+  pool->nextPeak = 0;
+  pool->firstBlockSize = INIT_BLOCK_SIZE;
 }
 
 static void FASTCALL
 poolClear(STRING_POOL *pool) {
+  if (pool->blocks) {
+    /* Strings that were discarded again still needed a block */
+    size_t used
+        = pool->usedSize + EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->blocks->s);
+    if (used == 0)
+      used = 1;
+    if (used > pool->peakSize)
+      pool->peakSize = used;
+  }
   if (! pool->freeBlocks)
     pool->freeBlocks = pool->blocks;
   else {
@@ -8185,6 +11017,85 @@ poolClear(STRING_POOL *pool) {
   pool->start = NULL;
   pool->ptr = NULL;
   pool->end = NULL;
+  pool->usedSize = 0;
+}
+
+/* Clears pool between documents, keeping just enough memory for the most
+   demanding of the last documents documents (including the one just
+   finished): free blocks worth up to twice what they needed at once,
+   starting with the smallest block that holds all of it.  Without such a
+   block, the first block that poolGrow allocates gets that size, so that
+   the next document need not grow the pool block by block again. */
+static void
+poolRetain(STRING_POOL *pool, unsigned int documents) {
+  poolClear(pool);
+  pool->peaks[pool->nextPeak] = pool->peakSize;
+  pool->nextPeak = (pool->nextPeak + 1) % POOL_PEAK_HISTORY;
+  pool->peakSize = 0;
+
+  size_t target = 0;
+  for (unsigned int i = 1; i <= documents; i++) {
+    const size_t peak
+        = pool->peaks[(pool->nextPeak + POOL_PEAK_HISTORY - i)
+                      % POOL_PEAK_HISTORY];
+    if (peak > target)
+      target = peak;
+  }
+
+  const size_t limit = (target == 0)                ? 0
+                       : (target < INIT_BLOCK_SIZE) ? 2 * INIT_BLOCK_SIZE
+                       : (target > SIZE_MAX / 2)    ? SIZE_MAX
+                                                    : 2 * target;
+  BLOCK *keep = NULL;
+  for (BLOCK *block = pool->freeBlocks; block != NULL; block = block->next) {
+    const size_t size = (size_t)block->size;
+    if ((size >= target) && (size <= limit)
+        && ((keep == NULL) || (block->size < keep->size)))
+      keep = block;
+  }
+  size_t kept = 0;
+  BLOCK *block = pool->freeBlocks;
+  pool->freeBlocks = NULL;
+  if (keep != NULL)
+    kept = (size_t)keep->size;
+  while (block != NULL) {
+    BLOCK *const next = block->next;
+    if (block != keep) {
+      const size_t size = (size_t)block->size;
+      if (size <= limit - kept) {
+        kept += size;
+        block->next = pool->freeBlocks;
+        pool->freeBlocks = block;
+      } else
+        FREE(pool->parser, block);
+    }
+    block = next;
+  }
+  if (keep != NULL) {
+    keep->next = pool->freeBlocks;
+    pool->freeBlocks = keep;
+  }
+
+  /* Stay clear of the overflow checks in poolBytesToAllocateFor */
+  if (target > INT_MAX / 4 / sizeof(XML_Char))
+    target = INT_MAX / 4 / sizeof(XML_Char);
+  pool->firstBlockSize
+      = (target > INIT_BLOCK_SIZE) ? (int)target : INIT_BLOCK_SIZE;
+}
+
+/* Frees the blocks that pool does not use, and forgets its peaks */
+static void FASTCALL
+poolTrim(STRING_POOL *pool) {
+  BLOCK *block = pool->freeBlocks;
+  while (block != NULL) {
+    BLOCK *const next = block->next;
+    FREE(pool->parser, block);
+    block = next;
+  }
+  pool->freeBlocks = NULL;
+  pool->peakSize = 0;
+  memset(pool->peaks, 0, sizeof(pool->peaks));
+  pool->firstBlockSize = INIT_BLOCK_SIZE;
 }
 
 static void FASTCALL
@@ -8314,41 +11225,63 @@ poolBytesToAllocateFor(int blockSize) {
   }
 }
 
+/* Counts what is used of the first block towards the peak of pool, as
+   the string in progress is about to move to a new first block */
+static void FASTCALL
+poolLeaveBlock(STRING_POOL *pool) {
+  if (pool->blocks != NULL)
+    pool->usedSize += EXPAT_SAFE_PTR_DIFF(pool->start, pool->blocks->s);
+}
+
+/* Doubles blockSize until it holds at least minSize characters */
+static int
+poolBlockSizeFor(int blockSize, int minSize) {
+  while (blockSize < minSize) {
+    /* Detect overflow, avoiding _signed_ overflow undefined behavior */
+    if ((int)((unsigned)blockSize * 2U) < 0)
+      return minSize;
+    blockSize *= 2;
+  }
+  return blockSize;
+}
+
 static XML_Bool FASTCALL
 poolGrow(STRING_POOL *pool) {
-  if (pool->freeBlocks) {
-    if (pool->start == NULL) {
-      pool->blocks = pool->freeBlocks;
-      pool->freeBlocks = pool->freeBlocks->next;
-      pool->blocks->next = NULL;
-      pool->start = pool->blocks->s;
-      pool->end = pool->start + pool->blocks->size;
-      pool->ptr = pool->start;
-      return XML_TRUE;
-    }
-    if (pool->end - pool->start < pool->freeBlocks->size) {
-      BLOCK *tem = pool->freeBlocks->next;
-      pool->freeBlocks->next = pool->blocks;
-      pool->blocks = pool->freeBlocks;
-      pool->freeBlocks = tem;
-      memcpy(pool->blocks->s, pool->start,
-             (pool->end - pool->start) * sizeof(XML_Char));
-      pool->ptr = pool->blocks->s + EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->start);
-      pool->start = pool->blocks->s;
-      pool->end = pool->start + pool->blocks->size;
+  return poolGrowBy(pool, 1);
+}
+
+/* Moves the string in progress to a block with more room than it has now,
+   and with room for at least needed more characters */
+static XML_Bool FASTCALL
+poolGrowBy(STRING_POOL *pool, size_t needed) {
+  const size_t length = EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->start);
+  /* Detect and prevent integer overflow */
+  if ((length > INT_MAX) || (needed > INT_MAX - length))
+    return XML_FALSE;
+  const int minSize = (int)(length + needed);
+
+  /* Any free block that is large enough will do */
+  BLOCK **prev = &pool->freeBlocks;
+  for (BLOCK *block = pool->freeBlocks; block != NULL; block = block->next) {
+    if ((block->size >= minSize) && (block->size > pool->end - pool->start)) {
+      poolLeaveBlock(pool);
+      *prev = block->next;
+      block->next = pool->blocks;
+      pool->blocks = block;
+      if (length > 0)
+        memcpy(block->s, pool->start, length * sizeof(XML_Char));
+      pool->start = block->s;
+      pool->ptr = pool->start + length;
+      pool->end = pool->start + block->size;
       return XML_TRUE;
     }
+    prev = &block->next;
   }
   if (pool->blocks && pool->start == pool->blocks->s) {
     BLOCK *temp;
     int blockSize = (int)((unsigned)(pool->end - pool->start) * 2U);
     size_t bytesToAllocate;
 
-    /* NOTE: Needs to be calculated prior to calling `realloc`
-             to avoid dangling pointers: */
-    const ptrdiff_t offsetInsideBlock
-        = EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->start);
-
     if (blockSize < 0) {
       /* This condition traps a situation where either more than
        * INT_MAX/2 bytes have already been allocated.  This isn't
@@ -8359,6 +11292,7 @@ poolGrow(STRING_POOL *pool) {
       return XML_FALSE; /* LCOV_EXCL_LINE */
     }
 
+    blockSize = poolBlockSizeFor(blockSize, minSize);
     bytesToAllocate = poolBytesToAllocateFor(blockSize);
     if (bytesToAllocate == 0)
       return XML_FALSE;
@@ -8368,7 +11302,7 @@ poolGrow(STRING_POOL *pool) {
       return XML_FALSE;
     pool->blocks = temp;
     pool->blocks->size = blockSize;
-    pool->ptr = pool->blocks->s + offsetInsideBlock;
+    pool->ptr = pool->blocks->s + length;
     pool->start = pool->blocks->s;
     pool->end = pool->start + blockSize;
   } else {
@@ -8389,8 +11323,10 @@ poolGrow(STRING_POOL *pool) {
       return XML_FALSE; /* LCOV_EXCL_LINE */
     }
 
+    /* The first block is sized for what recent documents needed,
+       see poolRetain */
     if (blockSize < INIT_BLOCK_SIZE)
-      blockSize = INIT_BLOCK_SIZE;
+      blockSize = pool->blocks ? INIT_BLOCK_SIZE : pool->firstBlockSize;
     else {
       /* Detect overflow, avoiding _signed_ overflow undefined behavior */
       if ((int)((unsigned)blockSize * 2U) < 0) {
@@ -8399,6 +11335,7 @@ poolGrow(STRING_POOL *pool) {
       blockSize *= 2;
     }
 
+    blockSize = poolBlockSizeFor(blockSize, minSize);
     bytesToAllocate = poolBytesToAllocateFor(blockSize);
     if (bytesToAllocate == 0)
       return XML_FALSE;
@@ -8406,13 +11343,13 @@ poolGrow(STRING_POOL *pool) {
     tem = MALLOC(pool->parser, bytesToAllocate);
     if (! tem)
       return XML_FALSE;
+    poolLeaveBlock(pool);
     tem->size = blockSize;
     tem->next = pool->blocks;
     pool->blocks = tem;
-    if (pool->ptr != pool->start)
-      memcpy(tem->s, pool->start,
-             EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->start) * sizeof(XML_Char));
-    pool->ptr = tem->s + EXPAT_SAFE_PTR_DIFF(pool->ptr, pool->start);
+    if (length > 0)
+      memcpy(tem->s, pool->start, length * sizeof(XML_Char));
+    pool->ptr = tem->s + length;
     pool->start = tem->s;
     pool->end = tem->s + blockSize;
   }
@@ -8421,15 +11358,8 @@ poolGrow(STRING_POOL *pool) {
 
 static bool FASTCALL
 poolGrowUntil(STRING_POOL *pool, size_t needed) {
-  for (;;) {
-    const size_t available = pool->end - pool->ptr;
-    if (available >= needed) {
-      return true;
-    }
-    if (! poolGrow(pool)) {
-      return false;
-    }
-  }
+  const size_t available = pool->end - pool->ptr;
+  return (available >= needed) || poolGrowBy(pool, needed);
 }
 
 static int FASTCALL
@@ -8650,12 +11580,12 @@ getElementType(XML_Parser parser, const ENCODING *enc, const char *ptr,
 
   if (! name)
     return NULL;
-  ret = (ELEMENT_TYPE *)lookup(parser, &dtd->elementTypes, name,
-                               sizeof(ELEMENT_TYPE));
+  ret = (ELEMENT_TYPE *)dtdLookup(parser, dtd, &dtd->elementTypes, name,
+                                  sizeof(ELEMENT_TYPE));
   if (! ret)
     return NULL;
-  if (! ret->defaultAttForName.parser)
-    hashTableInit(&(ret->defaultAttForName), getRootParserOf(parser, NULL));
+  if (! ret->defaultAttForName.arena)
+    hashTableInit(&(ret->defaultAttForName), &dtd->arena);
   if (ret->name != name)
     poolDiscard(&dtd->pool);
   else {
@@ -64,6 +64,7 @@
 #include "internal.h"
 #include "fallthrough.h"
 #include "xmltok.h"
+#include "xmltok_simd.h"
 #include "nametab.h"
 
 #ifdef XML_DTD
@@ -208,6 +209,13 @@ struct normal_encoding {
   int(PTRFASTCALL *isInvalid2)(const ENCODING *, const char *);
   int(PTRFASTCALL *isInvalid3)(const ENCODING *, const char *);
   int(PTRFASTCALL *isInvalid4)(const ENCODING *, const char *);
+  /* Non-zero if bytes 0x20 to 0x7F are plain US-ASCII as in asciitab.h,
+     so that runs of them may be skipped by the helpers in xmltok_simd.h;
+     never set for user-defined encodings. */
+  char plainAscii;
+  /* Non-zero if bytes from 0x80 upwards are UTF-8 as in utf8tab.h, so that
+     runs of well-formed multi-byte characters may be skipped as well. */
+  char plainUtf8;
 };
 
 #define AS_NORMAL_ENCODING(enc) ((const struct normal_encoding *)(enc))
@@ -307,6 +315,27 @@ sb_charMatches(const ENCODING *enc, const char *p, int c) {
 #  define CHAR_MATCHES(enc, p, c) (*(p) == (c))
 #endif
 
+#ifdef XML_SIMD
+/* Skips US-ASCII bytes of value lowest or greater other than c1, c2 and c3,
+   and in UTF-8 also well-formed multi-byte characters */
+#  define SKIP_PLAIN_CHARS(enc, ptr, end, lowest, c1, c2, c3)                  \
+    (AS_NORMAL_ENCODING(enc)->plainUtf8                                        \
+         ? simdSkipPlainUtf8(ptr, end, lowest, c1, c2, c3)                     \
+     : AS_NORMAL_ENCODING(enc)->plainAscii                                     \
+         ? simdSkipPlain(ptr, end, lowest, c1, c2, c3)                         \
+         : (ptr))
+#endif
+
+#ifdef XML_SIMD
+/* Updates pos in bulk unless CR is not a line break, like in iasciitab.h */
+#  define UPDATE_POSITION_IN_BULK(enc, ptr, end, pos)                          \
+    ((AS_NORMAL_ENCODING(enc)->plainAscii                                      \
+      && AS_NORMAL_ENCODING(enc)->type[ASCII_CR] == BT_CR)                     \
+         ? simdUpdatePosition(ptr, end, AS_NORMAL_ENCODING(enc)->plainUtf8,    \
+                              pos)                                             \
+         : (ptr))
+#endif
+
 #define PREFIX(ident) normal_##ident
 #define XML_TOK_IMPL_C
 #include "xmltok_impl.c"
@@ -321,6 +350,8 @@ sb_charMatches(const ENCODING *enc, const char *p, int c) {
 #undef IS_NMSTRT_CHAR
 #undef IS_NMSTRT_CHAR_MINBPC
 #undef IS_INVALID_CHAR
+#undef SKIP_PLAIN_CHARS
+#undef UPDATE_POSITION_IN_BULK
 
 enum { /* UTF8_cvalN is value of masked first byte of N byte sequence */
        UTF8_cval1 = 0x00,
@@ -470,7 +501,7 @@ static const struct normal_encoding utf8_encoding_ns
 #  include "asciitab.h"
 #  include "utf8tab.h"
        },
-       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_)};
+       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_), 1, 1};
 #endif
 
 static const struct normal_encoding utf8_encoding
@@ -481,7 +512,7 @@ static const struct normal_encoding utf8_encoding
 #undef BT_COLON
 #include "utf8tab.h"
        },
-       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_)};
+       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_), 1, 1};
 
 #ifdef XML_NS
 
@@ -491,7 +522,7 @@ static const struct normal_encoding internal_utf8_encoding_ns
 #  include "iasciitab.h"
 #  include "utf8tab.h"
        },
-       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_)};
+       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_), 1, 1};
 
 #endif
 
@@ -503,7 +534,7 @@ static const struct normal_encoding internal_utf8_encoding
 #undef BT_COLON
 #include "utf8tab.h"
        },
-       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_)};
+       STANDARD_VTABLE(sb_) NORMAL_VTABLE(utf8_), 1, 1};
 
 static enum XML_Convert_Result PTRCALL
 latin1_toUtf8(const ENCODING *enc, const char **fromP, const char *fromLim,
@@ -549,7 +580,7 @@ static const struct normal_encoding latin1_encoding_ns
 #  include "asciitab.h"
 #  include "latin1tab.h"
        },
-       STANDARD_VTABLE(sb_) NULL_VTABLE};
+       STANDARD_VTABLE(sb_) NULL_VTABLE, 1, 0};
 
 #endif
 
@@ -561,7 +592,7 @@ static const struct normal_encoding latin1_encoding
 #undef BT_COLON
 #include "latin1tab.h"
        },
-       STANDARD_VTABLE(sb_) NULL_VTABLE};
+       STANDARD_VTABLE(sb_) NULL_VTABLE, 1, 0};
 
 static enum XML_Convert_Result PTRCALL
 ascii_toUtf8(const ENCODING *enc, const char **fromP, const char *fromLim,
@@ -584,7 +615,7 @@ static const struct normal_encoding ascii_encoding_ns
 #  include "asciitab.h"
            /* BT_NONXML == 0 */
        },
-       STANDARD_VTABLE(sb_) NULL_VTABLE};
+       STANDARD_VTABLE(sb_) NULL_VTABLE, 1, 0};
 
 #endif
 
@@ -596,7 +627,7 @@ static const struct normal_encoding ascii_encoding
 #undef BT_COLON
            /* BT_NONXML == 0 */
        },
-       STANDARD_VTABLE(sb_) NULL_VTABLE};
+       STANDARD_VTABLE(sb_) NULL_VTABLE, 1, 0};
 
 static int PTRFASTCALL
 unicode_byte_type(char hi, char lo) {
@@ -828,7 +859,7 @@ static const struct normal_encoding little2_encoding_ns
 #  include "asciitab.h"
 #  include "latin1tab.h"
        },
-       STANDARD_VTABLE(little2_) NULL_VTABLE};
+       STANDARD_VTABLE(little2_) NULL_VTABLE, 0, 0};
 
 #endif
 
@@ -846,7 +877,7 @@ static const struct normal_encoding little2_encoding
 #undef BT_COLON
 #include "latin1tab.h"
        },
-       STANDARD_VTABLE(little2_) NULL_VTABLE};
+       STANDARD_VTABLE(little2_) NULL_VTABLE, 0, 0};
 
 #if BYTEORDER != 4321
 
@@ -858,7 +889,7 @@ static const struct normal_encoding internal_little2_encoding_ns
 #    include "iasciitab.h"
 #    include "latin1tab.h"
        },
-       STANDARD_VTABLE(little2_) NULL_VTABLE};
+       STANDARD_VTABLE(little2_) NULL_VTABLE, 0, 0};
 
 #  endif
 
@@ -870,7 +901,7 @@ static const struct normal_encoding internal_little2_encoding
 #  undef BT_COLON
 #  include "latin1tab.h"
        },
-       STANDARD_VTABLE(little2_) NULL_VTABLE};
+       STANDARD_VTABLE(little2_) NULL_VTABLE, 0, 0};
 
 #endif
 
@@ -961,7 +992,7 @@ static const struct normal_encoding big2_encoding_ns
 #  include "asciitab.h"
 #  include "latin1tab.h"
        },
-       STANDARD_VTABLE(big2_) NULL_VTABLE};
+       STANDARD_VTABLE(big2_) NULL_VTABLE, 0, 0};
 
 #endif
 
@@ -979,7 +1010,7 @@ static const struct normal_encoding big2_encoding
 #undef BT_COLON
 #include "latin1tab.h"
        },
-       STANDARD_VTABLE(big2_) NULL_VTABLE};
+       STANDARD_VTABLE(big2_) NULL_VTABLE, 0, 0};
 
 #if BYTEORDER != 1234
 
@@ -991,7 +1022,7 @@ static const struct normal_encoding internal_big2_encoding_ns
 #    include "iasciitab.h"
 #    include "latin1tab.h"
        },
-       STANDARD_VTABLE(big2_) NULL_VTABLE};
+       STANDARD_VTABLE(big2_) NULL_VTABLE, 0, 0};
 
 #  endif
 
@@ -1003,7 +1034,7 @@ static const struct normal_encoding internal_big2_encoding
 #  undef BT_COLON
 #  include "latin1tab.h"
        },
-       STANDARD_VTABLE(big2_) NULL_VTABLE};
+       STANDARD_VTABLE(big2_) NULL_VTABLE, 0, 0};
 
 #endif
 
@@ -1416,6 +1447,8 @@ XmlInitUnknownEncoding(void *mem, const int *table, CONVERTER convert,
   int i;
   struct unknown_encoding *e = (struct unknown_encoding *)mem;
   memcpy(mem, &latin1_encoding, sizeof(struct normal_encoding));
+  /* User-defined tables may turn any BT_OTHER byte into something else */
+  e->normal.plainAscii = 0;
   for (i = 0; i < 128; i++)
     if (latin1_encoding.type[i] != BT_OTHER
         && latin1_encoding.type[i] != BT_NONXML && table[i] != i)
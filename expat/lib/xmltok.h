@@ -180,8 +180,8 @@ struct encoding {
                                  const char *);
   int(PTRFASTCALL *nameLength)(const ENCODING *, const char *);
   const char *(PTRFASTCALL *skipS)(const ENCODING *, const char *);
-  int(PTRCALL *getAtts)(const ENCODING *enc, const char *ptr, int attsMax,
-                        ATTRIBUTE *atts);
+  int(PTRCALL *getAtts)(const ENCODING *enc, const char *ptr, const char *end,
+                        int attsMax, ATTRIBUTE *atts);
   int(PTRFASTCALL *charRefNumber)(const ENCODING *enc, const char *ptr);
   int(PTRCALL *predefinedEntityName)(const ENCODING *, const char *,
                                      const char *);
@@ -262,8 +262,8 @@ struct encoding {
 
 #  define XmlSkipS(enc, ptr) (((enc)->skipS)(enc, ptr))
 
-#  define XmlGetAttributes(enc, ptr, attsMax, atts)                            \
-    (((enc)->getAtts)(enc, ptr, attsMax, atts))
+#  define XmlGetAttributes(enc, ptr, end, attsMax, atts)                       \
+    (((enc)->getAtts)(enc, ptr, end, attsMax, atts))
 
 #  define XmlCharRefNumber(enc, ptr) (((enc)->charRefNumber)(enc, ptr))
 
@@ -124,6 +124,15 @@
     CHECK_NMSTRT_CASE(3, enc, ptr, end, nextTokPtr)                            \
     CHECK_NMSTRT_CASE(4, enc, ptr, end, nextTokPtr)
 
+#  ifndef SKIP_PLAIN_CHARS // i.e. no vectorized scanning for this encoding
+#    define SKIP_PLAIN_CHARS(enc, ptr, end, lowest, c1, c2, c3)                \
+      ((void)(end), (ptr))
+#  endif
+
+#  ifndef UPDATE_POSITION_IN_BULK
+#    define UPDATE_POSITION_IN_BULK(enc, ptr, end, pos) (ptr)
+#  endif
+
 #  ifndef PREFIX
 #    define PREFIX(ident) ident
 #  endif
@@ -171,7 +180,8 @@ PREFIX(scanComment)(const ENCODING *enc, const char *ptr, const char *end,
         }
         break;
       default:
-        ptr += MINBPC(enc);
+        ptr = SKIP_PLAIN_CHARS(enc, ptr + MINBPC(enc), end, ASCII_SPACE,
+                               ASCII_MINUS, ASCII_MINUS, ASCII_MINUS);
         break;
       }
     }
@@ -310,7 +320,8 @@ PREFIX(scanPi)(const ENCODING *enc, const char *ptr, const char *end,
           }
           break;
         default:
-          ptr += MINBPC(enc);
+          ptr = SKIP_PLAIN_CHARS(enc, ptr + MINBPC(enc), end, ASCII_SPACE,
+                                 ASCII_QUEST, ASCII_QUEST, ASCII_QUEST);
           break;
         }
       }
@@ -405,7 +416,8 @@ PREFIX(cdataSectionTok)(const ENCODING *enc, const char *ptr, const char *end,
       *nextTokPtr = ptr;                                                       \
       return XML_TOK_DATA_CHARS;                                               \
     }                                                                          \
-    ptr += n;                                                                  \
+    ptr = SKIP_PLAIN_CHARS(enc, ptr + n, end, ASCII_SPACE, ASCII_RSQB,         \
+                           ASCII_RSQB, ASCII_RSQB);                            \
     break;
       LEAD_CASE(2)
       LEAD_CASE(3)
@@ -420,7 +432,9 @@ PREFIX(cdataSectionTok)(const ENCODING *enc, const char *ptr, const char *end,
       *nextTokPtr = ptr;
       return XML_TOK_DATA_CHARS;
     default:
-      ptr += MINBPC(enc);
+      /* Only "]]>" ends a CDATA section, so '<' and '&' are plain here */
+      ptr = SKIP_PLAIN_CHARS(enc, ptr + MINBPC(enc), end, ASCII_SPACE,
+                             ASCII_RSQB, ASCII_RSQB, ASCII_RSQB);
       break;
     }
   }
@@ -663,7 +677,9 @@ PREFIX(scanAtts)(const ENCODING *enc, const char *ptr, const char *end,
           *nextTokPtr = ptr;
           return XML_TOK_INVALID;
         default:
-          ptr += MINBPC(enc);
+          ptr = SKIP_PLAIN_CHARS(enc, ptr + MINBPC(enc), end, ASCII_SPACE,
+                                 (open == BT_QUOT) ? ASCII_QUOT : ASCII_APOS,
+                                 ASCII_AMP, ASCII_LT);
           break;
         }
       }
@@ -880,7 +896,8 @@ PREFIX(contentTok)(const ENCODING *enc, const char *ptr, const char *end,
       *nextTokPtr = ptr;                                                       \
       return XML_TOK_DATA_CHARS;                                               \
     }                                                                          \
-    ptr += n;                                                                  \
+    ptr = SKIP_PLAIN_CHARS(enc, ptr + n, end, ASCII_SPACE, ASCII_LT,           \
+                           ASCII_AMP, ASCII_RSQB);                             \
     break;
       LEAD_CASE(2)
       LEAD_CASE(3)
@@ -912,7 +929,9 @@ PREFIX(contentTok)(const ENCODING *enc, const char *ptr, const char *end,
       *nextTokPtr = ptr;
       return XML_TOK_DATA_CHARS;
     default:
-      ptr += MINBPC(enc);
+      /* Long runs of plain text are the common case, skip them in bulk */
+      ptr = SKIP_PLAIN_CHARS(enc, ptr + MINBPC(enc), end, ASCII_SPACE,
+                             ASCII_LT, ASCII_AMP, ASCII_RSQB);
       break;
     }
   }
@@ -1504,19 +1523,29 @@ PREFIX(isPublicId)(const ENCODING *enc, const char *ptr, const char *end,
 }
 
 /* This must only be called for a well-formed start-tag or empty
-   element tag.  Returns the number of attributes.  Pointers to the
-   first attsMax attributes are stored in atts.
+   element tag ending at end.  Returns the number of attributes.  Pointers
+   to the first attsMax attributes are stored in atts.
 */
 
 static int PTRCALL
-PREFIX(getAtts)(const ENCODING *enc, const char *ptr, int attsMax,
-                ATTRIBUTE *atts) {
+PREFIX(getAtts)(const ENCODING *enc, const char *ptr, const char *end,
+                int attsMax, ATTRIBUTE *atts) {
   enum { other, inName, inValue } state = inName;
   int nAtts = 0;
   int open = 0; /* defined when state == inValue;
                    initialization just to shut up compilers */
 
   for (ptr += MINBPC(enc);; ptr += MINBPC(enc)) {
+    if (state == inValue) {
+      /* Skip the bulk of the value; the closing quote stops this for sure.
+         Spaces only need a closer look while the value is still normalized. */
+      ptr = SKIP_PLAIN_CHARS(enc, ptr, end,
+                             (nAtts < attsMax && atts[nAtts].normalized)
+                                 ? ASCII_EXCL
+                                 : ASCII_SPACE,
+                             (open == BT_QUOT) ? ASCII_QUOT : ASCII_APOS,
+                             ASCII_AMP, ASCII_AMP);
+    }
     switch (BYTE_TYPE(enc, ptr)) {
 #  define START_NAME                                                           \
     if (state == other) {                                                      \
@@ -1780,6 +1809,7 @@ PREFIX(skipS)(const ENCODING *enc, const char *ptr) {
 static void PTRCALL
 PREFIX(updatePosition)(const ENCODING *enc, const char *ptr, const char *end,
                        POSITION *pos) {
+  ptr = UPDATE_POSITION_IN_BULK(enc, ptr, end, pos);
   while (HAS_CHAR(enc, ptr, end)) {
     switch (BYTE_TYPE(enc, ptr)) {
 #  define LEAD_CASE(n)                                                         \
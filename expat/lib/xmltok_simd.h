@@ -0,0 +1,580 @@
+/*
+                            __  __            _
+                         ___\ \/ /_ __   __ _| |_
+                        / _ \\  /| '_ \ / _` | __|
+                       |  __//  \| |_) | (_| | |_
+                        \___/_/\_\ .__/ \__,_|\__|
+                                 |_| XML parser
+
+   Copyright (c) 2026      Expat development team
+   Licensed under the MIT license:
+
+   Permission is  hereby granted,  free of charge,  to any  person obtaining
+   a  copy  of  this  software   and  associated  documentation  files  (the
+   "Software"),  to  deal in  the  Software  without restriction,  including
+   without  limitation the  rights  to use,  copy,  modify, merge,  publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons  to whom  the Software  is  furnished to  do so,  subject to  the
+   following conditions:
+
+   The above copyright  notice and this permission notice  shall be included
+   in all copies or substantial portions of the Software.
+
+   THE  SOFTWARE  IS  PROVIDED  "AS  IS",  WITHOUT  WARRANTY  OF  ANY  KIND,
+   EXPRESS  OR IMPLIED,  INCLUDING  BUT  NOT LIMITED  TO  THE WARRANTIES  OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+   NO EVENT SHALL THE AUTHORS OR  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+   DAMAGES OR  OTHER LIABILITY, WHETHER  IN AN  ACTION OF CONTRACT,  TORT OR
+   OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+   USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+   SPDX-License-Identifier: MIT
+*/
+
+/* This file is included (from xmltok.c only)!
+
+   It provides vectorized helpers that let the single-byte tokenizer skip
+   long runs of bytes that need no attention.  Every helper has a portable
+   scalar fallback, so the tokenizer behaves identically with and without
+   vector support; the vector code only changes how fast we get there.
+*/
+
+#ifndef XmlTokSimd_INCLUDED
+#  define XmlTokSimd_INCLUDED 1
+
+#  include <stddef.h> // size_t
+
+#  if ! defined(XML_MIN_SIZE) && ! defined(XML_NO_SIMD)
+#    if defined(__SSE2__) || defined(_M_X64)                                   \
+      || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#      define XML_SIMD_SSE2 1
+#      include <emmintrin.h>
+#      if (defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__)
+/* AVX2 and AVX-512 are not part of any x86 baseline, so they have to be
+   detected at runtime; we only do that where the compiler supports both
+   function-level target attributes and __builtin_cpu_supports. */
+#        define XML_SIMD_AVX2 1
+#        define XML_SIMD_AVX512 1
+#        include <immintrin.h>
+#      endif
+#    elif (defined(__aarch64__) && defined(__ARM_NEON)) || defined(_M_ARM64)
+#      define XML_SIMD_NEON 1
+#      include <arm_neon.h>
+#    endif
+#  endif /* ! defined(XML_MIN_SIZE) && ! defined(XML_NO_SIMD) */
+
+#  if defined(XML_SIMD_SSE2) || defined(XML_SIMD_NEON)
+#    define XML_SIMD 1
+#  endif
+
+#  ifdef XML_SIMD
+
+#    if defined(_MSC_VER)
+#      include <intrin.h> // _BitScanForward, _BitScanForward64
+#    endif
+
+/* Index of the lowest bit set in a non-zero mask */
+static unsigned
+simdLowestBit(unsigned long long mask) {
+#    if defined(_MSC_VER) && ! defined(__clang__)
+  unsigned long index;
+#      if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanForward64(&index, mask);
+#      else
+  if (! _BitScanForward(&index, (unsigned long)mask)) {
+    _BitScanForward(&index, (unsigned long)(mask >> 32));
+    index += 32;
+  }
+#      endif
+  return (unsigned)index;
+#    else
+  return (unsigned)__builtin_ctzll(mask);
+#    endif
+}
+
+/* Index of the highest bit set in a non-zero mask */
+static unsigned
+simdHighestBit(unsigned long long mask) {
+#    if defined(_MSC_VER) && ! defined(__clang__)
+  unsigned long index;
+#      if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanReverse64(&index, mask);
+#      else
+  if (_BitScanReverse(&index, (unsigned long)(mask >> 32)))
+    index += 32;
+  else
+    _BitScanReverse(&index, (unsigned long)mask);
+#      endif
+  return (unsigned)index;
+#    else
+  return 63u - (unsigned)__builtin_clzll(mask);
+#    endif
+}
+
+/* Number of bits set in a mask */
+static unsigned
+simdPopCount(unsigned long long mask) {
+#    if defined(_MSC_VER) && ! defined(__clang__)
+  /* NOTE: __popcnt64 would need a CPU check */
+  mask = mask - ((mask >> 1) & 0x5555555555555555ULL);
+  mask = (mask & 0x3333333333333333ULL) + ((mask >> 2) & 0x3333333333333333ULL);
+  mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (unsigned)((mask * 0x0101010101010101ULL) >> 56);
+#    else
+  return (unsigned)__builtin_popcountll(mask);
+#    endif
+}
+
+/* A byte is "plain" when it is a US-ASCII byte of value lowest or greater
+   (lowest being 0x20 or 0x21) and none of c1, c2 and c3.  All control
+   characters and all bytes from 0x80 upwards are not plain, so every kind
+   of non-ASCII or invalid input ends a plain run.
+*/
+#    define SIMD_IS_PLAIN(b, lowest, c1, c2, c3)                               \
+      ((b) >= (lowest) && (b) < 0x80 && (b) != (unsigned char)(c1)             \
+       && (b) != (unsigned char)(c2) && (b) != (unsigned char)(c3))
+
+#    if defined(XML_SIMD_AVX2)
+
+enum { SIMD_LEVEL_BASELINE, SIMD_LEVEL_AVX2, SIMD_LEVEL_AVX512 };
+
+/* The widest vector extension that this CPU supports and that we have code
+   for.  The compiler runtime runs cpuid once at startup, so this is cheap
+   enough to ask whenever a run turns out to be long.
+*/
+static int
+simdCpuLevel(void) {
+  if (__builtin_cpu_supports("avx512bw"))
+    return SIMD_LEVEL_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_LEVEL_AVX2;
+  return SIMD_LEVEL_BASELINE;
+}
+
+__attribute__((target("avx2"))) static const char *
+simdSkipPlainAvx2(const char *ptr, const char *end, int lowest, char c1,
+                  char c2, char c3) {
+  const __m256i vLowest = _mm256_set1_epi8((char)lowest);
+  const __m256i v1 = _mm256_set1_epi8(c1);
+  const __m256i v2 = _mm256_set1_epi8(c2);
+  const __m256i v3 = _mm256_set1_epi8(c3);
+  while (end - ptr >= 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    /* NOTE: Comparison is signed, so bytes >=0x80 count as less than lowest */
+    const __m256i special = _mm256_or_si256(
+        _mm256_cmpgt_epi8(vLowest, v),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, v1),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, v2),
+                                        _mm256_cmpeq_epi8(v, v3))));
+    const unsigned mask = (unsigned)_mm256_movemask_epi8(special);
+    if (mask != 0)
+      return ptr + simdLowestBit(mask);
+    ptr += 32;
+  }
+  return ptr;
+}
+
+#    endif /* defined(XML_SIMD_AVX2) */
+
+#    if defined(XML_SIMD_AVX512)
+
+__attribute__((target("avx512bw"))) static const char *
+simdSkipPlainAvx512(const char *ptr, const char *end, int lowest, char c1,
+                    char c2, char c3) {
+  const __m512i vLowest = _mm512_set1_epi8((char)lowest);
+  const __m512i v1 = _mm512_set1_epi8(c1);
+  const __m512i v2 = _mm512_set1_epi8(c2);
+  const __m512i v3 = _mm512_set1_epi8(c3);
+  while (end - ptr >= 64) {
+    const __m512i v = _mm512_loadu_si512((const void *)ptr);
+    /* NOTE: Comparison is signed, so bytes >=0x80 count as less than lowest */
+    const unsigned long long mask
+        = (unsigned long long)(_mm512_cmplt_epi8_mask(v, vLowest)
+                               | _mm512_cmpeq_epi8_mask(v, v1)
+                               | _mm512_cmpeq_epi8_mask(v, v2)
+                               | _mm512_cmpeq_epi8_mask(v, v3));
+    if (mask != 0)
+      return ptr + simdLowestBit(mask);
+    ptr += 64;
+  }
+  return ptr;
+}
+
+#    endif /* defined(XML_SIMD_AVX512) */
+
+/* Returns a pointer to the first byte in [ptr, end) that is not plain
+   (see SIMD_IS_PLAIN above), or end if all of them are.
+*/
+static const char *
+simdSkipPlain(const char *ptr, const char *end, int lowest, char c1, char c2,
+              char c3) {
+  {
+    /* Runs of a few bytes are common, so look at these before bothering
+       with vector registers */
+    const char *const shortEnd = (end - ptr > 8) ? ptr + 8 : end;
+    for (; ptr < shortEnd; ptr++) {
+      const unsigned char b = (unsigned char)*ptr;
+      if (! SIMD_IS_PLAIN(b, lowest, c1, c2, c3))
+        return ptr;
+    }
+  }
+#    if defined(XML_SIMD_SSE2)
+  {
+    const __m128i vLowest = _mm_set1_epi8((char)lowest);
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    const __m128i v3 = _mm_set1_epi8(c3);
+#      if defined(XML_SIMD_AVX2)
+    int wideTried = 0;
+#      endif
+    while (end - ptr >= 16) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+      /* NOTE: Comparison is signed, so bytes >=0x80 count as less than
+               lowest */
+      const __m128i special = _mm_or_si128(
+          _mm_cmplt_epi8(v, vLowest),
+          _mm_or_si128(_mm_cmpeq_epi8(v, v1),
+                       _mm_or_si128(_mm_cmpeq_epi8(v, v2),
+                                    _mm_cmpeq_epi8(v, v3))));
+      const unsigned mask = (unsigned)_mm_movemask_epi8(special);
+      if (mask != 0)
+        return ptr + simdLowestBit(mask);
+      ptr += 16;
+#      if defined(XML_SIMD_AVX2)
+      /* Most runs are short, so wider vectors only pay off after the first
+         block */
+      if (! wideTried && end - ptr >= 64) {
+        wideTried = 1;
+        switch (simdCpuLevel()) {
+#        if defined(XML_SIMD_AVX512)
+        case SIMD_LEVEL_AVX512:
+          ptr = simdSkipPlainAvx512(ptr, end, lowest, c1, c2, c3);
+          break;
+#        endif
+        case SIMD_LEVEL_AVX2:
+          ptr = simdSkipPlainAvx2(ptr, end, lowest, c1, c2, c3);
+          break;
+        default:
+          break;
+        }
+      }
+#      endif
+    }
+  }
+#    elif defined(XML_SIMD_NEON)
+  {
+    const int8x16_t vLowest = vdupq_n_s8((signed char)lowest);
+    const uint8x16_t v1 = vdupq_n_u8((unsigned char)c1);
+    const uint8x16_t v2 = vdupq_n_u8((unsigned char)c2);
+    const uint8x16_t v3 = vdupq_n_u8((unsigned char)c3);
+    while (end - ptr >= 16) {
+      const uint8x16_t v = vld1q_u8((const unsigned char *)ptr);
+      /* NOTE: Comparison is signed, so bytes >=0x80 count as less than
+               lowest */
+      const uint8x16_t special
+          = vorrq_u8(vcltq_s8(vreinterpretq_s8_u8(v), vLowest),
+                     vorrq_u8(vceqq_u8(v, v1),
+                              vorrq_u8(vceqq_u8(v, v2), vceqq_u8(v, v3))));
+      /* Narrow to 4 bits per byte to get a 64-bit mask */
+      const unsigned long long mask = vget_lane_u64(
+          vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)),
+          0);
+      if (mask != 0)
+        return ptr + simdLowestBit(mask) / 4;
+      ptr += 16;
+    }
+  }
+#    endif
+  for (; ptr < end; ptr++) {
+    const unsigned char b = (unsigned char)*ptr;
+    if (! SIMD_IS_PLAIN(b, lowest, c1, c2, c3))
+      break;
+  }
+  return ptr;
+}
+
+/* Returns a pointer past the run of well-formed multi-byte UTF-8 characters
+   at ptr.  The run ends at the first US-ASCII byte, at anything malformed,
+   at U+FFFE and U+FFFF (which are not XML characters, see UTF8_INVALID3 in
+   xmltok.c) and at a character that is cut off by end.
+*/
+static const char *
+simdSkipUtf8Chars(const char *ptr, const char *end) {
+  while (ptr < end) {
+    const unsigned char *const p = (const unsigned char *)ptr;
+    if (p[0] < 0xC2) // US-ASCII, trail bytes and overlong 0xC0 and 0xC1
+      break;
+    if (p[0] < 0xE0) {
+      if (end - ptr < 2 || (p[1] & 0xC0) != 0x80)
+        break;
+      ptr += 2;
+    } else if (p[0] < 0xF0) {
+      if (end - ptr < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80
+          || (p[0] == 0xE0 && p[1] < 0xA0) || (p[0] == 0xED && p[1] > 0x9F)
+          || (p[0] == 0xEF && p[1] == 0xBF && p[2] > 0xBD))
+        break;
+      ptr += 3;
+    } else {
+      if (p[0] > 0xF4 || end - ptr < 4 || (p[1] & 0xC0) != 0x80
+          || (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80
+          || (p[0] == 0xF0 && p[1] < 0x90) || (p[0] == 0xF4 && p[1] > 0x8F))
+        break;
+      ptr += 4;
+    }
+  }
+  return ptr;
+}
+
+#    if defined(XML_SIMD_AVX2)
+
+/* Bytes [n..31] of input preceded by the last n bytes of prevInput */
+#      define SIMD_PREV_AVX2(input, prevInput, n)                              \
+        _mm256_alignr_epi8(                                                    \
+            (input), _mm256_permute2x128_si256((prevInput), (input), 0x21),    \
+            16 - (n))
+
+/* Validates 32 bytes at a time using the lookup algorithm from
+   John Keiser and Daniel Lemire, "Validating UTF-8 In Less Than One
+   Instruction Per Byte", Software: Practice and Experience 51(5), 2021.
+   Each byte is classified by the high nibble of the byte before it, the low
+   nibble of the byte before it and its own high nibble; only the bits
+   common to all three lookups describe an error.
+*/
+__attribute__((target("avx2"))) static const char *
+simdSkipUtf8Avx2(const char *ptr, const char *end, int lowest, char c1,
+                 char c2, char c3) {
+  enum {
+    TOO_SHORT = 1 << 0,  // 11______ 0_______ and 11______ 11______
+    TOO_LONG = 1 << 1,   // 0_______ 10______
+    OVERLONG_3 = 1 << 2, // 11100000 100_____
+    TOO_LARGE = 1 << 3,  // 11110100 1001____ and up
+    SURROGATE = 1 << 4,  // 11101101 101_____
+    OVERLONG_2 = 1 << 5, // 1100000_ 10______
+    TOO_LARGE_1000 = 1 << 6, // 11110101 1000____ and up
+    OVERLONG_4 = 1 << 6,     // 11110000 1000____
+    TWO_CONTS = 1 << 7,      // 10______ 10______
+    CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+    LARGE = TOO_LARGE | TOO_LARGE_1000,
+    CONT = TOO_LONG | OVERLONG_2 | TWO_CONTS
+  };
+  static const unsigned char byte1HighTable[16] = {
+      // 0_______ ________
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TOO_LONG,
+      // 10______ ________
+      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      // 1100____ ________
+      TOO_SHORT | OVERLONG_2,
+      // 1101____ ________
+      TOO_SHORT,
+      // 1110____ ________
+      TOO_SHORT | OVERLONG_3 | SURROGATE,
+      // 1111____ ________
+      TOO_SHORT | LARGE | OVERLONG_4};
+  static const unsigned char byte1LowTable[16] = {
+      // ____0000 ________
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+      // ____0001 ________
+      CARRY | OVERLONG_2,
+      // ____001_ ________
+      CARRY, CARRY,
+      // ____0100 ________
+      CARRY | TOO_LARGE,
+      // ____0101 ________ and up
+      CARRY | LARGE, CARRY | LARGE, CARRY | LARGE, CARRY | LARGE,
+      CARRY | LARGE, CARRY | LARGE, CARRY | LARGE, CARRY | LARGE,
+      // ____1101 ________
+      CARRY | LARGE | SURROGATE,
+      // ____111_ ________
+      CARRY | LARGE, CARRY | LARGE};
+  static const unsigned char byte2HighTable[16] = {
+      // ________ 0_______
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT,
+      // ________ 1000____
+      CONT | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+      // ________ 1001____
+      CONT | OVERLONG_3 | TOO_LARGE,
+      // ________ 101_____
+      CONT | SURROGATE | TOO_LARGE, CONT | SURROGATE | TOO_LARGE,
+      // ________ 11______
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+  const __m256i byte1High = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)byte1HighTable));
+  const __m256i byte1Low = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)byte1LowTable));
+  const __m256i byte2High = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)byte2HighTable));
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i vLowest = _mm256_set1_epi8((char)lowest);
+  const __m256i v1 = _mm256_set1_epi8(c1);
+  const __m256i v2 = _mm256_set1_epi8(c2);
+  const __m256i v3 = _mm256_set1_epi8(c3);
+  const char *const start = ptr;
+  __m256i prevInput = zero; // ptr is at the start of a character
+  while (end - ptr >= 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+    const __m256i prev1 = SIMD_PREV_AVX2(v, prevInput, 1);
+    const __m256i prev2 = SIMD_PREV_AVX2(v, prevInput, 2);
+    const __m256i prev3 = SIMD_PREV_AVX2(v, prevInput, 3);
+    const __m256i specialCases = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte1High, _mm256_and_si256(
+                                               _mm256_srli_epi16(prev1, 4),
+                                               nibble)),
+            _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte2High,
+                            _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+    /* Third and fourth bytes have to be trail bytes, which is exactly where
+       the lookup above flags two trail bytes in a row */
+    const __m256i mustBeTrail = _mm256_and_si256(
+        _mm256_or_si256(
+            _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))),
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)))),
+        _mm256_set1_epi8((char)0x80));
+    /* U+FFFE and U+FFFF are well-formed UTF-8 but not XML characters */
+    const __m256i vBF = _mm256_set1_epi8((char)0xBF);
+    const __m256i nonXml = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi8(prev2, _mm256_set1_epi8((char)0xEF)),
+                         _mm256_cmpeq_epi8(prev1, vBF)),
+        _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(1)), vBF));
+    /* NOTE: Comparison is signed, so bytes >=0x80 have to be masked out */
+    const __m256i special = _mm256_or_si256(
+        _mm256_andnot_si256(_mm256_cmpgt_epi8(zero, v),
+                            _mm256_cmpgt_epi8(vLowest, v)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, v1),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, v2),
+                                        _mm256_cmpeq_epi8(v, v3))));
+    const __m256i error = _mm256_or_si256(
+        _mm256_or_si256(_mm256_xor_si256(mustBeTrail, specialCases), nonXml),
+        special);
+    if (! _mm256_testz_si256(error, error))
+      break;
+    prevInput = v;
+    ptr += 32;
+  }
+  /* The last character before ptr may be cut off or may be followed by
+     an error that belongs to it, so we leave it to the caller */
+  if (ptr > start) {
+    const char *lead = ptr - 1;
+    while (lead > start && ((unsigned char)*lead & 0xC0) == 0x80)
+      lead--;
+    if ((unsigned char)*lead >= 0xC0)
+      ptr = lead;
+  }
+  return ptr;
+}
+
+#    endif /* defined(XML_SIMD_AVX2) */
+
+/* Like simdSkipPlain, but also skips well-formed multi-byte UTF-8 */
+static const char *
+simdSkipPlainUtf8(const char *ptr, const char *end, int lowest, char c1,
+                  char c2, char c3) {
+  for (;;) {
+    ptr = simdSkipPlain(ptr, end, lowest, c1, c2, c3);
+    if (ptr == end || (unsigned char)*ptr < 0x80)
+      return ptr;
+    const char *const start = ptr;
+#    if defined(XML_SIMD_AVX2)
+    if (end - ptr >= 64 && simdCpuLevel() >= SIMD_LEVEL_AVX2)
+      ptr = simdSkipUtf8Avx2(ptr, end, lowest, c1, c2, c3);
+#    endif
+    ptr = simdSkipUtf8Chars(ptr, end);
+    if (ptr == start)
+      return ptr;
+  }
+}
+
+/* Takes a block of 16 bytes described by masks with stride bits per byte:
+   carriage returns, line feeds and bytes that do not start a character.
+   Line and column are counted like in PREFIX(updatePosition), where a
+   CR LF pair is a single line break; *afterCr carries a CR from the end of
+   the previous block.
+*/
+static void
+simdPositionStep(unsigned long long cr, unsigned long long lf,
+                 unsigned long long trail, unsigned stride, POSITION *pos,
+                 int *afterCr) {
+  const unsigned long long lowByte = (1ULL << stride) - 1;
+  const unsigned long long all = (stride == 4) ? ~0ULL : 0xFFFFULL;
+  const unsigned long long breaks = cr | lf;
+  lf &= ~((cr << stride) | (*afterCr ? lowByte : 0));
+  pos->lineNumber += (simdPopCount(cr) + simdPopCount(lf)) / stride;
+  if (breaks != 0) {
+    const unsigned last = simdHighestBit(breaks) / stride; // byte index
+    pos->columnNumber
+        = (last == 15) ? 0
+                       : simdPopCount((all & ~trail) >> ((last + 1) * stride))
+                             / stride;
+  } else
+    pos->columnNumber += simdPopCount(all & ~trail) / stride;
+  *afterCr = (int)((cr >> (15 * stride)) & 1);
+}
+
+/* Updates pos for the characters in [ptr, end), which have to be
+   US-ASCII with CR and LF as the only line breaks, and either UTF-8
+   (if utf8 is non-zero) or a single-byte encoding otherwise.
+   Returns end.
+*/
+static const char *
+simdUpdatePosition(const char *ptr, const char *end, int utf8,
+                   POSITION *pos) {
+  int afterCr = 0;
+#    if defined(XML_SIMD_SSE2)
+  const __m128i vCr = _mm_set1_epi8(0x0D);
+  const __m128i vLf = _mm_set1_epi8(0x0A);
+  const __m128i vTrailMask = _mm_set1_epi8((char)0xC0);
+  const __m128i vTrail = _mm_set1_epi8((char)0x80);
+  while (end - ptr >= 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+    const unsigned cr = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vCr));
+    const unsigned lf = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vLf));
+    const unsigned trail
+        = utf8 ? (unsigned)_mm_movemask_epi8(
+                     _mm_cmpeq_epi8(_mm_and_si128(v, vTrailMask), vTrail))
+               : 0;
+    simdPositionStep(cr, lf, trail, 1, pos, &afterCr);
+    ptr += 16;
+  }
+#    elif defined(XML_SIMD_NEON)
+  const uint8x16_t vCr = vdupq_n_u8(0x0D);
+  const uint8x16_t vLf = vdupq_n_u8(0x0A);
+  const uint8x16_t vTrailMask = vdupq_n_u8(0xC0);
+  const uint8x16_t vTrail = vdupq_n_u8(0x80);
+  while (end - ptr >= 16) {
+    const uint8x16_t v = vld1q_u8((const unsigned char *)ptr);
+    /* Narrow to 4 bits per byte to get 64-bit masks */
+#      define SIMD_MASK_NEON(m)                                                \
+        vget_lane_u64(                                                         \
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0)
+    const unsigned long long cr = SIMD_MASK_NEON(vceqq_u8(v, vCr));
+    const unsigned long long lf = SIMD_MASK_NEON(vceqq_u8(v, vLf));
+    const unsigned long long trail
+        = utf8 ? SIMD_MASK_NEON(vceqq_u8(vandq_u8(v, vTrailMask), vTrail)) : 0;
+#      undef SIMD_MASK_NEON
+    simdPositionStep(cr, lf, trail, 4, pos, &afterCr);
+    ptr += 16;
+  }
+#    endif
+  for (; ptr < end; ptr++) {
+    const unsigned char b = (unsigned char)*ptr;
+    if (b == 0x0D) {
+      pos->lineNumber++;
+      pos->columnNumber = 0;
+    } else if (b == 0x0A) {
+      if (! afterCr) {
+        pos->lineNumber++;
+        pos->columnNumber = 0;
+      }
+    } else if (! utf8 || (b & 0xC0) != 0x80)
+      pos->columnNumber++;
+    afterCr = (b == 0x0D);
+  }
+  return end;
+}
+
+#  endif /* XML_SIMD */
+
+#endif /* not XmlTokSimd_INCLUDED */
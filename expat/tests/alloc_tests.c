@@ -404,6 +404,41 @@ START_TEST(test_alloc_external_entity) {
 }
 END_TEST
 
+START_TEST(test_alloc_dtd_cache) {
+  const char *text = "<!DOCTYPE doc SYSTEM 'http://example.org/doc.dtd'>\n"
+                     "<doc>&e;</doc>";
+  const char *dtd = "<!ENTITY e 'text'><!ATTLIST doc a CDATA 'x'>";
+  XML_Memory_Handling_Suite memsuite = {duff_allocator, realloc, free};
+  int i;
+  const int alloc_test_max_repeats = 50;
+
+  XML_DTDCache cache = XML_DTDCacheCreate(&memsuite);
+  assert_true(cache != NULL);
+  for (i = 0; i < alloc_test_max_repeats; i++) {
+    XML_SetParamEntityParsing(g_parser, XML_PARAM_ENTITY_PARSING_ALWAYS);
+    XML_SetExternalEntityRefHandler(g_parser, external_entity_alloc);
+    XML_SetUserData(g_parser, (void *)dtd);
+    XML_SetDTDCache(g_parser, cache);
+    g_allocation_count = i;
+    if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+        == XML_STATUS_OK)
+      break;
+    /* See comment in test_alloc_parse_xdecl() */
+    alloc_teardown();
+    alloc_setup();
+  }
+  g_allocation_count = -1;
+  if (i == 0)
+    fail("DTD cache filled despite duff allocator");
+  if (i == alloc_test_max_repeats)
+    fail("DTD cache not filled at max allocation count");
+  /* The parser is freed before the cache it uses */
+  alloc_teardown();
+  alloc_setup();
+  XML_DTDCacheFree(cache);
+}
+END_TEST
+
 /* Test more allocation failure paths */
 START_TEST(test_alloc_ext_entity_set_encoding) {
   const char *text = "<!DOCTYPE doc [\n"
@@ -1685,7 +1720,7 @@ START_TEST(test_alloc_nested_entities) {
          "Memory Fail not faulted", NULL, XML_ERROR_NO_MEMORY};
 
   /* Causes an allocation error in a nested storeEntityValue() */
-  g_allocation_count = 12;
+  g_allocation_count = 8;
   XML_SetUserData(g_parser, &test_data);
   XML_SetParamEntityParsing(g_parser, XML_PARAM_ENTITY_PARSING_ALWAYS);
   XML_SetExternalEntityRefHandler(g_parser, external_entity_faulter);
@@ -1786,7 +1821,7 @@ START_TEST(test_alloc_realloc_ce_extends_pe) {
 }
 END_TEST
 
-START_TEST(test_alloc_realloc_attributes) {
+START_TEST(test_alloc_default_attributes) {
   const char *text = "<!DOCTYPE doc [\n"
                      "  <!ATTLIST doc\n"
                      "    a1  (a|b|c)   'a'\n"
@@ -1802,10 +1837,10 @@ START_TEST(test_alloc_realloc_attributes) {
                      "  >]>\n"
                      "<doc>wombat</doc>\n";
   int i;
-  const int max_realloc_count = 5;
+  const int max_alloc_count = 20;
 
-  for (i = 0; i < max_realloc_count; i++) {
-    g_reallocation_count = i;
+  for (i = 0; i < max_alloc_count; i++) {
+    g_allocation_count = i;
     if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
         != XML_STATUS_ERROR)
       break;
@@ -1815,9 +1850,9 @@ START_TEST(test_alloc_realloc_attributes) {
   }
 
   if (i == 0)
-    fail("Parse succeeded despite failing reallocator");
-  if (i == max_realloc_count)
-    fail("Parse failed at maximum reallocation count");
+    fail("Parse succeeded despite failing allocator");
+  if (i == max_alloc_count)
+    fail("Parse failed at maximum allocation count");
 }
 END_TEST
 
@@ -2094,6 +2129,48 @@ START_TEST(test_alloc_reset_after_external_entity_parser_create_fail) {
 }
 END_TEST
 
+/* Test that an error in a buffer parsed in place keeps its code when
+   there is no memory to keep its context */
+START_TEST(test_alloc_parse_external_buffer_error) {
+  const char *const text = "<doc><e></f></doc>";
+  int i;
+  const int max_alloc_count = 20;
+
+  for (i = 0; i < max_alloc_count; i++) {
+    g_allocation_count = i;
+    if (XML_ParseExternalBuffer(g_parser, text, (int)strlen(text), XML_TRUE)
+        != XML_STATUS_ERROR)
+      fail("Mismatched tag not faulted");
+    if (XML_GetErrorCode(g_parser) == XML_ERROR_TAG_MISMATCH) {
+      if (XML_GetCurrentColumnNumber(g_parser) != 10)
+        fail("Error column number incorrect");
+#if XML_CONTEXT_BYTES > 0
+      int offset, size;
+      const char *const context
+          = XML_GetInputContext(g_parser, &offset, &size);
+      if (context != NULL) {
+        if (offset != 10 || size != (int)strlen(text)
+            || memcmp(context, text, size) != 0)
+          fail("Context incorrect");
+        break;
+      }
+      if (XML_GetCurrentByteIndex(g_parser) != -1)
+        fail("Byte index without context");
+#else
+      break;
+#endif
+    } else if (XML_GetErrorCode(g_parser) != XML_ERROR_NO_MEMORY)
+      xml_failure(g_parser);
+    alloc_teardown();
+    alloc_setup();
+  }
+  if (i == 0)
+    fail("Parse succeeded despite failing allocator");
+  if (i == max_alloc_count)
+    fail("Parse failed with max allocations");
+}
+END_TEST
+
 #if XML_GE == 1
 static size_t
 sizeRecordedFor(void *ptr) {
@@ -2331,6 +2408,7 @@ make_alloc_test_case(Suite *s) {
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_run_external_parser);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_dtd_copy_default_atts);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_external_entity);
+  tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_dtd_cache);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_ext_entity_set_encoding);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_internal_entity);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_parameter_entity);
@@ -2370,7 +2448,7 @@ make_alloc_test_case(Suite *s) {
   tcase_add_test__ifdef_xml_dtd(tc_alloc,
                                 test_alloc_realloc_param_entity_newline);
   tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_realloc_ce_extends_pe);
-  tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_realloc_attributes);
+  tcase_add_test__ifdef_xml_dtd(tc_alloc, test_alloc_default_attributes);
   tcase_add_test(tc_alloc, test_alloc_long_doc_name);
   tcase_add_test__if_xml_ge(tc_alloc, test_alloc_long_base);
   tcase_add_test__if_xml_ge(tc_alloc, test_alloc_long_public_id);
@@ -2379,6 +2457,7 @@ make_alloc_test_case(Suite *s) {
 
   tcase_add_test__ifdef_xml_dtd(
       tc_alloc, test_alloc_reset_after_external_entity_parser_create_fail);
+  tcase_add_test(tc_alloc, test_alloc_parse_external_buffer_error);
 
   tcase_add_test__if_xml_ge(tc_alloc, test_alloc_tracker_size_recorded);
   tcase_add_test__if_xml_ge(tc_alloc, test_alloc_tracker_pointer_alignment);
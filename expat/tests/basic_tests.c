@@ -748,6 +748,73 @@ START_TEST(test_column_number_after_error) {
 }
 END_TEST
 
+START_TEST(test_line_and_column_numbers_in_long_lines) {
+  const struct {
+    const char *raw;
+    int lineBreaks;
+    int columns; /* when there are no line breaks */
+  } cases[] = {
+      {"\n", 1, 0},
+      {"\r", 1, 0},
+      {"\r\n", 1, 0},
+      {"\n\r", 2, 0},
+      {"\r\r", 2, 0},
+      {"\n\n", 2, 0},
+      {"\r\n\r\n", 2, 0},
+      {"\t", 0, 1},
+      {"&#13;", 0, 5},
+      {"\xC3\xA9", 0, 1},
+      {"\xE4\xB8\xAD", 0, 1},
+      {"\xF0\x9D\x84\x9E", 0, 1},
+  };
+  const int textLength = 100;
+  size_t i;
+  int offset;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    for (offset = 0; offset < textLength; offset++) {
+      char text[256];
+      int textLen = 0;
+      int k;
+      StructData storage;
+      StructDataEntry expected[]
+          = {{XCS("d"), 0, 1, STRUCT_START_TAG},
+             {XCS("e"), 0, 0, STRUCT_START_TAG}};
+
+      set_subtest("case %d, offset %d", (int)i, offset);
+      memcpy(text + textLen, "<d>", 3);
+      textLen += 3;
+      for (k = 0; k < textLength; k++) {
+        if (k == offset) {
+          memcpy(text + textLen, cases[i].raw, strlen(cases[i].raw));
+          textLen += (int)strlen(cases[i].raw);
+        }
+        text[textLen++] = 'a';
+      }
+      memcpy(text + textLen, "<e/></d>", 8);
+      textLen += 8;
+      if (cases[i].lineBreaks) {
+        expected[1].data0 = textLength - offset;
+        expected[1].data1 = 1 + cases[i].lineBreaks;
+      } else {
+        expected[1].data0 = 3 + textLength + cases[i].columns;
+        expected[1].data1 = 1;
+      }
+
+      XML_ParserReset(g_parser, NULL);
+      StructData_Init(&storage);
+      XML_SetUserData(g_parser, &storage);
+      XML_SetStartElementHandler(g_parser, start_element_event_handler2);
+      if (_XML_Parse_SINGLE_BYTES(g_parser, text, textLen, XML_TRUE)
+          == XML_STATUS_ERROR)
+        xml_failure(g_parser);
+      StructData_CheckItems(&storage, expected, 2);
+      StructData_Dispose(&storage);
+    }
+  }
+}
+END_TEST
+
 /* Regression test for SF bug #478332. */
 START_TEST(test_really_long_lines) {
   /* This parses an input line longer than INIT_DATA_BUF_SIZE
@@ -827,6 +894,221 @@ START_TEST(test_really_long_encoded_lines) {
 }
 END_TEST
 
+/* Shared fixture for the tests below: each case's raw text is placed at
+ * every offset of a long run of filler between prefix and suffix, in
+ * particular at every offset relative to the blocks that the vectorized
+ * scanners work on.  Well-formed cases must report the expected text
+ * around the filler through the handlers that setup installs, between
+ * expectedPrefix and expectedSuffix when given; malformed ones must be
+ * rejected, at the column where they sit when errorAtOffset is set.
+ * Without setup, only well-formedness is checked.
+ */
+typedef struct {
+  const char *raw;
+  const char *expected; /* NULL for documents that are not well-formed */
+} LongTextCase;
+
+typedef struct {
+  const char *prefix;
+  const char *suffix;
+  /* Returns the character for position k of the run, ASCII unless
+     setup is NULL */
+  const char *(*filler)(int k, int offset);
+  void (*setup)(XML_Parser parser);
+  const XML_Char *expectedPrefix;
+  const XML_Char *expectedSuffix;
+  XML_Bool errorAtOffset;
+} LongTextFixture;
+
+#define LONG_TEXT_LENGTH 100
+
+static const char *
+split_filler(int k, int offset) {
+  return (k < offset) ? "a" : "b";
+}
+
+static void
+check_cases_in_long_text(const LongTextFixture *fixture,
+                         const LongTextCase *cases, size_t count) {
+  size_t i;
+  int offset;
+
+  for (i = 0; i < count; i++) {
+    for (offset = 0; offset < LONG_TEXT_LENGTH; offset++) {
+      char text[512];
+      XML_Char expected[512];
+      CharData storage;
+      int textLen = 0;
+      int expectedLen = 0;
+      int k;
+      const char *p;
+      const XML_Char *q;
+      XML_Parser parser = XML_ParserCreate(NULL);
+      assert_true(parser != NULL);
+
+      set_subtest("%s case %d, offset %d", fixture->prefix, (int)i, offset);
+      memcpy(text, fixture->prefix, strlen(fixture->prefix));
+      textLen += (int)strlen(fixture->prefix);
+      if (fixture->expectedPrefix != NULL)
+        for (q = fixture->expectedPrefix; *q != 0; q++)
+          expected[expectedLen++] = *q;
+      for (k = 0; k < LONG_TEXT_LENGTH; k++) {
+        const char *const filler = fixture->filler(k, offset);
+        if (k == offset) {
+          memcpy(text + textLen, cases[i].raw, strlen(cases[i].raw));
+          textLen += (int)strlen(cases[i].raw);
+          if (cases[i].expected != NULL)
+            for (p = cases[i].expected; *p != '\0'; p++)
+              expected[expectedLen++] = (XML_Char)*p;
+        }
+        memcpy(text + textLen, filler, strlen(filler));
+        textLen += (int)strlen(filler);
+        for (p = filler; *p != '\0'; p++)
+          expected[expectedLen++] = (XML_Char)*p;
+      }
+      memcpy(text + textLen, fixture->suffix, strlen(fixture->suffix));
+      textLen += (int)strlen(fixture->suffix);
+      if (fixture->expectedSuffix != NULL)
+        for (q = fixture->expectedSuffix; *q != 0; q++)
+          expected[expectedLen++] = *q;
+      expected[expectedLen] = 0;
+
+      CharData_Init(&storage);
+      XML_SetUserData(parser, &storage);
+      if (fixture->setup != NULL)
+        fixture->setup(parser);
+      if (cases[i].expected == NULL) {
+        if (_XML_Parse_SINGLE_BYTES(parser, text, textLen, XML_TRUE)
+            != XML_STATUS_ERROR)
+          fail("Malformed document not rejected");
+        if (fixture->errorAtOffset
+            && (XML_GetCurrentLineNumber(parser) != 1
+                || XML_GetCurrentColumnNumber(parser)
+                       != strlen(fixture->prefix) + (XML_Size)offset))
+          fail("Malformed document reported in the wrong place");
+      } else {
+        if (_XML_Parse_SINGLE_BYTES(parser, text, textLen, XML_TRUE)
+            == XML_STATUS_ERROR)
+          xml_failure(parser);
+        if (fixture->setup != NULL)
+          CharData_CheckXMLChars(&storage, expected);
+      }
+      XML_ParserFree(parser);
+    }
+  }
+}
+
+static void
+setup_long_text(XML_Parser parser) {
+  XML_SetCharacterDataHandler(parser, accumulate_characters);
+}
+
+START_TEST(test_special_chars_in_long_text) {
+  const LongTextCase cases[] = {
+      {"&amp;", "&"}, {"&#x41;", "A"}, {"<x/>", ""},   {"\r\n", "\n"},
+      {"\r", "\n"},  {"\n", "\n"},    {"\t", "\t"}, {"]", "]"},
+      {"]]", "]]"},   {"]]>", NULL},   {"\x01", NULL}, {"\x80", NULL},
+  };
+  const LongTextFixture fixture
+      = {"<d>", "</d>", split_filler, setup_long_text, NULL, NULL, XML_FALSE};
+
+  check_cases_in_long_text(&fixture, cases, sizeof(cases) / sizeof(cases[0]));
+}
+END_TEST
+
+static void
+setup_long_attribute_value(XML_Parser parser) {
+  XML_SetStartElementHandler(parser, accumulate_attribute);
+}
+
+START_TEST(test_special_chars_in_long_attribute_value) {
+  const LongTextCase cases[] = {
+      {"&amp;", "&"}, {"&#x41;", "A"}, {" ", " "},      {"  ", "  "},
+      {"\t", " "},    {"\n", " "},     {"\r\n", " "},   {"'", "'"},
+      {">", ">"},     {"&quot;", "\""}, {"\"", NULL},    {"<", NULL},
+      {"\x01", NULL}, {"\x80", NULL},
+  };
+  /* A second attribute makes sure the first one ends where it should */
+  const LongTextFixture fixture
+      = {"<d a=\"", "\" b='x'/>", split_filler, setup_long_attribute_value,
+         NULL, NULL, XML_FALSE};
+
+  check_cases_in_long_text(&fixture, cases, sizeof(cases) / sizeof(cases[0]));
+}
+END_TEST
+
+static void
+setup_long_markup(XML_Parser parser) {
+  XML_SetCommentHandler(parser, accumulate_comment);
+  XML_SetProcessingInstructionHandler(parser, accumulate_pi_characters);
+  XML_SetCharacterDataHandler(parser, accumulate_characters);
+}
+
+START_TEST(test_special_chars_in_long_markup) {
+  const LongTextCase commentCases[] = {
+      {"-", "-"},   {"\r\n", "\n"}, {"\t", "\t"},   {"?>", "?>"},
+      {"]]>", "]]>"}, {"--", NULL},   {"\x01", NULL}, {"\x80", NULL},
+  };
+  const LongTextCase piCases[] = {
+      {"?", "?"},     {"x\r\n", "x\n"}, {"-->", "-->"},
+      {"]]>", "]]>"}, {"\x01", NULL},   {"\x80", NULL},
+  };
+  const LongTextCase cdataCases[] = {
+      {"]", "]"},   {"]]", "]]"},     {"]>", "]>"},   {"\r\n", "\n"},
+      {"<&", "<&"}, {"\x01", NULL}, {"\x80", NULL},
+  };
+  const LongTextFixture comment
+      = {"<d><!--", "--></d>", split_filler, setup_long_markup,
+         NULL, NULL, XML_FALSE};
+  /* accumulate_pi_characters reports "target: data\n" */
+  const LongTextFixture pi
+      = {"<d><?t ", "?></d>", split_filler, setup_long_markup,
+         XCS("t: "), XCS("\n"), XML_FALSE};
+  const LongTextFixture cdata
+      = {"<d><![CDATA[", "]]></d>", split_filler, setup_long_markup,
+         NULL, NULL, XML_FALSE};
+
+  check_cases_in_long_text(&comment, commentCases,
+                           sizeof(commentCases) / sizeof(commentCases[0]));
+  check_cases_in_long_text(&pi, piCases, sizeof(piCases) / sizeof(piCases[0]));
+  check_cases_in_long_text(&cdata, cdataCases,
+                           sizeof(cdataCases) / sizeof(cdataCases[0]));
+}
+END_TEST
+
+/* U+4E2D, so that runs are long enough for the vectorized validator */
+static const char *
+cjk_filler(int k, int offset) {
+  UNUSED_P(offset);
+  return (k % 10 == 9) ? "a" : "\xE4\xB8\xAD";
+}
+
+START_TEST(test_utf8_in_long_text) {
+  /* The expected text is not checked, only whether it is NULL */
+  const LongTextCase cases[] = {
+      {"\xC3\xA9", ""},               /* U+00E9 */
+      {"\xEF\xBF\xBD", ""},           /* U+FFFD */
+      {"\xF0\x9D\x84\x9E", ""},       /* U+1D11E */
+      {"\xF4\x8F\xBF\xBF", ""},       /* U+10FFFF */
+      {"&amp;", ""},                  /* stops the bulk scan */
+      {"\xEF\xBF\xBE", NULL},         /* U+FFFE */
+      {"\xEF\xBF\xBF", NULL},         /* U+FFFF */
+      {"\xED\xA0\x80", NULL},         /* surrogate */
+      {"\xC0\x80", NULL},             /* overlong */
+      {"\xE0\x80\x80", NULL},         /* overlong */
+      {"\xF0\x80\x80\x80", NULL},     /* overlong */
+      {"\xF4\x90\x80\x80", NULL},     /* too large */
+      {"\xF8\x88\x80\x80\x80", NULL}, /* too long */
+      {"\x80", NULL},                 /* stray trail byte */
+      {"\xE4\xB8", NULL},             /* cut off */
+  };
+  const LongTextFixture fixture
+      = {"<d>", "</d>", cjk_filler, NULL, NULL, NULL, XML_TRUE};
+
+  check_cases_in_long_text(&fixture, cases, sizeof(cases) / sizeof(cases[0]));
+}
+END_TEST
+
 /*
  * Element event tests.
  */
@@ -3557,6 +3839,410 @@ START_TEST(test_getbuffer_allocates_on_zero_len) {
 }
 END_TEST
 
+/* Test that XML_ParseExternalBuffer is done with the input when it returns,
+   however the document is split up */
+START_TEST(test_parse_external_buffer) {
+  const char *const text
+      = "<?xml version='1.0' encoding='utf-8'?>\n"
+        "<doc a='value &amp; more'><e>hello &amp; world</e>"
+        "<![CDATA[<cdata>]]><!-- \xC3\xA9t\xC3\xA9 --><?pi data?>text</doc>";
+  const XML_Char *const expected = XCS("hello & world<cdata>text");
+  const int textLen = (int)strlen(text);
+  char scratch[64];
+
+  for (int chunkSize = 1; chunkSize <= (int)sizeof(scratch); chunkSize++) {
+    set_subtest("chunk size %d", chunkSize);
+    CharData storage;
+    CharData_Init(&storage);
+    XML_Parser parser = XML_ParserCreate(NULL);
+    assert_true(parser != NULL);
+    XML_SetUserData(parser, &storage);
+    XML_SetCharacterDataHandler(parser, accumulate_characters);
+    for (int offset = 0; offset < textLen; offset += chunkSize) {
+      const int len
+          = (textLen - offset < chunkSize) ? textLen - offset : chunkSize;
+      memcpy(scratch, text + offset, len);
+      if (XML_ParseExternalBuffer(parser, scratch, len, XML_FALSE)
+          == XML_STATUS_ERROR)
+        xml_failure(parser);
+      /* Anything read from here on would break the document */
+      memset(scratch, '<', sizeof(scratch));
+    }
+    if (XML_ParseExternalBuffer(parser, NULL, 0, XML_TRUE) == XML_STATUS_ERROR)
+      xml_failure(parser);
+    CharData_CheckXMLChars(&storage, expected);
+    if (XML_GetCurrentByteIndex(parser) != (XML_Index)textLen)
+      fail("Terminal byte index incorrect");
+    XML_ParserFree(parser);
+  }
+}
+END_TEST
+
+/* Test suspending and resuming with XML_ParseExternalBuffer, both while
+   parsing in place and while completing a token cut off before */
+START_TEST(test_parse_external_buffer_suspend) {
+  const char *const head = "<doc><sus";
+  const char *const tail = "pend/>";
+  const int textCount = 1500; // more than is copied to complete a token
+  const int len = (int)strlen(tail) + textCount + (int)strlen("</doc>");
+  char *const scratch = (char *)malloc(len);
+  assert_true(scratch != NULL);
+
+  for (int split = 0; split <= 1; split++) {
+    set_subtest("%s", split ? "split" : "in place");
+    CharData storage;
+    CharData_Init(&storage);
+    XML_ParserReset(g_parser, NULL);
+    XML_SetUserData(g_parser, &storage);
+    XML_SetStartElementHandler(g_parser, start_element_suspender);
+    XML_SetCharacterDataHandler(g_parser, accumulate_characters);
+    if (split) {
+      memcpy(scratch, head, strlen(head));
+      if (XML_ParseExternalBuffer(g_parser, scratch, (int)strlen(head),
+                                  XML_FALSE)
+          != XML_STATUS_OK)
+        xml_failure(g_parser);
+    } else {
+      if (XML_ParseExternalBuffer(g_parser, "<doc>", 5, XML_FALSE)
+          != XML_STATUS_OK)
+        xml_failure(g_parser);
+      memcpy(scratch, "<sus", 4);
+      if (XML_ParseExternalBuffer(g_parser, scratch, 4, XML_FALSE)
+          != XML_STATUS_OK)
+        xml_failure(g_parser);
+    }
+    memcpy(scratch, tail, strlen(tail));
+    memset(scratch + strlen(tail), 'a', textCount);
+    memcpy(scratch + strlen(tail) + textCount, "</doc>", strlen("</doc>"));
+    if (XML_ParseExternalBuffer(g_parser, scratch, len, XML_TRUE)
+        != XML_STATUS_SUSPENDED)
+      fail("Parser not suspended");
+    memset(scratch, '<', len);
+    if (XML_ResumeParser(g_parser) != XML_STATUS_OK)
+      xml_failure(g_parser);
+    assert_true(storage.count == textCount);
+  }
+  free(scratch);
+}
+END_TEST
+
+/* Test position information from errors with XML_ParseExternalBuffer;
+   like for XML_Parse, the error is reported at the mismatched name, and
+   the context outlives the buffer */
+START_TEST(test_parse_external_buffer_error) {
+  const char *const text = "<doc>\n  <e></f>\n</doc>";
+  char *const scratch = (char *)malloc(strlen(text));
+  assert_true(scratch != NULL);
+  memcpy(scratch, text, strlen(text));
+
+  if (XML_ParseExternalBuffer(g_parser, scratch, (int)strlen(text), XML_TRUE)
+      != XML_STATUS_ERROR)
+    fail("Mismatched tag not faulted");
+  free(scratch);
+  if (XML_GetErrorCode(g_parser) != XML_ERROR_TAG_MISMATCH)
+    xml_failure(g_parser);
+#if XML_CONTEXT_BYTES > 0
+  int offset, size;
+  const char *const context = XML_GetInputContext(g_parser, &offset, &size);
+  if (context == NULL)
+    fail("Context not kept");
+  if (offset != 13 || size != (int)strlen(text))
+    fail("Context offset or size incorrect");
+  if (memcmp(context, text, size) != 0)
+    fail("Context incorrect");
+#endif
+  if (XML_GetCurrentLineNumber(g_parser) != 2)
+    fail("Error line number incorrect");
+  if (XML_GetCurrentColumnNumber(g_parser) != 7)
+    fail("Error column number incorrect");
+  if (XML_GetCurrentByteIndex(g_parser) != 13)
+    fail("Error byte index incorrect");
+  if (XML_GetCurrentByteCount(g_parser) != 0)
+    fail("Error byte count incorrect");
+}
+END_TEST
+
+/* Test that only XML_CONTEXT_BYTES on either side of an error in a long
+   buffer parsed in place are kept as context */
+START_TEST(test_parse_external_buffer_error_long) {
+  const int textLength = 10000;
+  const int errorIndex = 5000;
+  char *const text = (char *)malloc(textLength);
+  assert_true(text != NULL);
+  memset(text, 'a', textLength);
+  memcpy(text, "<doc>", 5);
+  memcpy(text + errorIndex - 2, "</f>", 4);
+
+  if (XML_ParseExternalBuffer(g_parser, text, textLength, XML_FALSE)
+      != XML_STATUS_ERROR)
+    fail("Mismatched tag not faulted");
+  if (XML_GetErrorCode(g_parser) != XML_ERROR_TAG_MISMATCH)
+    xml_failure(g_parser);
+#if XML_CONTEXT_BYTES > 0
+  const int kept = (XML_CONTEXT_BYTES < errorIndex) ? XML_CONTEXT_BYTES
+                                                    : errorIndex;
+  int offset, size;
+  const char *const context = XML_GetInputContext(g_parser, &offset, &size);
+  if (context == NULL)
+    fail("Context not kept");
+  if (offset != kept || size != 2 * kept)
+    fail("Context offset or size incorrect");
+  if (memcmp(context, text + errorIndex - kept, size) != 0)
+    fail("Context incorrect");
+#endif
+  free(text);
+  if (XML_GetCurrentColumnNumber(g_parser) != (XML_Size)errorIndex)
+    fail("Error column number incorrect");
+  if (XML_GetCurrentByteIndex(g_parser) != errorIndex)
+    fail("Error byte index incorrect");
+}
+END_TEST
+
+/* Test that coalescing reports a block of text in a single call, however
+   it is split up by lines, references, CDATA sections and parse calls */
+START_TEST(test_coalesce_character_data) {
+  const char *const text = "<!DOCTYPE doc [<!ENTITY e 'in'>]>\n"
+                           "<doc>a&amp;b\r\n&#65;&e;c<![CDATA[x]]>y</doc>";
+  const XML_Char *const expected = XCS("a&b\nAincxy");
+  struct handler_record_list storage;
+  storage.count = 0;
+  CharData chardata;
+  CharData_Init(&chardata);
+
+  if (XML_SetCharacterDataCoalescing(NULL, XML_TRUE))
+    fail("XML_SetCharacterDataCoalescing accepted NULL parser");
+  if (XML_SetCharacterDataCoalescing(g_parser, 2))
+    fail("XML_SetCharacterDataCoalescing accepted invalid value");
+  if (! XML_SetCharacterDataCoalescing(g_parser, XML_TRUE))
+    fail("XML_SetCharacterDataCoalescing failed");
+  XML_SetUserData(g_parser, &storage);
+  XML_SetCharacterDataHandler(g_parser, record_cdata_nodefault_handler);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  assert_record_handler_called(&storage, 0, "record_cdata_nodefault_handler",
+                               (int)xcstrlen(expected));
+  assert_true(storage.count == 1);
+
+  XML_ParserReset(g_parser, NULL);
+  XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+  XML_SetUserData(g_parser, &chardata);
+  XML_SetCharacterDataHandler(g_parser, accumulate_characters);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&chardata, expected);
+}
+END_TEST
+
+/* Test that markup ends coalesced text, and that the text is reported
+   before the markup that ends it */
+START_TEST(test_coalesce_character_data_order) {
+  const char *const text = "<doc>ab<e/>cd<!--c-->ef<?pi?>gh</doc>";
+  struct handler_record_list storage;
+  storage.count = 0;
+
+  XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+  XML_SetUserData(g_parser, &storage);
+  XML_SetCharacterDataHandler(g_parser, record_cdata_nodefault_handler);
+  XML_SetDefaultHandler(g_parser, record_default_handler);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  int i = 0;
+  assert_record_handler_called(&storage, i++, "record_default_handler", 5);
+  assert_record_handler_called(&storage, i++, "record_cdata_nodefault_handler",
+                               2);
+  assert_record_handler_called(&storage, i++, "record_default_handler", 4);
+  assert_record_handler_called(&storage, i++, "record_cdata_nodefault_handler",
+                               2);
+  assert_record_handler_called(&storage, i++, "record_default_handler", 8);
+  assert_record_handler_called(&storage, i++, "record_cdata_nodefault_handler",
+                               2);
+  assert_record_handler_called(&storage, i++, "record_default_handler", 6);
+  assert_record_handler_called(&storage, i++, "record_cdata_nodefault_handler",
+                               2);
+  assert_record_handler_called(&storage, i++, "record_default_handler", 6);
+  assert_true(storage.count == i);
+
+  /* Without any other handler, markup still ends the text */
+  XML_ParserReset(g_parser, NULL);
+  storage.count = 0;
+  XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+  XML_SetUserData(g_parser, &storage);
+  XML_SetCharacterDataHandler(g_parser, record_cdata_nodefault_handler);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  assert_true(storage.count == 4);
+  for (i = 0; i < storage.count; i++)
+    assert_record_handler_called(&storage, i, "record_cdata_nodefault_handler",
+                                 2);
+}
+END_TEST
+
+static void XMLCALL
+stopping_coalesced_character_handler(void *userData, const XML_Char *s,
+                                     int len) {
+  CharData_AppendXMLChars((CharData *)userData, s, len);
+  /* The position is where the text ends, not the markup after it */
+  assert_true(XML_GetCurrentColumnNumber(g_parser) == 12);
+  XML_StopParser(g_parser, g_resumable);
+}
+
+/* Test that stopping or suspending the parser while coalesced text is
+   reported takes effect before the markup that ended the text */
+START_TEST(test_coalesce_character_data_stop) {
+  const char *const text = "<doc>a&amp;b<x/><y/></doc>";
+  CharData storage;
+
+  CharData_Init(&storage);
+  g_resumable = XML_FALSE;
+  XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+  XML_SetUserData(g_parser, &storage);
+  XML_SetStartElementHandler(g_parser, record_element_start_handler);
+  XML_SetCharacterDataHandler(g_parser, stopping_coalesced_character_handler);
+  if (XML_Parse(g_parser, text, (int)strlen(text), XML_TRUE)
+      != XML_STATUS_ERROR)
+    fail("Stopping from the coalesced text handler was ignored");
+  if (XML_GetErrorCode(g_parser) != XML_ERROR_ABORTED)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&storage, XCS("doca&b"));
+
+  XML_ParserReset(g_parser, NULL);
+  CharData_Init(&storage);
+  g_resumable = XML_TRUE;
+  XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+  XML_SetUserData(g_parser, &storage);
+  XML_SetStartElementHandler(g_parser, record_element_start_handler);
+  XML_SetCharacterDataHandler(g_parser, stopping_coalesced_character_handler);
+  if (XML_Parse(g_parser, text, (int)strlen(text), XML_TRUE)
+      != XML_STATUS_SUSPENDED)
+    fail("Suspending from the coalesced text handler was ignored");
+  CharData_CheckXMLChars(&storage, XCS("doca&b"));
+  if (XML_ResumeParser(g_parser) != XML_STATUS_OK)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&storage, XCS("doca&bxy"));
+}
+END_TEST
+
+static void XMLCALL
+stopping_character_handler(void *userData, const XML_Char *s, int len) {
+  CharData_AppendXMLChars((CharData *)userData, s, len);
+  XML_StopParser(g_parser, XML_FALSE);
+}
+
+static void XMLCALL
+accumulate_default_text(void *userData, const XML_Char *s, int len) {
+  CharData_AppendXMLChars((CharData *)userData, s, len);
+}
+
+static int XMLCALL
+external_entity_not_expected(XML_Parser parser, const XML_Char *context,
+                             const XML_Char *base, const XML_Char *systemId,
+                             const XML_Char *publicId) {
+  UNUSED_P(parser);
+  UNUSED_P(context);
+  UNUSED_P(base);
+  UNUSED_P(systemId);
+  UNUSED_P(publicId);
+  fail("External entity reference reported after the parser was stopped");
+  return XML_STATUS_ERROR;
+}
+
+/* Test that stopping the parser while coalesced text is reported also
+   keeps entity references and the default handler from being reported */
+START_TEST(test_coalesce_character_data_stop_before_entity) {
+  const struct {
+    const char *text;
+    XML_Bool useDefaultHandler;
+    const XML_Char *expected;
+  } cases[] = {
+      {"<!DOCTYPE doc [<!ENTITY x SYSTEM 'x.ent'>]>\n<doc>abc&x;</doc>",
+       XML_FALSE, XCS("abc")},
+      {"<!DOCTYPE doc SYSTEM 'doc.dtd'>\n<doc>abc&undeclared;</doc>",
+       XML_FALSE, XCS("abc")},
+      {"<doc>abc<![CDATA[d]]></doc>", XML_TRUE, XCS("<doc>abc")},
+  };
+  CharData storage;
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    XML_ParserReset(g_parser, NULL);
+    CharData_Init(&storage);
+    init_dummy_handlers();
+    XML_SetCharacterDataCoalescing(g_parser, XML_TRUE);
+    XML_SetUserData(g_parser, &storage);
+    XML_SetCharacterDataHandler(g_parser, stopping_character_handler);
+    XML_SetExternalEntityRefHandler(g_parser, external_entity_not_expected);
+    XML_SetSkippedEntityHandler(g_parser, dummy_skip_handler);
+    if (cases[i].useDefaultHandler)
+      XML_SetDefaultHandler(g_parser, accumulate_default_text);
+    if (XML_Parse(g_parser, cases[i].text, (int)strlen(cases[i].text),
+                  XML_TRUE)
+        != XML_STATUS_ERROR)
+      fail("Stopping from the coalesced text handler was ignored");
+    if (XML_GetErrorCode(g_parser) != XML_ERROR_ABORTED)
+      xml_failure(g_parser);
+    CharData_CheckXMLChars(&storage, cases[i].expected);
+    if (get_dummy_handler_flags() != 0)
+      fail("Skipped entity reported after the parser was stopped");
+  }
+}
+END_TEST
+
+/* Test that lookups keep working while the hash tables grow, and after
+   XML_ParserReset has emptied them */
+static void
+check_many_entities(void) {
+  const int count = 1000;
+  char text[32000];
+  XML_Char expected[1024];
+  int len = snprintf(text, sizeof(text), "<!DOCTYPE doc [\n");
+  for (int i = 0; i < count; i++)
+    len += snprintf(text + len, sizeof(text) - len,
+                    "<!ENTITY e%d '%c'>\n", i, 'a' + i % 26);
+  len += snprintf(text + len, sizeof(text) - len, "]>\n<doc>");
+  for (int i = count - 1; i >= 0; i--) {
+    len += snprintf(text + len, sizeof(text) - len, "&e%d;", i);
+    expected[count - 1 - i] = (XML_Char)('a' + i % 26);
+  }
+  len += snprintf(text + len, sizeof(text) - len, "</doc>");
+  assert_true(len < (int)sizeof(text));
+  expected[count] = 0;
+
+  run_character_check(text, expected);
+  XML_ParserReset(g_parser, NULL);
+  run_character_check(text, expected);
+}
+
+START_TEST(test_many_entities) {
+  check_many_entities();
+}
+END_TEST
+
+/* Test that hash tables switch over to SipHash when names collide */
+START_TEST(test_many_entities_colliding_hashes) {
+  g_fastHashCollides = XML_TRUE;
+  check_many_entities();
+  g_fastHashCollides = XML_FALSE;
+}
+END_TEST
+
+/* Test that element types and attribute IDs found by their raw names
+   are not carried over from one document to the next */
+START_TEST(test_name_lookup_after_reset) {
+  const char *const withDefault
+      = "<!DOCTYPE d [<!ATTLIST d a CDATA 'dtd'>]>\n<d/>";
+  const char *const withoutDefault = "<d/>";
+
+  run_attribute_check(withDefault, XCS("dtd"));
+  XML_ParserReset(g_parser, NULL);
+  run_attribute_check(withoutDefault, XCS(""));
+  XML_ParserReset(g_parser, NULL);
+  run_attribute_check(withDefault, XCS("dtd"));
+}
+END_TEST
+
 /* Test position information macros */
 START_TEST(test_byte_info_at_end) {
   const char *text = "<doc></doc>";
@@ -5412,6 +6098,119 @@ START_TEST(test_utf8_in_start_tags) {
 }
 END_TEST
 
+static void XMLCALL
+record_start_element_ids(void *userData, const XML_Char *name, int nameId,
+                         const XML_Char **atts, const int *attIds) {
+  CharData *const storage = (CharData *)userData;
+
+  if (nameId != XML_GetSymbolId(g_parser, name))
+    fail("Element name came with the wrong symbol ID");
+  CharData_AppendXMLChars(storage, name, -1);
+  for (int i = 0; atts[2 * i] != NULL; i++) {
+    if (attIds[i] != XML_GetSymbolId(g_parser, atts[2 * i]))
+      fail("Attribute name came with the wrong symbol ID");
+    CharData_AppendXMLChars(storage, XCS(" "), 1);
+    CharData_AppendXMLChars(storage, atts[2 * i], -1);
+  }
+}
+
+static void XMLCALL
+record_end_element_ids(void *userData, const XML_Char *name, int nameId) {
+  CharData *const storage = (CharData *)userData;
+
+  if (nameId != XML_GetSymbolId(g_parser, name))
+    fail("Element name came with the wrong symbol ID");
+  CharData_AppendXMLChars(storage, XCS("/"), 1);
+  CharData_AppendXMLChars(storage, name, -1);
+}
+
+/* Test that the element ID handlers get the symbol IDs of all names,
+   including those of default attributes and those registered up front */
+START_TEST(test_element_id_handlers) {
+  const char *text = "<!DOCTYPE a [<!ATTLIST b d CDATA 'x'>]>\n"
+                     "<a c='1'><b c='2'/><b></b></a>";
+  const XML_Char *expected = XCS("a c") XCS("b c d/b") XCS("b d/b/a");
+  CharData storage;
+
+  const int bId = XML_GetSymbolId(g_parser, XCS("b"));
+  if (bId != 1)
+    fail("First symbol did not get ID 1");
+  CharData_Init(&storage);
+  XML_SetElementIdHandler(g_parser, record_start_element_ids,
+                          record_end_element_ids);
+  XML_SetUserData(g_parser, &storage);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&storage, expected);
+  if (XML_GetSymbolId(g_parser, XCS("b")) != bId)
+    fail("Symbol ID changed while parsing");
+  if (XML_GetSymbolId(g_parser, XCS("d")) != 4)
+    fail("Symbols did not get consecutive IDs");
+
+  XML_ParserReset(g_parser, NULL);
+  if (XML_GetSymbolId(g_parser, XCS("d")) != 1)
+    fail("Symbol IDs were not handed out anew after XML_ParserReset");
+  if (XML_GetSymbolId(NULL, XCS("d")) != 0 || XML_GetSymbolId(g_parser, NULL))
+    fail("XML_GetSymbolId accepted NULL");
+}
+END_TEST
+
+/* Test that names in a vocabulary get their fixed symbol IDs, and that
+   names outside of it get the IDs after those */
+START_TEST(test_element_id_handlers_vocabulary) {
+  const XML_Char *const names[]
+      = {XCS("x"),     XCS("doc"),   XCS("item"), XCS("id"),    XCS("name"),
+         XCS("value"), XCS("title"), XCS("list"), XCS("entry"), XCS("d"),
+         NULL};
+  const int count = (int)(sizeof(names) / sizeof(names[0])) - 1;
+  const char *text = "<!DOCTYPE doc [<!ATTLIST item d CDATA 'x'>]>\n"
+                     "<doc id='1'><item name='a'/><other value='b'>"
+                     "<item other='c'></item></other></doc>";
+  const XML_Char *expected = XCS("doc id") XCS("item name d/item")
+      XCS("other value") XCS("item other d/item/other/doc");
+  CharData storage;
+
+  XML_Vocabulary vocabulary = XML_VocabularyCreate(names, NULL);
+  if (vocabulary == NULL)
+    fail("XML_VocabularyCreate failed");
+  if (! XML_SetVocabulary(g_parser, vocabulary))
+    fail("XML_SetVocabulary failed");
+  for (int i = 0; i < count; i++) {
+    if (XML_GetSymbolId(g_parser, names[i]) != i + 1)
+      fail("Name in vocabulary did not get its index as symbol ID");
+  }
+
+  CharData_Init(&storage);
+  XML_SetElementIdHandler(g_parser, record_start_element_ids,
+                          record_end_element_ids);
+  XML_SetUserData(g_parser, &storage);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&storage, expected);
+  if (XML_GetSymbolId(g_parser, XCS("item")) != 3)
+    fail("Symbol ID of name in vocabulary changed while parsing");
+  if (XML_GetSymbolId(g_parser, XCS("other")) != count + 1)
+    fail("Name outside vocabulary did not get the next symbol ID");
+
+  /* The vocabulary survives XML_ParserReset, but not past given out IDs */
+  XML_ParserReset(g_parser, NULL);
+  if (XML_GetSymbolId(g_parser, XCS("entry")) != 9)
+    fail("Vocabulary was dropped by XML_ParserReset");
+  if (XML_GetSymbolId(g_parser, XCS("other")) != count + 1)
+    fail("Symbol IDs after vocabulary were not handed out anew");
+  if (XML_SetVocabulary(g_parser, NULL))
+    fail("XML_SetVocabulary succeeded after handing out symbol IDs");
+  XML_ParserReset(g_parser, NULL);
+  if (! XML_SetVocabulary(g_parser, NULL))
+    fail("XML_SetVocabulary failed to detach vocabulary");
+  if (XML_GetSymbolId(g_parser, XCS("entry")) != 1)
+    fail("Vocabulary was not detached");
+  XML_VocabularyFree(vocabulary);
+}
+END_TEST
+
 /* Test trailing spaces in elements are accepted */
 START_TEST(test_trailing_spaces_in_elements) {
   const char *text = "<doc   >Hi</doc >";
@@ -6741,8 +7540,13 @@ make_basic_test_case(Suite *s) {
   tcase_add_test(tc_basic, test_line_and_column_numbers_inside_handlers);
   tcase_add_test(tc_basic, test_line_number_after_error);
   tcase_add_test(tc_basic, test_column_number_after_error);
+  tcase_add_test(tc_basic, test_line_and_column_numbers_in_long_lines);
   tcase_add_test(tc_basic, test_really_long_lines);
   tcase_add_test(tc_basic, test_really_long_encoded_lines);
+  tcase_add_test(tc_basic, test_special_chars_in_long_text);
+  tcase_add_test(tc_basic, test_special_chars_in_long_attribute_value);
+  tcase_add_test(tc_basic, test_special_chars_in_long_markup);
+  tcase_add_test(tc_basic, test_utf8_in_long_text);
   tcase_add_test(tc_basic, test_end_element_events);
   tcase_add_test(tc_basic, test_helper_is_whitespace_normalized);
   tcase_add_test(tc_basic, test_attr_whitespace_normalization);
@@ -6839,6 +7643,18 @@ make_basic_test_case(Suite *s) {
 #endif
   tcase_add_test(tc_basic, test_buffer_can_grow_to_max);
   tcase_add_test(tc_basic, test_getbuffer_allocates_on_zero_len);
+  tcase_add_test(tc_basic, test_parse_external_buffer);
+  tcase_add_test(tc_basic, test_parse_external_buffer_suspend);
+  tcase_add_test(tc_basic, test_parse_external_buffer_error);
+  tcase_add_test(tc_basic, test_parse_external_buffer_error_long);
+  tcase_add_test__if_xml_ge(tc_basic, test_coalesce_character_data);
+  tcase_add_test(tc_basic, test_coalesce_character_data_order);
+  tcase_add_test(tc_basic, test_coalesce_character_data_stop);
+  tcase_add_test__if_xml_ge(tc_basic,
+                            test_coalesce_character_data_stop_before_entity);
+  tcase_add_test__if_xml_ge(tc_basic, test_many_entities);
+  tcase_add_test__if_xml_ge(tc_basic, test_many_entities_colliding_hashes);
+  tcase_add_test(tc_basic, test_name_lookup_after_reset);
   tcase_add_test(tc_basic, test_byte_info_at_end);
   tcase_add_test(tc_basic, test_byte_info_at_error);
   tcase_add_test(tc_basic, test_byte_info_at_cdata);
@@ -6931,6 +7747,8 @@ make_basic_test_case(Suite *s) {
   tcase_add_test(tc_basic, test_utf8_in_cdata_section);
   tcase_add_test(tc_basic, test_utf8_in_cdata_section_2);
   tcase_add_test(tc_basic, test_utf8_in_start_tags);
+  tcase_add_test(tc_basic, test_element_id_handlers);
+  tcase_add_test(tc_basic, test_element_id_handlers_vocabulary);
   tcase_add_test(tc_basic, test_trailing_spaces_in_elements);
   tcase_add_test(tc_basic, test_utf16_attribute);
   tcase_add_test(tc_basic, test_utf16_second_attr);
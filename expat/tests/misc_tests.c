@@ -56,12 +56,23 @@
 #include <assert.h>
 #include <string.h>
 
+#if defined(XML_POOL_LOCKING) && ! defined(_WIN32)
+#  include <pthread.h>
+#endif
+
+#if defined(HAVE_PTHREAD_ATFORK)
+#  include <sys/types.h> /* pid_t */
+#  include <sys/wait.h>  /* waitpid */
+#  include <unistd.h>    /* fork, pipe */
+#endif
+
 #include "expat.h"
 #include "internal.h"
 #include "minicheck.h"
 #include "memcheck.h"
 #include "common.h"
 #include "ascii.h" /* for ASCII_xxx */
+#include "dummy.h"
 #include "handlers.h"
 #include "misc_tests.h"
 
@@ -957,6 +968,1306 @@ START_TEST(test_misc_input_2gb) {
 }
 END_TEST
 
+START_TEST(test_misc_parser_pool) {
+  const char *const text = "<doc xmlns='http://example.org/'>text</doc>";
+  XML_ParserPool pool = XML_ParserPoolCreate(NULL, NULL, XCS("|"), 1);
+  assert_true(pool != NULL);
+
+  XML_Parser first = XML_ParserPoolAcquire(pool);
+  assert_true(first != NULL);
+  CharData storage;
+  CharData_Init(&storage);
+  XML_SetUserData(first, &storage);
+  XML_SetStartElementHandler(first, start_element_event_handler);
+  XML_SetCharacterDataHandler(first, accumulate_characters);
+  XML_SetReturnNSTriplet(first, XML_TRUE);
+  if (_XML_Parse_SINGLE_BYTES(first, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(first);
+  CharData_CheckXMLChars(&storage, XCS("http://example.org/|doctext"));
+  assert_true(XML_ParserPoolRelease(pool, first) == XML_TRUE);
+
+  /* The parser comes back reset, without handlers */
+  XML_Parser second = XML_ParserPoolAcquire(pool);
+  assert_true(second == first);
+  CharData_Init(&storage);
+  XML_SetUserData(second, &storage);
+  XML_SetStartElementHandler(second, start_element_event_handler);
+  if (_XML_Parse_SINGLE_BYTES(second, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(second);
+  CharData_CheckXMLChars(&storage, XCS("http://example.org/|doc"));
+
+  /* With the pool empty, a new parser is created; with the pool full,
+     a released parser is freed */
+  XML_Parser third = XML_ParserPoolAcquire(pool);
+  assert_true(third != NULL);
+  assert_true(third != second);
+  assert_true(XML_ParserPoolRelease(pool, second) == XML_TRUE);
+  assert_true(XML_ParserPoolRelease(pool, third) == XML_TRUE);
+
+  assert_true(XML_ParserPoolRelease(NULL, third) == XML_FALSE);
+  assert_true(XML_ParserPoolRelease(pool, NULL) == XML_FALSE);
+  assert_true(XML_ParserPoolAcquire(NULL) == NULL);
+  XML_ParserPoolFree(pool);
+  XML_ParserPoolFree(NULL);
+}
+END_TEST
+
+START_TEST(test_misc_alloc_parser_pool) {
+  XML_Memory_Handling_Suite memsuite = {duff_allocator, realloc, free};
+  XML_ParserPool pool = NULL;
+  unsigned int i;
+  const unsigned int max_alloc_count = 10;
+
+  for (i = 0; i < max_alloc_count; i++) {
+    g_allocation_count = (int)i;
+    pool = XML_ParserPoolCreate(XCS("us-ascii"), &memsuite, NULL, 4);
+    if (pool != NULL)
+      break;
+  }
+  if (i == 0)
+    fail("Pool unexpectedly ignored failing allocator");
+  else if (i == max_alloc_count)
+    fail("Pool not created with max allocation count");
+
+  /* Parsers are created with the allocator of the pool */
+  g_allocation_count = 0;
+  assert_true(XML_ParserPoolAcquire(pool) == NULL);
+  g_allocation_count = ALLOC_ALWAYS_SUCCEED;
+  XML_Parser parser = XML_ParserPoolAcquire(pool);
+  assert_true(parser != NULL);
+  assert_true(XML_ParserPoolRelease(pool, parser) == XML_TRUE);
+  XML_ParserPoolFree(pool);
+}
+END_TEST
+
+#if defined(XML_POOL_LOCKING) && ! defined(_WIN32)
+struct pool_thread_data {
+  XML_ParserPool pool;
+  int rounds;
+  int failures;
+};
+
+static void XMLCALL
+count_characters(void *userData, const XML_Char *s, int len) {
+  UNUSED_P(s);
+  *(int *)userData += len;
+}
+
+static void *
+use_parser_pool(void *arg) {
+  struct pool_thread_data *const data = (struct pool_thread_data *)arg;
+  const char *const text = "<doc>text</doc>";
+  for (int i = 0; i < data->rounds; i++) {
+    XML_Parser parser = XML_ParserPoolAcquire(data->pool);
+    if (parser == NULL) {
+      data->failures++;
+      continue;
+    }
+    int chars = 0;
+    XML_SetUserData(parser, &chars);
+    XML_SetCharacterDataHandler(parser, count_characters);
+    if ((XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+         != XML_STATUS_OK)
+        || (chars != 4))
+      data->failures++;
+    if (! XML_ParserPoolRelease(data->pool, parser))
+      data->failures++;
+  }
+  return NULL;
+}
+
+/* Test that several threads can share a pool */
+START_TEST(test_misc_parser_pool_threads) {
+  enum { THREADS = 4 };
+  XML_ParserPool pool = XML_ParserPoolCreate(NULL, NULL, NULL, 2);
+  assert_true(pool != NULL);
+  pthread_t threads[THREADS];
+  struct pool_thread_data data[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    data[i].pool = pool;
+    data[i].rounds = 500;
+    data[i].failures = 0;
+    assert_true(pthread_create(&threads[i], NULL, use_parser_pool, &data[i])
+                == 0);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    assert_true(pthread_join(threads[i], NULL) == 0);
+    assert_true(data[i].failures == 0);
+  }
+  XML_ParserPoolFree(pool);
+}
+END_TEST
+#endif
+
+#if defined(HAVE_PTHREAD_ATFORK)
+/* Has a new parser take its hash salt, without the test framework so that
+   it can be used in a child process */
+static XML_Bool
+take_hash_salt(unsigned char salt[16]) {
+  XML_Parser parser = XML_ParserCreate(NULL);
+  if (parser == NULL)
+    return XML_FALSE;
+  const XML_Bool parsed
+      = (XML_Parse(parser, "", 0, XML_FALSE) == XML_STATUS_OK);
+  testingGetHashSalt(parser, salt);
+  XML_ParserFree(parser);
+  return parsed;
+}
+
+/* Test that a child process does not repeat the hash salts of its parent
+   after fork, even though salts are handed out from a batch */
+START_TEST(test_misc_hash_salt_after_fork) {
+  unsigned char parentSalt[16];
+  unsigned char childSalt[16];
+  int fds[2];
+
+  /* Have the batch of this thread filled before forking */
+  assert_true(take_hash_salt(parentSalt));
+  assert_true(pipe(fds) == 0);
+  const pid_t pid = fork();
+  assert_true(pid >= 0);
+  if (pid == 0) {
+    close(fds[0]);
+    const XML_Bool sent = take_hash_salt(childSalt)
+                          && (write(fds[1], childSalt, 16) == 16);
+    _exit(sent ? 0 : 1);
+  }
+  close(fds[1]);
+  assert_true(take_hash_salt(parentSalt));
+  assert_true(read(fds[0], childSalt, 16) == 16);
+  close(fds[0]);
+  int status;
+  assert_true(waitpid(pid, &status, 0) == pid);
+  assert_true(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+  assert_true(memcmp(parentSalt, childSalt, 16) != 0);
+}
+END_TEST
+#endif
+
+START_TEST(test_misc_vocabulary) {
+  enum { COUNT = 500 };
+  XML_Char chars[COUNT][8];
+  const XML_Char *names[COUNT + 1];
+  for (int i = 0; i < COUNT; i++) {
+    chars[i][0] = XCS('n');
+    chars[i][1] = (XML_Char)(XCS('0') + i / 100);
+    chars[i][2] = (XML_Char)(XCS('0') + i / 10 % 10);
+    chars[i][3] = (XML_Char)(XCS('0') + i % 10);
+    chars[i][4] = XCS('\0');
+    names[i] = chars[i];
+  }
+  names[COUNT] = NULL;
+  XML_Vocabulary vocabulary = XML_VocabularyCreate(names, NULL);
+  assert_true(vocabulary != NULL);
+
+  /* Parsers share the vocabulary */
+  XML_Parser parsers[2];
+  for (int p = 0; p < 2; p++) {
+    parsers[p] = XML_ParserCreate(NULL);
+    assert_true(XML_SetVocabulary(parsers[p], vocabulary) == XML_TRUE);
+  }
+  for (int i = 0; i < COUNT; i++) {
+    assert_true(XML_GetSymbolId(parsers[0], names[i]) == i + 1);
+    assert_true(XML_GetSymbolId(parsers[1], names[i]) == i + 1);
+  }
+  const char *const text = "<n001 n002='a'><n499/><other n002='b'/></n001>";
+  for (int p = 0; p < 2; p++) {
+    if (_XML_Parse_SINGLE_BYTES(parsers[p], text, (int)strlen(text), XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(parsers[p]);
+    assert_true(XML_SetVocabulary(parsers[p], NULL) == XML_FALSE);
+    XML_ParserFree(parsers[p]);
+  }
+
+  /* Parser pools do not pass the vocabulary on */
+  XML_ParserPool pool = XML_ParserPoolCreate(NULL, NULL, NULL, 1);
+  XML_Parser parser = XML_ParserPoolAcquire(pool);
+  assert_true(XML_SetVocabulary(parser, vocabulary) == XML_TRUE);
+  assert_true(XML_ParserPoolRelease(pool, parser) == XML_TRUE);
+  parser = XML_ParserPoolAcquire(pool);
+  assert_true(XML_GetSymbolId(parser, names[COUNT - 1]) == 1);
+  XML_ParserFree(parser);
+  XML_ParserPoolFree(pool);
+  XML_VocabularyFree(vocabulary);
+
+  const XML_Char *const duplicates[] = {XCS("a"), XCS("b"), XCS("a"), NULL};
+  assert_true(XML_VocabularyCreate(duplicates, NULL) == NULL);
+  assert_true(XML_VocabularyCreate(NULL, NULL) == NULL);
+  assert_true(XML_SetVocabulary(NULL, NULL) == XML_FALSE);
+  vocabulary = XML_VocabularyCreate(names + COUNT, NULL);
+  assert_true(vocabulary != NULL);
+  XML_VocabularyFree(vocabulary);
+  XML_VocabularyFree(NULL);
+}
+END_TEST
+
+START_TEST(test_misc_alloc_vocabulary) {
+  XML_Memory_Handling_Suite memsuite = {duff_allocator, realloc, free};
+  const XML_Char *const names[] = {XCS("a"), XCS("b"), XCS("c"), NULL};
+  XML_Vocabulary vocabulary = NULL;
+  unsigned int i;
+  const unsigned int max_alloc_count = 10;
+
+  for (i = 0; i < max_alloc_count; i++) {
+    g_allocation_count = (int)i;
+    vocabulary = XML_VocabularyCreate(names, &memsuite);
+    if (vocabulary != NULL)
+      break;
+  }
+  if (i == 0)
+    fail("Vocabulary unexpectedly ignored failing allocator");
+  else if (i == max_alloc_count)
+    fail("Vocabulary not created with max allocation count");
+  g_allocation_count = ALLOC_ALWAYS_SUCCEED;
+  XML_VocabularyFree(vocabulary);
+}
+END_TEST
+
+START_TEST(test_misc_dtd_snapshot) {
+  const char *const dtd = "<!DOCTYPE doc [\n"
+                          "<!ENTITY e 'entity text'>\n"
+                          "<!ENTITY ext SYSTEM 'ext.ent'>\n"
+                          "<!ATTLIST doc a CDATA 'default'>\n"
+                          "<!ATTLIST doc t NMTOKENS #IMPLIED>\n"
+                          "]>\n"
+                          "<doc/>";
+  XML_Parser parser = XML_ParserCreate(NULL);
+  XML_SetParamEntityParsing(parser, XML_PARAM_ENTITY_PARSING_ALWAYS);
+  if (_XML_Parse_SINGLE_BYTES(parser, dtd, (int)strlen(dtd), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  XML_DTDSnapshot snapshot = XML_DTDSnapshotCreate(parser);
+  assert_true(snapshot != NULL);
+  XML_ParserFree(parser);
+
+  /* Declarations in the snapshot come first, and are binding */
+  const char *const texts[] = {
+      "<doc>&e;</doc>",
+      "<!DOCTYPE doc [<!ENTITY e 'other'><!ATTLIST doc a CDATA 'x'>]>\n"
+      "<doc>&e;</doc>",
+  };
+  for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+    for (int round = 0; round < 2; round++) {
+      if (round == 0) {
+        parser = XML_ParserCreate(NULL);
+        assert_true(XML_SetDTDSnapshot(parser, snapshot) == XML_TRUE);
+      } else
+        /* The snapshot survives a reset */
+        assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+      CharData storage;
+      CharData_Init(&storage);
+      XML_SetUserData(parser, &storage);
+      XML_SetStartElementHandler(parser, accumulate_attribute);
+      XML_SetCharacterDataHandler(parser, accumulate_characters);
+      if (_XML_Parse_SINGLE_BYTES(parser, texts[i], (int)strlen(texts[i]),
+                                  XML_TRUE)
+          == XML_STATUS_ERROR)
+        xml_failure(parser);
+      CharData_CheckXMLChars(&storage, XCS("defaultentity text"));
+    }
+    assert_true(XML_SetDTDSnapshot(parser, NULL) == XML_FALSE);
+    XML_ParserFree(parser);
+  }
+
+  /* External entity parsers share the snapshot */
+  const char *const text = "<doc>&ext;</doc>";
+  CharData storage;
+  CharData_Init(&storage);
+  ExtTest test_data = {"&e;", NULL, &storage};
+  parser = XML_ParserCreate(NULL);
+  assert_true(XML_SetDTDSnapshot(parser, snapshot) == XML_TRUE);
+  XML_SetUserData(parser, &test_data);
+  XML_SetExternalEntityRefHandler(parser, external_entity_loader);
+  XML_SetCharacterDataHandler(parser, ext_accumulate_characters);
+  if (_XML_Parse_SINGLE_BYTES(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  CharData_CheckXMLChars(&storage, XCS("entity text"));
+  assert_true(XML_DTDSnapshotCreate(parser) == NULL);
+  XML_ParserFree(parser);
+
+  /* Attribute types of the snapshot apply, also once the document adds
+     attributes to an element type of the snapshot */
+  const char *const attTexts[] = {
+      "<doc t=' x  y '/>",
+      "<!DOCTYPE doc [<!ATTLIST doc b CDATA 'added' t CDATA 'no'>]>\n"
+      "<doc t=' x  y '/>",
+  };
+  const XML_Char *const attExpected[] = {
+      XCS("(doc(t=x y,a=default))\n"),
+      XCS("(doc(t=x y,a=default,b=added))\n"),
+  };
+  for (size_t i = 0; i < sizeof(attTexts) / sizeof(attTexts[0]); i++) {
+    parser = XML_ParserCreate(NULL);
+    assert_true(XML_SetDTDSnapshot(parser, snapshot) == XML_TRUE);
+    CharData_Init(&storage);
+    XML_SetUserData(parser, &storage);
+    XML_SetStartElementHandler(parser, accumulate_start_element);
+    if (_XML_Parse_SINGLE_BYTES(parser, attTexts[i], (int)strlen(attTexts[i]),
+                                XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(parser);
+    CharData_CheckXMLChars(&storage, attExpected[i]);
+    XML_ParserFree(parser);
+  }
+
+  /* Parser pools do not pass the snapshot on */
+  XML_ParserPool pool = XML_ParserPoolCreate(NULL, NULL, NULL, 1);
+  parser = XML_ParserPoolAcquire(pool);
+  assert_true(XML_SetDTDSnapshot(parser, snapshot) == XML_TRUE);
+  assert_true(XML_ParserPoolRelease(pool, parser) == XML_TRUE);
+  parser = XML_ParserPoolAcquire(pool);
+  assert_true(_XML_Parse_SINGLE_BYTES(parser, texts[0],
+                                      (int)strlen(texts[0]), XML_TRUE)
+              == XML_STATUS_ERROR);
+  assert_true(XML_GetErrorCode(parser) == XML_ERROR_UNDEFINED_ENTITY);
+  XML_ParserFree(parser);
+  XML_ParserPoolFree(pool);
+
+  parser = XML_ParserCreateNS(NULL, XCS('\n'));
+  assert_true(XML_SetDTDSnapshot(parser, snapshot) == XML_FALSE);
+  XML_ParserFree(parser);
+  assert_true(XML_SetDTDSnapshot(NULL, snapshot) == XML_FALSE);
+  assert_true(XML_DTDSnapshotCreate(NULL) == NULL);
+  XML_DTDSnapshotFree(snapshot);
+  XML_DTDSnapshotFree(NULL);
+}
+END_TEST
+
+static int g_dtd_cache_loads;
+
+static int XMLCALL
+external_subset_counter(XML_Parser parser, const XML_Char *context,
+                        const XML_Char *base, const XML_Char *systemId,
+                        const XML_Char *publicId) {
+  UNUSED_P(base);
+  UNUSED_P(systemId);
+  UNUSED_P(publicId);
+  g_dtd_cache_loads++;
+  return external_entity_loader(parser, context, base, systemId, publicId);
+}
+
+static void XMLCALL
+ext_accumulate_attribute(void *userData, const XML_Char *name,
+                         const XML_Char **atts) {
+  ExtTest *const test_data = (ExtTest *)userData;
+  accumulate_attribute(test_data->storage, name, atts);
+}
+
+static void
+parse_with_dtd_cache(XML_Parser parser, XML_DTDCache cache, const char *text,
+                     const XML_Char *expected) {
+  CharData storage;
+  CharData_Init(&storage);
+  ExtTest test_data = {"<!ENTITY e 'entity text'>\n"
+                       "<!ATTLIST doc a CDATA 'default'><!--c--><?p q?>",
+                       NULL, &storage};
+  XML_SetParamEntityParsing(parser, XML_PARAM_ENTITY_PARSING_ALWAYS);
+  assert_true(XML_SetDTDCache(parser, cache) == XML_TRUE);
+  XML_SetUserData(parser, &test_data);
+  XML_SetExternalEntityRefHandler(parser, external_subset_counter);
+  XML_SetStartElementHandler(parser, ext_accumulate_attribute);
+  XML_SetCharacterDataHandler(parser, ext_accumulate_characters);
+  if (_XML_Parse_SINGLE_BYTES(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  CharData_CheckXMLChars(&storage, expected);
+}
+
+START_TEST(test_misc_dtd_cache) {
+  const char *const text = "<!DOCTYPE doc SYSTEM 'doc.dtd'>\n"
+                           "<doc>&e;</doc>";
+  XML_DTDCache cache = XML_DTDCacheCreate(NULL);
+  assert_true(cache != NULL);
+  g_dtd_cache_loads = 0;
+
+  /* Only the first document reads the external subset */
+  XML_Parser parser = XML_ParserCreate(NULL);
+  for (int round = 0; round < 3; round++) {
+    if (round == 2)
+      assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+    else if (round == 1) {
+      XML_ParserFree(parser);
+      parser = XML_ParserCreate(NULL);
+    }
+    parse_with_dtd_cache(parser, cache, text, XCS("defaultentity text"));
+    assert_true(g_dtd_cache_loads == 1);
+  }
+
+  /* Parsers do not keep what they took from the cache across resets */
+  assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+  XML_SetParamEntityParsing(parser, XML_PARAM_ENTITY_PARSING_ALWAYS);
+  const char *const undeclared = "<doc>&e;</doc>";
+  assert_true(_XML_Parse_SINGLE_BYTES(parser, undeclared,
+                                      (int)strlen(undeclared), XML_TRUE)
+              == XML_STATUS_ERROR);
+  assert_true(XML_GetErrorCode(parser) == XML_ERROR_UNDEFINED_ENTITY);
+  assert_true(XML_SetDTDCache(parser, cache) == XML_FALSE);
+  XML_ParserFree(parser);
+
+  /* Other external subsets are read and kept separately */
+  const char *const others[] = {
+      "<!DOCTYPE doc PUBLIC 'pubid' 'doc.dtd'>\n<doc>&e;</doc>",
+      "<!DOCTYPE doc SYSTEM 'other.dtd'>\n<doc>&e;</doc>",
+  };
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+      parser = XML_ParserCreate(NULL);
+      parse_with_dtd_cache(parser, cache, others[i],
+                           XCS("defaultentity text"));
+      XML_ParserFree(parser);
+    }
+  }
+  assert_true(g_dtd_cache_loads == 3);
+
+  /* Internal subsets declaring something and declaration handlers keep
+     the cache from being used; empty internal subsets do not */
+  const char *const internal
+      = "<!DOCTYPE doc SYSTEM 'doc.dtd' [<!ENTITY e 'internal'>]>\n"
+        "<doc>&e;</doc>";
+  parser = XML_ParserCreate(NULL);
+  parse_with_dtd_cache(parser, cache, internal, XCS("defaultinternal"));
+  XML_ParserFree(parser);
+  assert_true(g_dtd_cache_loads == 4);
+  parser = XML_ParserCreate(NULL);
+  XML_SetEntityDeclHandler(parser, dummy_entity_decl_handler);
+  parse_with_dtd_cache(parser, cache, text, XCS("defaultentity text"));
+  XML_ParserFree(parser);
+  assert_true(g_dtd_cache_loads == 5);
+  const char *const empty = "<!DOCTYPE doc SYSTEM 'doc.dtd' [<!--x-->]>\n"
+                            "<doc>&e;</doc>";
+  parser = XML_ParserCreate(NULL);
+  parse_with_dtd_cache(parser, cache, empty, XCS("defaultentity text"));
+  XML_ParserFree(parser);
+  assert_true(g_dtd_cache_loads == 5);
+
+  /* So do handlers for what else is in the external subset */
+  init_dummy_handlers();
+  parser = XML_ParserCreate(NULL);
+  XML_SetCommentHandler(parser, dummy_comment_handler);
+  XML_SetProcessingInstructionHandler(parser, dummy_pi_handler);
+  parse_with_dtd_cache(parser, cache, text, XCS("defaultentity text"));
+  XML_ParserFree(parser);
+  assert_true(g_dtd_cache_loads == 6);
+  assert_true(get_dummy_handler_flags()
+              == (DUMMY_COMMENT_HANDLER_FLAG | DUMMY_PI_HANDLER_FLAG));
+
+  /* Parsers with namespace processing have entries of their own */
+  for (int round = 0; round < 2; round++) {
+    parser = XML_ParserCreateNS(NULL, XCS('\n'));
+    parse_with_dtd_cache(parser, cache, text, XCS("defaultentity text"));
+    XML_ParserFree(parser);
+  }
+  assert_true(g_dtd_cache_loads == 7);
+
+  assert_true(XML_SetDTDCache(NULL, cache) == XML_FALSE);
+  XML_DTDCacheFree(cache);
+  XML_DTDCacheFree(NULL);
+}
+END_TEST
+
+static unsigned int g_retention_allocs;
+static unsigned int g_retention_frees;
+static size_t g_retention_bytes; /* currently allocated */
+
+/* Keeps the size in front of each allocation */
+typedef union {
+  size_t size;
+  long double alignment1;
+  void *alignment2;
+} RetentionHeader;
+
+static void *
+retention_realloc(void *ptr, size_t size) {
+  RetentionHeader *header = NULL;
+  if (ptr != NULL) {
+    header = (RetentionHeader *)ptr - 1;
+    g_retention_bytes -= header->size;
+  }
+  header = realloc(header, sizeof(RetentionHeader) + size);
+  if (header == NULL)
+    return NULL;
+  g_retention_allocs++;
+  g_retention_bytes += size;
+  header->size = size;
+  return header + 1;
+}
+
+static void *
+retention_malloc(size_t size) {
+  return retention_realloc(NULL, size);
+}
+
+static void
+retention_free(void *ptr) {
+  if (ptr == NULL)
+    return;
+  RetentionHeader *const header = (RetentionHeader *)ptr - 1;
+  g_retention_frees++;
+  g_retention_bytes -= header->size;
+  free(header);
+}
+
+START_TEST(test_misc_memory_retention) {
+  const XML_Memory_Handling_Suite memsuite
+      = {retention_malloc, retention_realloc, retention_free};
+  const size_t valueLength = 100000;
+  char *const big = malloc(valueLength + 16);
+  assert_true(big != NULL);
+  memcpy(big, "<doc a='", 8);
+  memset(big + 8, 'x', valueLength);
+  memcpy(big + 8 + valueLength, "'/>", 4);
+  const char *const small = "<doc a='x'/>";
+
+  XML_Parser parser = XML_ParserCreate_MM(NULL, &memsuite, NULL);
+  assert_true(parser != NULL);
+
+  /* A document like the last one finds its string pools large enough */
+  unsigned int firstAllocs = 0;
+  for (int round = 0; round < 2; round++) {
+    assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+    g_retention_allocs = 0;
+    if (XML_Parse(parser, big, (int)strlen(big), XML_TRUE) == XML_STATUS_ERROR)
+      xml_failure(parser);
+    if (round == 0)
+      firstAllocs = g_retention_allocs;
+  }
+  assert_true(g_retention_allocs < firstAllocs);
+
+  /* The memory for it goes once enough smaller documents came after it;
+     the input buffer stays */
+  const size_t pooled = valueLength * sizeof(XML_Char);
+  assert_true(XML_SetMemoryRetention(parser, 2) == XML_TRUE);
+  assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+  const size_t held = g_retention_bytes;
+  for (int round = 0; round < 2; round++) {
+    if (XML_Parse(parser, small, (int)strlen(small), XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(parser);
+    assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+    if (round == 0)
+      assert_true(g_retention_bytes >= held);
+    else
+      assert_true(g_retention_bytes + pooled <= held);
+  }
+
+  /* Trimming lets go of the rest, so the next document allocates again */
+  const size_t retained = g_retention_bytes;
+  assert_true(XML_TrimMemory(parser) == XML_TRUE);
+  assert_true(g_retention_bytes < retained);
+  g_retention_allocs = 0;
+  if (XML_Parse(parser, small, (int)strlen(small), XML_FALSE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(g_retention_allocs > 0);
+  assert_true(XML_TrimMemory(parser) == XML_FALSE);
+  XML_ParserFree(parser);
+  free(big);
+
+  /* A buffer from XML_GetBuffer stays valid for XML_ParseBuffer */
+  parser = XML_ParserCreate(NULL);
+  char *const buffer = XML_GetBuffer(parser, 16);
+  assert_true(buffer != NULL);
+  assert_true(XML_TrimMemory(parser) == XML_TRUE);
+  memcpy(buffer, "<doc/>", 6);
+  if (XML_ParseBuffer(parser, 6, XML_TRUE) == XML_STATUS_ERROR)
+    xml_failure(parser);
+  XML_ParserFree(parser);
+
+  assert_true(XML_SetMemoryRetention(NULL, 1) == XML_FALSE);
+  assert_true(XML_TrimMemory(NULL) == XML_FALSE);
+  parser = XML_ParserCreate(NULL);
+  assert_true(XML_SetMemoryRetention(parser, 17) == XML_FALSE);
+  assert_true(XML_SetMemoryRetention(parser, 0) == XML_TRUE);
+  XML_ParserFree(parser);
+}
+END_TEST
+
+START_TEST(test_misc_document_arena) {
+  const XML_Memory_Handling_Suite memsuite
+      = {retention_malloc, retention_realloc, retention_free};
+  /* The long name has to grow the tag buffer, and the second binding of b
+     has to grow the memory of the first */
+  const char *const text
+      = "<a:doc xmlns:a='A'>"
+        "<a:element-with-a-name-longer-than-a-tag-buffer xmlns:b='B'>"
+        "<b:e><e/></b:e>"
+        "</a:element-with-a-name-longer-than-a-tag-buffer>"
+        "<b:e xmlns:b='B-is-now-a-namespace-name-longer-than-before'/>"
+        "</a:doc>";
+  const XML_Char *const expected = XCS("A|doc")
+      XCS("A|element-with-a-name-longer-than-a-tag-buffer") XCS("B|e")
+      XCS("e/e/B|e/A|element-with-a-name-longer-than-a-tag-buffer")
+      XCS("B-is-now-a-namespace-name-longer-than-before|e")
+      XCS("/B-is-now-a-namespace-name-longer-than-before|e/A|doc");
+  unsigned int allocs[2];
+  unsigned int frees[2];
+
+  for (int arena = 0; arena < 2; arena++) {
+    g_retention_allocs = 0;
+    XML_Parser parser = XML_ParserCreate_MM(NULL, &memsuite, XCS("|"));
+    assert_true(parser != NULL);
+    assert_true(XML_SetDocumentArena(parser, arena ? XML_TRUE : XML_FALSE)
+                == XML_TRUE);
+    for (int round = 0; round < 2; round++) {
+      CharData storage;
+      CharData_Init(&storage);
+      XML_SetUserData(parser, &storage);
+      XML_SetElementHandler(parser, start_element_event_handler,
+                            end_element_event_handler);
+      if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+          == XML_STATUS_ERROR)
+        xml_failure(parser);
+      CharData_CheckXMLChars(&storage, expected);
+      if (round == 0) {
+        allocs[arena] = g_retention_allocs;
+        assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+        g_retention_allocs = 0;
+      }
+    }
+    /* The next document finds all the memory it needs */
+    assert_true(g_retention_allocs == 0);
+    g_retention_frees = 0;
+    XML_ParserFree(parser);
+    frees[arena] = g_retention_frees;
+  }
+  assert_true(allocs[1] < allocs[0]);
+  assert_true(frees[1] < frees[0]);
+
+  XML_Parser parser = XML_ParserCreate(NULL);
+  assert_true(XML_SetDocumentArena(parser, 2) == XML_FALSE);
+  assert_true(XML_SetDocumentArena(parser, XML_TRUE) == XML_TRUE);
+  XML_Parser ext_parser
+      = XML_ExternalEntityParserCreate(parser, XCS(""), NULL);
+  assert_true(ext_parser != NULL);
+  assert_true(XML_SetDocumentArena(ext_parser, XML_FALSE) == XML_FALSE);
+  XML_ParserFree(ext_parser);
+  if (XML_Parse(parser, "<doc>", 5, XML_FALSE) == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(XML_SetDocumentArena(parser, XML_FALSE) == XML_FALSE);
+  assert_true(XML_TrimMemory(parser) == XML_FALSE);
+  assert_true(XML_ParserReset(parser, NULL) == XML_TRUE);
+  assert_true(XML_TrimMemory(parser) == XML_TRUE);
+  assert_true(XML_SetDocumentArena(parser, XML_FALSE) == XML_TRUE);
+  XML_ParserFree(parser);
+  assert_true(XML_SetDocumentArena(NULL, XML_TRUE) == XML_FALSE);
+}
+END_TEST
+
+static void XMLCALL
+record_element_symbol_id(void *userData, const XML_Char *name, int nameId,
+                         const XML_Char **atts, const int *attIds) {
+  int *const ids = (int *)userData;
+  UNUSED_P(atts);
+  UNUSED_P(attIds);
+  if (xcstrcmp(name, XCS("item")) == 0)
+    ids[0] = nameId;
+  else if (xcstrcmp(name, XCS("other")) == 0)
+    ids[1] = nameId;
+}
+
+START_TEST(test_misc_fragment_parser) {
+  const char *const prolog = "<!DOCTYPE d [<!ATTLIST b x CDATA 'X'>]>\n"
+                             "<d xmlns='D' xmlns:p='P'>";
+  const char *const pieces[]
+      = {"<p:a><b/></p:a>", "<b><![CDATA[text]]></b>", "<p:c/>"};
+  const XML_Char *const expected[]
+      = {XCS("(P|a)\n(D|b(x=X))\n/D|b/P|a/D|d"), XCS("(D|b(x=X))\ntext/D|b"),
+         XCS("(P|c)\n/P|c")};
+  const char *const bad_pieces[] = {"<b>", "</b><b/>", "x]]><b/>"};
+  CharData storage[3];
+  XML_Parser fragment_parsers[3];
+
+  XML_Parser parser = XML_ParserCreateNS(NULL, XCS('|'));
+  XML_SetElementHandler(parser, accumulate_start_element,
+                        end_element_event_handler);
+  XML_SetCharacterDataHandler(parser, accumulate_characters);
+  CharData_Init(&storage[0]);
+  XML_SetUserData(parser, &storage[0]);
+  /* The start tag of the document element has to be through, rather than
+     held back by reparse deferral, when the fragment parsers are created */
+  if (XML_Parse(parser, prolog, (int)strlen(prolog), XML_FALSE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  for (int i = 0; i < 3; i++) {
+    CharData_Init(&storage[i]);
+    fragment_parsers[i] = XML_FragmentParserCreate(parser, NULL);
+    assert_true(fragment_parsers[i] != NULL);
+    XML_SetUserData(fragment_parsers[i], &storage[i]);
+  }
+
+  /* The first piece goes to the parser of the document, which is done and
+     freed before the fragment parsers even start */
+  CharData_Init(&storage[0]);
+  if (_XML_Parse_SINGLE_BYTES(parser, pieces[0], (int)strlen(pieces[0]),
+                              XML_FALSE)
+          == XML_STATUS_ERROR
+      || _XML_Parse_SINGLE_BYTES(parser, "</d>", 4, XML_TRUE)
+             == XML_STATUS_ERROR)
+    xml_failure(parser);
+  XML_ParserFree(parser);
+  XML_ParserFree(fragment_parsers[0]);
+  for (int i = 1; i < 3; i++) {
+    if (_XML_Parse_SINGLE_BYTES(fragment_parsers[i], pieces[i],
+                                (int)strlen(pieces[i]), XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(fragment_parsers[i]);
+    XML_ParserFree(fragment_parsers[i]);
+  }
+  for (int i = 0; i < 3; i++)
+    CharData_CheckXMLChars(&storage[i], expected[i]);
+
+  /* A wrong guess at a split point shows as a failing fragment */
+  parser = XML_ParserCreateNS(NULL, XCS('|'));
+  if (XML_Parse(parser, prolog, (int)strlen(prolog), XML_FALSE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  for (int i = 0; i < 3; i++) {
+    XML_Parser fragment_parser = XML_FragmentParserCreate(parser, NULL);
+    assert_true(fragment_parser != NULL);
+    assert_true(_XML_Parse_SINGLE_BYTES(fragment_parser, bad_pieces[i],
+                                        (int)strlen(bad_pieces[i]), XML_TRUE)
+                == XML_STATUS_ERROR);
+    XML_ParserFree(fragment_parser);
+  }
+#ifdef XML_DTD
+  XML_Parser ext_parser = XML_ExternalEntityParserCreate(parser, NULL, NULL);
+  assert_true(ext_parser != NULL);
+  assert_true(XML_FragmentParserCreate(ext_parser, NULL) == NULL);
+  XML_ParserFree(ext_parser);
+#endif
+  XML_ParserFree(parser);
+  assert_true(XML_FragmentParserCreate(NULL, NULL) == NULL);
+
+  /* Names keep the symbol IDs that the document parser gave them, and new
+     names get IDs after those */
+  int ids[2] = {0, 0};
+  parser = XML_ParserCreate(NULL);
+  assert_true(XML_GetSymbolId(parser, XCS("item")) == 1);
+  XML_SetElementIdHandler(parser, record_element_symbol_id, NULL);
+  XML_SetUserData(parser, ids);
+  if (XML_Parse(parser, "<root>", 6, XML_FALSE) == XML_STATUS_ERROR)
+    xml_failure(parser);
+  const int rootId = XML_GetSymbolId(parser, XCS("root"));
+  assert_true(rootId == 2);
+  XML_Parser fragment_parser = XML_FragmentParserCreate(parser, NULL);
+  assert_true(fragment_parser != NULL);
+  if (_XML_Parse_SINGLE_BYTES(fragment_parser, "<other/><item/>", 15,
+                              XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(fragment_parser);
+  assert_true(ids[0] == 1);
+  assert_true(ids[1] == rootId + 1);
+  assert_true(XML_GetSymbolId(fragment_parser, XCS("root")) == rootId);
+  XML_ParserFree(fragment_parser);
+  XML_ParserFree(parser);
+}
+END_TEST
+
+typedef struct {
+  const char *s[4];
+  int len[4];
+  int count;
+} ScannedRecords;
+
+static void XMLCALL
+record_scanned_record(void *userData, const char *s, int len) {
+  ScannedRecords *const records = userData;
+  assert_true(records->count < 4);
+  records->s[records->count] = s;
+  records->len[records->count] = len;
+  records->count++;
+}
+
+START_TEST(test_misc_scan_records) {
+  const char *const start = "<feed xmlns='F'>";
+  const char *const content
+      = "\n <item n='1'>a<![CDATA[</item>]]></item>\n <!-- <item> -->"
+        "\n <item/>\n <item><x>b</x></item>\n</feed>";
+  const char *const records[]
+      = {"<item n='1'>a<![CDATA[</item>]]></item>", "<item/>",
+         "<item><x>b</x></item>"};
+  const XML_Char *const expected[]
+      = {XCS("F|itema</item>/F|item"), XCS("F|item/F|item"),
+         XCS("F|itemF|xb/F|x/F|item")};
+  const int content_len = (int)strlen(content);
+  const int end_tag_offset = content_len - (int)strlen("</feed>");
+  ScannedRecords scanned;
+
+  /* A fresh parser is not in content */
+  XML_Parser parser = XML_ParserCreateNS(NULL, XCS('|'));
+  assert_true(XML_ScanRecords(parser, content, content_len,
+                              record_scanned_record, &scanned)
+              == -1);
+  if (XML_Parse(parser, start, (int)strlen(start), XML_FALSE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+
+  scanned.count = 0;
+  assert_true(XML_ScanRecords(parser, content, content_len,
+                              record_scanned_record, &scanned)
+              == end_tag_offset);
+  assert_true(scanned.count == 3);
+  for (int i = 0; i < 3; i++) {
+    assert_true(scanned.len[i] == (int)strlen(records[i]));
+    assert_true(memcmp(scanned.s[i], records[i], scanned.len[i]) == 0);
+
+    CharData storage;
+    CharData_Init(&storage);
+    XML_Parser fragment_parser = XML_FragmentParserCreate(parser, NULL);
+    assert_true(fragment_parser != NULL);
+    XML_SetUserData(fragment_parser, &storage);
+    XML_SetElementHandler(fragment_parser, start_element_event_handler,
+                          end_element_event_handler);
+    XML_SetCharacterDataHandler(fragment_parser, accumulate_characters);
+    if (_XML_Parse_SINGLE_BYTES(fragment_parser, scanned.s[i], scanned.len[i],
+                                XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(fragment_parser);
+    CharData_CheckXMLChars(&storage, expected[i]);
+    XML_ParserFree(fragment_parser);
+  }
+
+  /* Input that ends inside a record, even inside a CDATA section, is
+     scanned up to the start of that record */
+  const int third_offset = (int)(scanned.s[2] - content);
+  scanned.count = 0;
+  assert_true(XML_ScanRecords(parser, content, third_offset + 9,
+                              record_scanned_record, &scanned)
+              == third_offset);
+  assert_true(scanned.count == 2);
+  scanned.count = 0;
+  assert_true(XML_ScanRecords(parser, content, 20, record_scanned_record,
+                              &scanned)
+              == 2);
+  assert_true(scanned.count == 0);
+  assert_true(XML_ScanRecords(parser, "<item>&;</item>", 15,
+                              record_scanned_record, &scanned)
+              == -1);
+
+  if (XML_Parse(parser, content + end_tag_offset,
+                content_len - end_tag_offset, XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(XML_ScanRecords(parser, content, content_len,
+                              record_scanned_record, &scanned)
+              == -1);
+  XML_ParserFree(parser);
+  assert_true(XML_ScanRecords(NULL, content, content_len,
+                              record_scanned_record, &scanned)
+              == -1);
+}
+END_TEST
+
+typedef struct {
+  CharData storage;
+  XML_Parser parser;
+  int maxEvents;
+  XML_Bool keep;
+  XML_EventBatch batches[8];
+  int count;
+  XML_Index firstByteIndex;
+} EventBatches;
+
+static void
+append_event(CharData *storage, const XML_Event *event) {
+  switch (event->type) {
+  case XML_EVENT_START_ELEMENT:
+    CharData_AppendXMLChars(storage, XCS("S"), 1);
+    CharData_AppendXMLChars(storage, event->name, -1);
+    for (int i = 0; event->atts[i]; i += 2) {
+      CharData_AppendXMLChars(storage, XCS(" "), 1);
+      CharData_AppendXMLChars(storage, event->atts[i], -1);
+      CharData_AppendXMLChars(storage, XCS("="), 1);
+      CharData_AppendXMLChars(storage, event->atts[i + 1], -1);
+    }
+    break;
+  case XML_EVENT_END_ELEMENT:
+    CharData_AppendXMLChars(storage, XCS("E"), 1);
+    CharData_AppendXMLChars(storage, event->name, -1);
+    break;
+  case XML_EVENT_CHARACTER_DATA:
+    CharData_AppendXMLChars(storage, XCS("C"), 1);
+    CharData_AppendXMLChars(storage, event->data, event->dataLen);
+    break;
+  case XML_EVENT_PROCESSING_INSTRUCTION:
+    assert_true(event->dataLen == (int)xcstrlen(event->data));
+    CharData_AppendXMLChars(storage, XCS("P"), 1);
+    CharData_AppendXMLChars(storage, event->name, -1);
+    CharData_AppendXMLChars(storage, XCS(" "), 1);
+    CharData_AppendXMLChars(storage, event->data, event->dataLen);
+    break;
+  case XML_EVENT_COMMENT:
+    assert_true(event->dataLen == (int)xcstrlen(event->data));
+    CharData_AppendXMLChars(storage, XCS("M"), 1);
+    CharData_AppendXMLChars(storage, event->data, event->dataLen);
+    break;
+  case XML_EVENT_START_CDATA_SECTION:
+    CharData_AppendXMLChars(storage, XCS("["), 1);
+    break;
+  case XML_EVENT_END_CDATA_SECTION:
+    CharData_AppendXMLChars(storage, XCS("]"), 1);
+    break;
+  default:
+    fail("unknown event type");
+  }
+  CharData_AppendXMLChars(storage, XCS(";"), 1);
+}
+
+static void XMLCALL
+record_event_batch(void *userData, XML_EventBatch batch) {
+  EventBatches *const batches = userData;
+  int count = 0;
+  const XML_Event *const events = XML_GetEventBatchEvents(batch, &count);
+  assert_true((count >= 1) && (count <= batches->maxEvents));
+  assert_true(batches->count < 8);
+  if (batches->count == 0)
+    batches->firstByteIndex = events[0].byteIndex;
+  batches->batches[batches->count++] = batch;
+  for (int i = 0; i < count; i++)
+    append_event(&batches->storage, &events[i]);
+  if (! batches->keep)
+    XML_ReleaseEventBatch(batches->parser, batch);
+}
+
+START_TEST(test_misc_event_batches) {
+  const char *const prolog = "<?xml version='1.0'?>\n";
+  const char *const text = "<d a='1' b='2'>x&amp;y<![CDATA[z]]><?p q?>"
+                           "<!--c--><e/></d>";
+  const XML_Char *const expected
+      = XCS("Sd a=1 b=2;Cx&y;[;Cz;];Pp q;Mc;Se;Ee;Ed;");
+  EventBatches batches;
+  XML_Parser parser = XML_ParserCreate(NULL);
+
+  assert_true(XML_SetEventBatchHandler(NULL, record_event_batch, 3)
+              == XML_FALSE);
+  assert_true(XML_SetEventBatchHandler(parser, record_event_batch, 0)
+              == XML_FALSE);
+  assert_true(XML_SetEventBatchHandler(parser, NULL, 0) == XML_TRUE);
+
+  /* Batches released by the handler are reused */
+  for (int keep = 0; keep <= 1; keep++) {
+    CharData_Init(&batches.storage);
+    batches.parser = parser;
+    batches.maxEvents = 3;
+    batches.keep = (XML_Bool)keep;
+    batches.count = 0;
+    XML_SetUserData(parser, &batches);
+    assert_true(XML_SetEventBatchHandler(parser, record_event_batch, 3)
+                == XML_TRUE);
+    /* Handlers do not see the events that are recorded */
+    init_dummy_handlers();
+    XML_SetElementHandler(parser, dummy_start_element, dummy_end_element);
+    XML_SetProcessingInstructionHandler(parser, dummy_pi_handler);
+    XML_SetCommentHandler(parser, dummy_comment_handler);
+    XML_SetCdataSectionHandler(parser, dummy_start_cdata_handler,
+                               dummy_end_cdata_handler);
+    if (XML_Parse(parser, prolog, (int)strlen(prolog), XML_FALSE)
+        == XML_STATUS_ERROR)
+      xml_failure(parser);
+    if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+        == XML_STATUS_ERROR)
+      xml_failure(parser);
+    assert_true(XML_SetEventBatchHandler(parser, record_event_batch, 3)
+                == XML_FALSE);
+    CharData_CheckXMLChars(&batches.storage, expected);
+    assert_true(batches.count == 4);
+    assert_true(batches.firstByteIndex == (XML_Index)strlen(prolog));
+    assert_true(get_dummy_handler_flags() == 0);
+    for (int i = 1; i < batches.count; i++)
+      assert_true((batches.batches[i] == batches.batches[0]) == ! keep);
+
+    /* Kept batches stay valid after the parse buffer is gone */
+    if (keep) {
+      CharData_Init(&batches.storage);
+      for (int i = 0; i < batches.count; i++) {
+        int count = 0;
+        const XML_Event *const events
+            = XML_GetEventBatchEvents(batches.batches[i], &count);
+        for (int j = 0; j < count; j++)
+          append_event(&batches.storage, &events[j]);
+        XML_ReleaseEventBatch(parser, batches.batches[i]);
+      }
+      CharData_CheckXMLChars(&batches.storage, expected);
+    }
+    XML_ParserReset(parser, NULL);
+  }
+
+  /* XML_ParserReset turned event batches off */
+  CharData_Init(&batches.storage);
+  batches.count = 0;
+  XML_SetUserData(parser, &batches);
+  init_dummy_handlers();
+  XML_SetElementHandler(parser, dummy_start_element, dummy_end_element);
+  if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(batches.count == 0);
+  assert_true(get_dummy_handler_flags() == DUMMY_START_ELEMENT_HANDLER_FLAG);
+  XML_ParserFree(parser);
+
+  int count = -1;
+  assert_true(XML_GetEventBatchEvents(NULL, &count) == NULL);
+  assert_true(count == 0);
+  XML_ReleaseEventBatch(NULL, NULL);
+}
+END_TEST
+
+static int XMLCALL
+event_batch_entity_loader(XML_Parser parser, const XML_Char *context,
+                          const XML_Char *base, const XML_Char *systemId,
+                          const XML_Char *publicId) {
+  const char *const text = "<f>t</f>c";
+  UNUSED_P(base);
+  UNUSED_P(systemId);
+  UNUSED_P(publicId);
+  XML_Parser ext_parser = XML_ExternalEntityParserCreate(parser, context, NULL);
+  if (ext_parser == NULL)
+    fail("Could not create external entity parser.");
+  assert_true(XML_SetEventBatchHandler(ext_parser, record_event_batch, 2)
+              == XML_FALSE);
+  if (_XML_Parse_SINGLE_BYTES(ext_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR) {
+    xml_failure(ext_parser);
+    return XML_STATUS_ERROR;
+  }
+  XML_ParserFree(ext_parser);
+  return XML_STATUS_OK;
+}
+
+START_TEST(test_misc_event_batches_external_entity) {
+  const char *const text = "<!DOCTYPE d [<!ENTITY e SYSTEM 'e.ent'>]>\n"
+                           "<d>a&e;b</d>";
+  EventBatches batches;
+  XML_Parser parser = XML_ParserCreate(NULL);
+
+  CharData_Init(&batches.storage);
+  batches.parser = parser;
+  batches.maxEvents = 2;
+  batches.keep = XML_FALSE;
+  batches.count = 0;
+  XML_SetUserData(parser, &batches);
+  XML_SetExternalEntityRefHandler(parser, event_batch_entity_loader);
+  assert_true(XML_SetEventBatchHandler(parser, record_event_batch, 2)
+              == XML_TRUE);
+  if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  /* The events of the external entity are in document order */
+  CharData_CheckXMLChars(&batches.storage,
+                         XCS("Sd;Ca;Sf;Ct;Ef;Cc;Cb;Ed;"));
+
+  /* A pull parser does not suspend while parsing the entity, and merges
+     the character data around its end */
+  XML_ParserReset(parser, NULL);
+  CharData_Init(&batches.storage);
+  XML_SetExternalEntityRefHandler(parser, event_batch_entity_loader);
+  assert_true(XML_SetPullParsing(parser, 1) == XML_TRUE);
+  if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  const XML_Event *event;
+  while (XML_NextEvent(parser, &event) == XML_STATUS_OK && event)
+    append_event(&batches.storage, event);
+  if (XML_GetErrorCode(parser) != XML_ERROR_NONE)
+    xml_failure(parser);
+  CharData_CheckXMLChars(&batches.storage,
+                         XCS("Sd;Ca;Sf;Ct;Ef;Ccb;Ed;"));
+  XML_ParserFree(parser);
+}
+END_TEST
+
+typedef struct {
+  XML_Parser parser;
+  const XML_Event *events;
+  CharData storage;
+  int calls;
+} EventArray;
+
+static void XMLCALL
+record_event_array(void *userData, const XML_Event *events, int count) {
+  EventArray *const array = userData;
+  assert_true(events == array->events);
+  assert_true((count >= 1) && (count <= 3));
+  for (int i = 0; i < count; i++) {
+    const XML_Event *const event = &events[i];
+    if ((event->type == XML_EVENT_START_ELEMENT)
+        || (event->type == XML_EVENT_END_ELEMENT))
+      assert_true(event->nameId == XML_GetSymbolId(array->parser, event->name));
+    else
+      assert_true(event->nameId == 0);
+    for (int j = 0; event->atts && event->atts[2 * j]; j++)
+      assert_true(event->attIds[j]
+                  == XML_GetSymbolId(array->parser, event->atts[2 * j]));
+    append_event(&array->storage, event);
+  }
+  array->calls++;
+}
+
+static void XMLCALL
+record_event_array_start(void *userData, const XML_Char *name,
+                         const XML_Char **atts) {
+  EventArray *const array = userData;
+  UNUSED_P(atts);
+  CharData_AppendXMLChars(&array->storage, name, -1);
+}
+
+START_TEST(test_misc_event_array) {
+  const char *const text = "<d a='1' b='2'>x&amp;y<![CDATA[z]]><?p q?>"
+                           "<!--c--><e/></d>";
+  XML_Event events[3];
+  EventArray array;
+  XML_Parser parser = XML_ParserCreate(NULL);
+
+  assert_true(XML_SetEventArrayHandler(NULL, record_event_array, events, 3)
+              == XML_FALSE);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, NULL, 3)
+              == XML_FALSE);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, events, 0)
+              == XML_FALSE);
+  assert_true(XML_SetEventArrayHandler(parser, NULL, NULL, 0) == XML_TRUE);
+
+  /* Event arrays replace event batches */
+  assert_true(XML_SetEventBatchHandler(parser, record_event_batch, 3)
+              == XML_TRUE);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, events, 3)
+              == XML_TRUE);
+  array.parser = parser;
+  array.events = events;
+  CharData_Init(&array.storage);
+  array.calls = 0;
+  XML_SetUserData(parser, &array);
+  if (_XML_Parse_SINGLE_BYTES(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, events, 3)
+              == XML_FALSE);
+  assert_true(array.calls >= 4);
+
+  /* Character data is only merged within a call to XML_Parse */
+  XML_ParserReset(parser, NULL);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, events, 3)
+              == XML_TRUE);
+  CharData_Init(&array.storage);
+  array.calls = 0;
+  XML_SetUserData(parser, &array);
+  if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  CharData_CheckXMLChars(&array.storage,
+                         XCS("Sd a=1 b=2;Cx&y;[;Cz;];Pp q;Mc;Se;Ee;Ed;"));
+  assert_true(array.calls == 4);
+
+  /* Fragment parsers leave the event array of their parser alone, and
+     call the handlers unless they get an array of their own */
+  XML_ParserReset(parser, NULL);
+  assert_true(XML_SetEventArrayHandler(parser, record_event_array, events, 3)
+              == XML_TRUE);
+  CharData_Init(&array.storage);
+  array.calls = 0;
+  XML_SetUserData(parser, &array);
+  if (XML_Parse(parser, "<d>", 3, XML_FALSE) == XML_STATUS_ERROR)
+    xml_failure(parser);
+  assert_true(array.calls == 1);
+  XML_Parser fragment_parser = XML_FragmentParserCreate(parser, NULL);
+  assert_true(fragment_parser != NULL);
+  XML_SetStartElementHandler(fragment_parser, record_event_array_start);
+  if (XML_Parse(fragment_parser, "<e/>", 4, XML_TRUE) == XML_STATUS_ERROR)
+    xml_failure(fragment_parser);
+  XML_ParserFree(fragment_parser);
+  CharData_CheckXMLChars(&array.storage, XCS("Sd;e"));
+  assert_true(array.calls == 1);
+
+  XML_Event fragment_events[3];
+  EventArray fragment_array;
+  fragment_parser = XML_FragmentParserCreate(parser, NULL);
+  assert_true(fragment_parser != NULL);
+  assert_true(XML_SetEventArrayHandler(fragment_parser, record_event_array,
+                                       fragment_events, 3)
+              == XML_TRUE);
+  fragment_array.parser = fragment_parser;
+  fragment_array.events = fragment_events;
+  CharData_Init(&fragment_array.storage);
+  fragment_array.calls = 0;
+  XML_SetUserData(fragment_parser, &fragment_array);
+  if (XML_Parse(fragment_parser, "<e/>", 4, XML_TRUE) == XML_STATUS_ERROR)
+    xml_failure(fragment_parser);
+  XML_ParserFree(fragment_parser);
+  CharData_CheckXMLChars(&fragment_array.storage, XCS("Se;Ee;"));
+  assert_true(array.calls == 1);
+  XML_ParserFree(parser);
+}
+END_TEST
+
+START_TEST(test_misc_pull_parsing) {
+  const char *const prolog = "<?xml version='1.0'?>\n";
+  const char *const text = "<d a='1' b='2'>x&amp;y<![CDATA[z]]><?p q?>"
+                           "<!--c--><e/></d>";
+  CharData storage;
+  const XML_Event *event = NULL;
+  XML_ParsingStatus status;
+  XML_Parser parser = XML_ParserCreate(NULL);
+
+  assert_true(XML_SetPullParsing(NULL, 2) == XML_FALSE);
+  assert_true(XML_SetPullParsing(parser, -1) == XML_FALSE);
+  assert_true(XML_NextEvent(NULL, &event) == XML_STATUS_ERROR);
+  assert_true(XML_NextEvent(parser, &event) == XML_STATUS_ERROR);
+  assert_true(XML_GetErrorCode(parser) == XML_ERROR_INVALID_ARGUMENT);
+  assert_true(XML_SetPullParsing(parser, 2) == XML_TRUE);
+  assert_true(XML_NextEvent(parser, NULL) == XML_STATUS_ERROR);
+
+  /* Without events to return, XML_Parse does not suspend */
+  init_dummy_handlers();
+  XML_SetElementHandler(parser, dummy_start_element, dummy_end_element);
+  if (XML_Parse(parser, prolog, (int)strlen(prolog), XML_FALSE)
+      != XML_STATUS_OK)
+    xml_failure(parser);
+  assert_true(XML_SetPullParsing(parser, 2) == XML_FALSE);
+  assert_true(XML_NextEvent(parser, &event) == XML_STATUS_OK);
+  assert_true(event == NULL);
+
+  assert_true(XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+              == XML_STATUS_SUSPENDED);
+  CharData_Init(&storage);
+  int count = 0;
+  while (XML_NextEvent(parser, &event) == XML_STATUS_OK && event) {
+    if (count++ == 0)
+      assert_true(event->byteIndex == (XML_Index)strlen(prolog));
+    append_event(&storage, event);
+  }
+  if (XML_GetErrorCode(parser) != XML_ERROR_NONE)
+    xml_failure(parser);
+  CharData_CheckXMLChars(&storage,
+                         XCS("Sd a=1 b=2;Cx&y;[;Cz;];Pp q;Mc;Se;Ee;Ed;"));
+  assert_true(get_dummy_handler_flags() == 0);
+  XML_GetParsingStatus(parser, &status);
+  assert_true(status.parsing == XML_FINISHED);
+
+  /* Events recorded before an error can still be pulled */
+  XML_ParserReset(parser, NULL);
+  assert_true(XML_SetPullParsing(parser, 1) == XML_TRUE);
+  assert_true(XML_Parse(parser, "<d><e/></x>", 11, XML_TRUE)
+              == XML_STATUS_SUSPENDED);
+  CharData_Init(&storage);
+  while (XML_NextEvent(parser, &event) == XML_STATUS_OK && event)
+    append_event(&storage, event);
+  assert_true(XML_GetErrorCode(parser) == XML_ERROR_TAG_MISMATCH);
+  assert_true(XML_NextEvent(parser, &event) == XML_STATUS_OK);
+  assert_true(event == NULL);
+  CharData_CheckXMLChars(&storage, XCS("Sd;Se;Ee;"));
+
+  /* XML_ParserReset turned pull parsing off */
+  XML_ParserReset(parser, NULL);
+  if (XML_Parse(parser, text, (int)strlen(text), XML_TRUE)
+      != XML_STATUS_OK)
+    xml_failure(parser);
+  assert_true(XML_NextEvent(parser, &event) == XML_STATUS_ERROR);
+  XML_ParserFree(parser);
+}
+END_TEST
+
 void
 make_miscellaneous_test_case(Suite *s) {
   TCase *tc_misc = tcase_create("miscellaneous tests");
@@ -993,4 +2304,25 @@ make_miscellaneous_test_case(Suite *s) {
   tcase_add_test(tc_misc, test_misc_unknown_encoding_callbacks_protected);
   tcase_add_test(tc_misc, test_misc_input_2gb);
   tcase_add_test(tc_misc, test_misc_low_surrogate_mozilla_bug_2053153);
+  tcase_add_test(tc_misc, test_misc_parser_pool);
+#if defined(XML_POOL_LOCKING) && ! defined(_WIN32)
+  tcase_add_test(tc_misc, test_misc_parser_pool_threads);
+#endif
+  tcase_add_test(tc_misc, test_misc_alloc_parser_pool);
+#if defined(HAVE_PTHREAD_ATFORK)
+  tcase_add_test(tc_misc, test_misc_hash_salt_after_fork);
+#endif
+  tcase_add_test(tc_misc, test_misc_vocabulary);
+  tcase_add_test(tc_misc, test_misc_alloc_vocabulary);
+  tcase_add_test__if_xml_ge(tc_misc, test_misc_dtd_snapshot);
+  tcase_add_test__ifdef_xml_dtd(tc_misc, test_misc_dtd_cache);
+  tcase_add_test(tc_misc, test_misc_memory_retention);
+  tcase_add_test(tc_misc, test_misc_document_arena);
+  tcase_add_test(tc_misc, test_misc_fragment_parser);
+  tcase_add_test(tc_misc, test_misc_scan_records);
+  tcase_add_test(tc_misc, test_misc_event_batches);
+  tcase_add_test__if_xml_ge(tc_misc,
+                            test_misc_event_batches_external_entity);
+  tcase_add_test(tc_misc, test_misc_pull_parsing);
+  tcase_add_test(tc_misc, test_misc_event_array);
 }
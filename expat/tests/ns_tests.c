@@ -45,6 +45,7 @@
 
 #include "expat_config.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #include "expat.h"
@@ -332,6 +333,105 @@ START_TEST(test_ns_duplicate_hashes) {
 }
 END_TEST
 
+/* Test that duplicate attributes are still found after the check has
+   switched over to SipHash because the names collided */
+START_TEST(test_ns_duplicate_attrs_colliding_hashes) {
+  char text[2048];
+  int len = snprintf(text, sizeof(text),
+                     "<doc xmlns:a='http://example.org/a'"
+                     " xmlns:b='http://example.org/a'");
+  for (int i = 0; i < 50; i++)
+    len += snprintf(text + len, sizeof(text) - len, " a:n%d='v'", i);
+  const int unique = len;
+  len += snprintf(text + len, sizeof(text) - len, " b:n7='v'/>");
+  assert_true(len < (int)sizeof(text));
+
+  g_fastHashCollides = XML_TRUE;
+  expect_failure(text, XML_ERROR_DUPLICATE_ATTRIBUTE,
+                 "did not report multiple attributes with same URI+name");
+
+  /* The namespace prefix appended to expanded names is not hashed */
+  XML_ParserReset(g_parser, NULL);
+  XML_SetReturnNSTriplet(g_parser, XML_TRUE);
+  snprintf(text + unique, sizeof(text) - unique, "/>");
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  g_fastHashCollides = XML_FALSE;
+}
+END_TEST
+
+static void XMLCALL
+check_start_element_ids(void *userData, const XML_Char *name, int nameId,
+                        const XML_Char **atts, const int *attIds) {
+  UNUSED_P(userData);
+  if (xcstrcmp(name, XCS("http://example.org/ e")) != 0)
+    fail("Element name was not expanded");
+  if (nameId != XML_GetSymbolId(g_parser, XCS("p:e")))
+    fail("Element ID is not the one of the prefixed name");
+  if (atts[0] == NULL || atts[2] != NULL
+      || attIds[0] != XML_GetSymbolId(g_parser, XCS("p:a")))
+    fail("Attribute ID is not the one of the prefixed name");
+}
+
+/* Test that symbol IDs stand for names as written, prefix included */
+START_TEST(test_ns_element_id_handlers) {
+  const char *text = "<p:e xmlns:p='http://example.org/' p:a='1'/>";
+
+  XML_SetElementIdHandler(g_parser, check_start_element_ids, NULL);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+}
+END_TEST
+
+static void XMLCALL
+record_ns_names(void *userData, const XML_Char *name, const XML_Char **atts) {
+  CharData *const storage = (CharData *)userData;
+
+  CharData_AppendXMLChars(storage, XCS("<"), 1);
+  CharData_AppendXMLChars(storage, name, -1);
+  for (; atts[0] != NULL; atts += 2) {
+    CharData_AppendXMLChars(storage, XCS(" @"), 2);
+    CharData_AppendXMLChars(storage, atts[0], -1);
+  }
+}
+
+/* Test that namespace declarations defaulted in a DTD snapshot apply */
+START_TEST(test_ns_dtd_snapshot) {
+  const char *dtd = "<!DOCTYPE doc [<!ATTLIST doc\n"
+                    "  xmlns CDATA 'http://example.org/'\n"
+                    "  xmlns:p CDATA 'urn:p'>]>\n"
+                    "<doc/>";
+  const char *text = "<doc><p:e p:a='1'/></doc>";
+  const XML_Char *expected = XCS("<http://example.org/ doc")
+      XCS("<urn:p e @urn:p a");
+  CharData storage;
+
+  XML_Parser parser = XML_ParserCreateNS(NULL, XCS(' '));
+  if (_XML_Parse_SINGLE_BYTES(parser, dtd, (int)strlen(dtd), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(parser);
+  XML_DTDSnapshot snapshot = XML_DTDSnapshotCreate(parser);
+  XML_ParserFree(parser);
+  if (snapshot == NULL)
+    fail("XML_DTDSnapshotCreate failed");
+  if (! XML_SetDTDSnapshot(g_parser, snapshot))
+    fail("XML_SetDTDSnapshot failed");
+
+  CharData_Init(&storage);
+  XML_SetUserData(g_parser, &storage);
+  XML_SetStartElementHandler(g_parser, record_ns_names);
+  if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+      == XML_STATUS_ERROR)
+    xml_failure(g_parser);
+  CharData_CheckXMLChars(&storage, expected);
+  XML_ParserFree(g_parser);
+  g_parser = NULL;
+  XML_DTDSnapshotFree(snapshot);
+}
+END_TEST
+
 /* Regression test for SF bug #695401: unbound prefix. */
 START_TEST(test_ns_unbound_prefix_on_attribute) {
   const char *text = "<doc a:attr=''/>";
@@ -734,6 +834,9 @@ make_namespace_test_case(Suite *s) {
   tcase_add_test(tc_namespace, test_ns_default_with_empty_uri);
   tcase_add_test(tc_namespace, test_ns_duplicate_attrs_diff_prefixes);
   tcase_add_test(tc_namespace, test_ns_duplicate_hashes);
+  tcase_add_test(tc_namespace, test_ns_duplicate_attrs_colliding_hashes);
+  tcase_add_test(tc_namespace, test_ns_element_id_handlers);
+  tcase_add_test(tc_namespace, test_ns_dtd_snapshot);
   tcase_add_test(tc_namespace, test_ns_unbound_prefix_on_attribute);
   tcase_add_test(tc_namespace, test_ns_unbound_prefix_on_element);
   tcase_add_test(tc_namespace, test_ns_long_element);
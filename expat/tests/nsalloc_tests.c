@@ -1536,6 +1536,34 @@ START_TEST(test_nsalloc_set_context_zombie) {
 }
 END_TEST
 
+/* Test allocation failures with tags and bindings in a document arena */
+START_TEST(test_nsalloc_document_arena) {
+  const char *text = "<a:e xmlns:a='http://example.org/a'>"
+                     "<a:element-with-a-name-longer-than-a-tag-buffer"
+                     " xmlns:b='http://example.org/b'><b:e/>"
+                     "</a:element-with-a-name-longer-than-a-tag-buffer>"
+                     "<b:e xmlns:b='http://example.org/a-longer-namespace'/>"
+                     "</a:e>";
+  int i;
+  const int max_alloc_count = 30;
+
+  for (i = 0; i < max_alloc_count; i++) {
+    assert_true(XML_SetDocumentArena(g_parser, XML_TRUE) == XML_TRUE);
+    g_allocation_count = i;
+    if (_XML_Parse_SINGLE_BYTES(g_parser, text, (int)strlen(text), XML_TRUE)
+        != XML_STATUS_ERROR)
+      break;
+    /* See comment in test_nsalloc_xmlns() */
+    nsalloc_teardown();
+    nsalloc_setup();
+  }
+  if (i == 0)
+    fail("Parsing worked despite failing allocations");
+  else if (i == max_alloc_count)
+    fail("Parsing failed even at max allocation count");
+}
+END_TEST
+
 void
 make_nsalloc_test_case(Suite *s) {
   TCase *tc_nsalloc = tcase_create("namespace allocation tests");
@@ -1571,4 +1599,5 @@ make_nsalloc_test_case(Suite *s) {
   tcase_add_test(tc_nsalloc, test_nsalloc_long_systemid_in_ext);
   tcase_add_test(tc_nsalloc, test_nsalloc_prefixed_element);
   tcase_add_test(tc_nsalloc, test_nsalloc_set_context_zombie);
+  tcase_add_test(tc_nsalloc, test_nsalloc_document_arena);
 }